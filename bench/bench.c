@@ -0,0 +1,311 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../src/bitstream.h"
+
+/**
+ * Benchmarks of the stream engines.
+ *
+ * Every case runs passes over a buffer until a round has lasted long
+ * enough, the best of a few rounds is kept. Cases cover the field widths
+ * 1..64 in both bit orders, aligned and unaligned starts, fixed and
+ * growable output, buffers from L1 sized to larger than the last level
+ * cache, and read, write, seek, transcode and copy loads.
+ *
+ * usage: bench [--quick] [--json FILE] [--min-ms N] [--rounds N]
+ *
+ * A table goes to stdout, the JSON report to FILE.
+ */
+
+#define BENCH_VALUES 4096
+#define BENCH_SEEKS 4096
+#define BENCH_SEEK_OPS (1 << 16)
+#define BENCH_MAX_BYTES (64 << 20)
+
+typedef enum tagBenchOp { BENCH_READ, BENCH_WRITE, BENCH_SEEK, BENCH_MIX, BENCH_COPY } BenchOp;
+
+static char const *const benchOpNames[] = { "read", "write", "seek", "mix", "copy" };
+
+typedef struct tagBenchCase {
+    BenchOp op;
+    BSBitOrder order;
+    size_t width;
+    size_t align;
+    int growable;
+    size_t bytes;
+} BenchCase;
+
+typedef struct tagBenchResult {
+    uint64_t ns;
+    uint64_t ops;
+    uint64_t bits;
+} BenchResult;
+
+typedef struct tagBenchContext {
+    unsigned char *input;
+    unsigned char *output;
+    uint64_t values[BENCH_VALUES];
+    size_t seeks[BENCH_SEEKS];
+    unsigned minMs;
+    unsigned rounds;
+    FILE *json;
+    size_t reported;
+} BenchContext;
+
+/* keeps the reads from being optimized away. */
+static volatile uint64_t benchSink;
+
+#if defined(__unix__) || defined(__APPLE__)
+static uint64_t benchNow(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000u + (uint64_t) t.tv_nsec;
+}
+#define BENCH_TIMER "clock_gettime(CLOCK_MONOTONIC)"
+#else
+static uint64_t benchNow(void) {
+    return (uint64_t) clock() * (1000000000u / CLOCKS_PER_SEC);
+}
+#define BENCH_TIMER "clock()"
+#endif
+
+static uint64_t nextRandom(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static size_t benchFields(BenchCase const *c) {
+    return (c->bytes * 8 - c->align) / c->width;
+}
+
+/**
+ * One pass of the case, fills in the operations and bits it did. Returns
+ * 0 on success, -1 when the library failed.
+ */
+static int benchPass(BenchContext *ctx, BenchCase const *c, BenchResult *r) {
+    BitInputStream bis;
+    BitOutputStream bos;
+    ReadResult rr;
+    uint64_t sum = 0;
+    size_t n = benchFields(c);
+    size_t i;
+    int rc = 0;
+
+    BitInputStreamInitialize(&bis, ctx->input, c->bytes * 8);
+    BitInputStreamSetBitOrder(&bis, c->order);
+    if (c->growable)
+        BitOutputStreamInitialize(&bos, NULL, 0);
+    else
+        BitOutputStreamInitialize(&bos, ctx->output, c->bytes * 8);
+    BitOutputStreamSetBitOrder(&bos, c->order);
+    BitInputStreamSkipBits(&bis, c->align);
+    /* copies start the output aligned, so that an unaligned input has to be shifted. */
+    BitOutputStreamWriteUInt(&bos, c->op == BENCH_COPY ? 0 : c->align, 0);
+
+    switch (c->op) {
+    case BENCH_READ:
+        for (i = 0; i < n; ++i)
+            sum += BitInputStreamReadUInt(&bis, c->width)._M_value.uint;
+        r->ops = n;
+        r->bits = (uint64_t) n * c->width;
+        break;
+    case BENCH_WRITE:
+        for (i = 0; i < n; ++i)
+            if (!BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, c->width, ctx->values[i & (BENCH_VALUES - 1)])))
+                rc = -1;
+        r->ops = n;
+        r->bits = (uint64_t) n * c->width;
+        break;
+    case BENCH_SEEK:
+        for (i = 0; i < BENCH_SEEK_OPS; ++i) {
+            BitInputStreamSeekBits(&bis, (long) (ctx->seeks[i & (BENCH_SEEKS - 1)] % (c->bytes * 8 - 64)),
+                    SEEK_SET);
+            sum += BitInputStreamReadUInt(&bis, c->width)._M_value.uint;
+        }
+        r->ops = BENCH_SEEK_OPS;
+        r->bits = (uint64_t) BENCH_SEEK_OPS * c->width;
+        break;
+    case BENCH_MIX:
+        /* transcoding: every field read, every eighth one rewritten. */
+        for (i = 0; i < n; ++i) {
+            rr = BitInputStreamReadUInt(&bis, c->width);
+            if (!BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, c->width, (i & 0x7) ? rr._M_value.uint : i)))
+                rc = -1;
+        }
+        r->ops = n;
+        r->bits = (uint64_t) n * c->width;
+        break;
+    case BENCH_COPY:
+        if (!BS_SUCCEEDED(BitStreamCopyBits(&bos, &bis, c->bytes * 8 - c->align)))
+            rc = -1;
+        r->ops = 1;
+        r->bits = c->bytes * 8 - c->align;
+        break;
+    }
+    benchSink += sum;
+    BitOutputStreamRelease(&bos);
+    BitInputStreamRelease(&bis);
+    return rc;
+}
+
+/* the best of the rounds, a round being passes up to the minimum time. */
+static int benchRun(BenchContext *ctx, BenchCase const *c, BenchResult *best) {
+    BenchResult pass;
+    BenchResult round;
+    uint64_t start;
+    uint64_t limit = (uint64_t) ctx->minMs * 1000000u;
+    unsigned k;
+
+    memset(best, 0, sizeof(*best));
+    for (k = 0; k < ctx->rounds; ++k) {
+        memset(&round, 0, sizeof(round));
+        start = benchNow();
+        do {
+            if (benchPass(ctx, c, &pass) != 0)
+                return -1;
+            round.ops += pass.ops;
+            round.bits += pass.bits;
+            round.ns = benchNow() - start;
+        } while (round.ns < limit);
+        if (round.ns == 0)
+            round.ns = 1;
+        if (best->ns == 0 || (double) round.ns / round.ops < (double) best->ns / best->ops)
+            *best = round;
+    }
+    return 0;
+}
+
+static void benchReport(BenchContext *ctx, BenchCase const *c, BenchResult const *r) {
+    double nsPerOp = (double) r->ns / (double) r->ops;
+    double bitsPerNs = (double) r->bits / (double) r->ns;
+    double gbPerS = bitsPerNs / 8;
+
+    fprintf(stdout, "%-5s %-3s w=%-2lu a=%lu %-9s %9lu B  %10.3f ns/op  %8.3f bits/ns  %7.3f GB/s\n",
+            benchOpNames[c->op], c->order == BS_LSB_FIRST ? "lsb" : "msb", (unsigned long) c->width,
+            (unsigned long) c->align, c->growable ? "growable" : "fixed", (unsigned long) c->bytes,
+            nsPerOp, bitsPerNs, gbPerS);
+    if (!ctx->json)
+        return;
+    fprintf(ctx->json, "%s\n    {\"op\": \"%s\", \"order\": \"%s\", \"width\": %lu, \"align\": %lu, "
+            "\"output\": \"%s\", \"buffer_bytes\": %lu, \"ops\": %lu, \"ns\": %lu, "
+            "\"ns_per_op\": %.4f, \"bits_per_ns\": %.4f, \"gb_per_s\": %.4f}",
+            ctx->reported ? "," : "", benchOpNames[c->op], c->order == BS_LSB_FIRST ? "lsb" : "msb",
+            (unsigned long) c->width, (unsigned long) c->align, c->growable ? "growable" : "fixed",
+            (unsigned long) c->bytes, (unsigned long) r->ops, (unsigned long) r->ns,
+            nsPerOp, bitsPerNs, gbPerS);
+    ++ctx->reported;
+}
+
+static int benchCase(BenchContext *ctx, BenchOp op, BSBitOrder order, size_t width, size_t align,
+        int growable, size_t bytes) {
+    BenchCase c;
+    BenchResult r;
+
+    c.op = op;
+    c.order = order;
+    c.width = width;
+    c.align = align;
+    c.growable = growable;
+    c.bytes = bytes;
+    if (benchRun(ctx, &c, &r) != 0) {
+        fprintf(stderr, "%s w=%lu failed\n", benchOpNames[op], (unsigned long) width);
+        return -1;
+    }
+    benchReport(ctx, &c, &r);
+    return 0;
+}
+
+int main(int argc, char* *argv) {
+    static size_t const sizes[] = { 16 << 10, 256 << 10, 8 << 20, BENCH_MAX_BYTES };
+    static size_t const widths[] = { 7, 32, 57 };
+    static BenchContext ctx;
+    char const *jsonPath = NULL;
+    size_t nsizes = sizeof(sizes) / sizeof(sizes[0]);
+    size_t step = 1;
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    int rc = EXIT_FAILURE;
+    int order;
+    int op;
+    int growable;
+    size_t s, w, a, i;
+
+    ctx.minMs = 20;
+    ctx.rounds = 3;
+    for (i = 1; i < (size_t) argc; ++i) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            nsizes = 2;
+            step = 9;
+            ctx.minMs = 5;
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < (size_t) argc) {
+            jsonPath = argv[++i];
+        } else if (strcmp(argv[i], "--min-ms") == 0 && i + 1 < (size_t) argc) {
+            ctx.minMs = (unsigned) atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < (size_t) argc) {
+            ctx.rounds = (unsigned) atoi(argv[++i]);
+            if (ctx.rounds == 0)
+                ctx.rounds = 1;
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [--json FILE] [--min-ms N] [--rounds N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    ctx.input = (unsigned char*) malloc(BENCH_MAX_BYTES);
+    ctx.output = (unsigned char*) malloc(BENCH_MAX_BYTES);
+    if (!ctx.input || !ctx.output)
+        goto cleanup;
+    for (i = 0; i < BENCH_MAX_BYTES; ++i)
+        ctx.input[i] = (unsigned char) nextRandom(&state);
+    memset(ctx.output, 0, BENCH_MAX_BYTES);
+    for (i = 0; i < BENCH_VALUES; ++i)
+        ctx.values[i] = nextRandom(&state);
+    for (i = 0; i < BENCH_SEEKS; ++i)
+        ctx.seeks[i] = (size_t) nextRandom(&state);
+    if (jsonPath) {
+        if (!(ctx.json = fopen(jsonPath, "w"))) {
+            perror(jsonPath);
+            goto cleanup;
+        }
+        fprintf(ctx.json, "{\n  \"library\": \"bitstream\",\n  \"timer\": \"%s\",\n  \"min_ms\": %u,\n"
+                "  \"rounds\": %u,\n  \"results\": [", BENCH_TIMER, ctx.minMs, ctx.rounds);
+    }
+
+    /* every field width on an L1 sized buffer, both orders. */
+    for (order = BS_MSB_FIRST; order <= BS_LSB_FIRST; ++order)
+        for (op = BENCH_READ; op <= BENCH_WRITE; ++op)
+            for (w = 1; w <= 64; w += step)
+                if (benchCase(&ctx, (BenchOp) op, (BSBitOrder) order, w, 0, 0, sizes[0]) != 0)
+                    goto cleanup;
+
+    /* alignments, outputs and buffer sizes for a few widths. */
+    for (s = 0; s < nsizes; ++s) {
+        for (a = 0; a < 8; a += 3) {
+            for (i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+                if (benchCase(&ctx, BENCH_READ, BS_MSB_FIRST, widths[i], a, 0, sizes[s]) != 0
+                        || benchCase(&ctx, BENCH_SEEK, BS_MSB_FIRST, widths[i], a, 0, sizes[s]) != 0)
+                    goto cleanup;
+                for (growable = 0; growable < 2; ++growable)
+                    if (benchCase(&ctx, BENCH_WRITE, BS_MSB_FIRST, widths[i], a, growable, sizes[s]) != 0
+                            || benchCase(&ctx, BENCH_MIX, BS_MSB_FIRST, widths[i], a, growable, sizes[s]) != 0)
+                        goto cleanup;
+            }
+            for (growable = 0; growable < 2; ++growable)
+                if (benchCase(&ctx, BENCH_COPY, BS_MSB_FIRST, 1, a, growable, sizes[s]) != 0)
+                    goto cleanup;
+        }
+    }
+    rc = EXIT_SUCCESS;
+cleanup:
+    if (ctx.json) {
+        fprintf(ctx.json, "\n  ]\n}\n");
+        fclose(ctx.json);
+    }
+    free(ctx.input);
+    free(ctx.output);
+    return rc;
+}
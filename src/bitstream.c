@@ -1,4 +1,5 @@
 #include "bitstream.h"
+#include "bitstream_internal.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -11,21 +12,44 @@ BitInputStream* BitInputStreamInitialize(BitInputStream *bis, void const *bytes,
     bis->_M_bytes = (uint8_t const*) bytes;
     bis->_M_size = bits;
     bis->_M_position = 0;
+    bis->_M_cache = 0;
+    bis->_M_cache_bits = 0;
 
     bis->_M_marked_position = 0;
+    bis->_M_source = NULL;
+    bis->_M_base = 0;
+    bis->_M_error = BS_SUCCESS;
+    bis->_M_order = BS_MSB_FIRST;
     return bis;
 }
 
 void BitInputStreamRelease(BitInputStream *bis) {
     if (bis) {
+        BitStreamSourceDestroy(bis->_M_source);
         bis->_M_bytes = NULL;
         bis->_M_position = 0;
         bis->_M_size = 0;
+        bis->_M_cache = 0;
+        bis->_M_cache_bits = 0;
 
         bis->_M_marked_position = 0;
+        bis->_M_source = NULL;
+        bis->_M_base = 0;
+        bis->_M_error = BS_SUCCESS;
+        bis->_M_order = BS_MSB_FIRST;
     }
 }
 
+/* takes effect from the cursor on, what was read stays as it was read. */
+void BitInputStreamSetBitOrder(BitInputStream *bis, BSBitOrder order) {
+    bis->_M_order = order;
+    bis->_M_cache_bits = 0;
+}
+
+BSBitOrder BitInputStreamGetBitOrder(BitInputStream const *bis) {
+    return bis->_M_order;
+}
+
 int const READ_ONE_BIT_SHIFT_WIDTH[] = {
     7, 6, 5, 4, 3, 2, 1, 0
 };
@@ -33,11 +57,21 @@ int const READ_ONE_BIT_SHIFT_WIDTH[] = {
 ReadResult BitInputStreamReadBit(BitInputStream *bis) {
     ReadResult result;
     result._M_status = BS_SUCCESS;
-    if (bis->_M_position >= bis->_M_size) {
+    BS_STAT_INC(read_calls);
+    if (bis->_M_position >= bis->_M_size && !BitInputStreamFill(bis, 1)) {
+        BS_STAT_INC(eos);
         result._M_status = BS_EOS;
         return result;
     }
-    result._M_value.uint = (bis->_M_bytes[bis->_M_position >> 3] >> READ_ONE_BIT_SHIFT_WIDTH[bis->_M_position & 0x7]) & 0x1;
+    BS_STAT_INC(bits_read);
+    if (bis->_M_cache_bits > 0) {
+        result._M_value.uint = BitInputStreamTake(bis, 1);
+        return result;
+    }
+    if (bis->_M_order == BS_LSB_FIRST)
+        result._M_value.uint = (bis->_M_bytes[bis->_M_position >> 3] >> (bis->_M_position & 0x7)) & 0x1;
+    else
+        result._M_value.uint = (bis->_M_bytes[bis->_M_position >> 3] >> READ_ONE_BIT_SHIFT_WIDTH[bis->_M_position & 0x7]) & 0x1;
     ++bis->_M_position;
     return result;
 }
@@ -47,7 +81,11 @@ void BitInputStreamMark(BitInputStream *bis) {
 }
 
 void BitInputStreamReset(BitInputStream *bis) {
+    /* the mark of a source backed stream may have slid out of the window. */
+    if (bis->_M_marked_position == BS_NO_MARK)
+        return;
     bis->_M_position = bis->_M_marked_position;
+    bis->_M_cache_bits = 0;
 }
 
 ReadResult BitInputStreamReadInt(BitInputStream *bis, size_t bits) {
@@ -57,6 +95,14 @@ ReadResult BitInputStreamReadInt(BitInputStream *bis, size_t bits) {
     result._M_status = BS_SUCCESS;
     result._M_value.sint = 0;
 
+    /* the sign bit is the most significant one, which comes last LSB first. */
+    if (bis->_M_order == BS_LSB_FIRST) {
+        if (!BS_SUCCEEDED(r = BitInputStreamReadUInt(bis, bits)))
+            return r;
+        if (bits > 0 && bits < 64 && (r._M_value.uint >> (bits - 1)))
+            r._M_value.uint |= ~(uint64_t) 0 << bits;
+        return r;
+    }
     if (!BS_SUCCEEDED(r = BitInputStreamReadBit(bis)))
         return r;
     if (r._M_value.uint == 1) {
@@ -70,74 +116,186 @@ ReadResult BitInputStreamReadInt(BitInputStream *bis, size_t bits) {
     return result;
 }
 
-static int const READ_LSB_BITS_OF_ONE_BYTE[] = {
-    0,
-    0x1,
-    (0x1 << 1) | 0x1,
-    (0x1 << 2) | (0x1 << 1) | 0x1,
-    (0x1 << 3) | (0x1 << 2) | (0x1 << 1) | 0x1,
-    (0x1 << 4) | (0x1 << 3) | (0x1 << 2) | (0x1 << 1) | 0x1,
-    (0x1 << 5) | (0x1 << 4) | (0x1 << 3) | (0x1 << 2) | (0x1 << 1) | 0x1,
-    (0x1 << 6) | (0x1 << 5) | (0x1 << 4) | (0x1 << 3) | (0x1 << 2) | (0x1 << 1) | 0x1,
-};
-
-ReadResult BitInputStreamReadUInt(BitInputStream *bis, size_t bits) {
+static ReadResult BitInputStreamReadUIntSlow(BitInputStream *bis, size_t bits) {
     ReadResult result;
-    int pos = bis->_M_position;
-    int w = 0;
+    size_t n;
 
     result._M_status = BS_SUCCESS;
-    if (pos + bits > bis->_M_size) {
+    if (bis->_M_position + bits > bis->_M_size && !BitInputStreamFill(bis, bits)) {
+        BS_STAT_INC(eos);
         result._M_status = BS_EOS;
         return result;
     }
+    BS_STAT_ADD(bits_read, bits);
     result._M_value.uint = 0;
 
+    /**
+     * Only the least significant 64 bits are kept for the wider fields,
+     * the leading ones are shifted out.
+     */
     while (bits > 0) {
-        /* at the byte first bit. */
-        if ((pos & 0x7) == 0) {
-            while (bits >= 8) {
-                /* more than one byte width (8 bits) */
-                result._M_value.uint <<= 8;
-                result._M_value.uint |= bis->_M_bytes[pos >> 3];
-                pos += 8;
-                bits -= 8;
-            }
-            if (bits > 0) {
-                /* less than 8 bits width to read. */
-                result._M_value.uint <<= bits;
-                result._M_value.uint |= (bis->_M_bytes[pos >> 3] >> (8 - bits)) & READ_LSB_BITS_OF_ONE_BYTE[bits];
-                pos += bits;
-                bits = 0;
-                break;
-            }
-        } else {
-            /* next start bit position. */
-            w = ((pos >> 3) + 1) << 3;
-            /* not from the first bit of byte. */
-            if ((int) (pos + bits) >= w) {
-                /* at least to read the remaining bits in one byte. */
-                w -= pos;
-                result._M_value.uint <<= w;
-                result._M_value.uint |= bis->_M_bytes[pos >> 3] & READ_LSB_BITS_OF_ONE_BYTE[w];
-                pos += w;
-                bits -= w;
-            } else {
-                /* less than one byte. */
-                w -= pos + bits;
-                result._M_value.uint <<= bits;
-                result._M_value.uint |= (bis->_M_bytes[pos >> 3] >> w) & READ_LSB_BITS_OF_ONE_BYTE[bits];
-                pos += bits;
-                bits = 0;
-                break;
-            }
-        }
+        if (bis->_M_cache_bits == 0)
+            BitInputStreamRefill(bis);
+        n = bits < bis->_M_cache_bits ? bits : bis->_M_cache_bits;
+        result._M_value.uint = (result._M_value.uint << (n - 1)) << 1;
+        result._M_value.uint |= BitInputStreamTake(bis, n);
+        bits -= n;
+    }
+    return result;
+}
+
+ReadResult BitInputStreamReadUInt(BitInputStream *bis, size_t bits) {
+    ReadResult result;
+
+    /**
+     * `bits - 1` wraps for zero width which goes to the slow path, so does
+     * every read of a LSB first stream as it caches nothing.
+     */
+    BS_STAT_INC(read_calls);
+    if (bits - 1 >= bis->_M_cache_bits) {
+        BS_STAT_INC(read_misses);
+        if (BS_UNLIKELY(bis->_M_order == BS_LSB_FIRST))
+            return BitInputStreamReadUIntLsb(bis, bits);
+        if (bits - 1 >= BS_WINDOW_BITS || bis->_M_position + bits > bis->_M_size)
+            return BitInputStreamReadUIntSlow(bis, bits);
+        BitInputStreamRefill(bis);
+    }
+    BS_STAT_ADD(bits_read, bits);
+    result._M_status = BS_SUCCESS;
+    result._M_value.uint = BitInputStreamTake(bis, bits);
+    return result;
+}
+
+/* 0 when `bits` more bits can be read, -1 otherwise. */
+int BitInputStreamEnsure(BitInputStream *bis, size_t bits) {
+    if (bis->_M_position + bits <= bis->_M_size)
+        return 0;
+    return BitInputStreamFill(bis, bits) ? 0 : -1;
+}
+
+/* out of line half of BitInputStreamReadUIntUnchecked, the window ran short. */
+uint64_t BitInputStreamReadUIntUncheckedSlow(BitInputStream *bis, size_t bits) {
+    uint64_t value = 0;
+    size_t n;
+
+    BS_STAT_INC(read_misses);
+    BS_STAT_ADD(bits_read, bits);
+    if (bis->_M_order == BS_LSB_FIRST) {
+        value = BitStreamExtractLsb(bis->_M_bytes, (bis->_M_size + 7) >> 3, bis->_M_position, bits);
+        bis->_M_position += bits;
+        return value;
     }
+    /* reloading from the cursor serves up to 57 bits at once. */
+    if (BS_LIKELY(bits - 1 < BS_WINDOW_BITS)) {
+        BitInputStreamRefill(bis);
+        return BitInputStreamTake(bis, bits);
+    }
+    while (bits > 0) {
+        if (bis->_M_cache_bits == 0)
+            BitInputStreamRefill(bis);
+        n = bits < bis->_M_cache_bits ? bits : bis->_M_cache_bits;
+        value = ((value << (n - 1)) << 1) | BitInputStreamTake(bis, n);
+        bits -= n;
+    }
+    return value;
+}
+
+/* out of line half of BitInputStreamFetchUInt, also where errors stick. */
+uint64_t BitInputStreamFetchUIntSlow(BitInputStream *bis, size_t bits) {
+    ReadResult r;
+
+    if (bis->_M_error)
+        return 0;
+    if (bits == 0 || bits > 64) {
+        bis->_M_error = BS_FAIL;
+        return 0;
+    }
+    r = BitInputStreamReadUInt(bis, bits);
+    if (!BS_SUCCEEDED(r)) {
+        bis->_M_error = r._M_status;
+        return 0;
+    }
+    return r._M_value.uint;
+}
+
+/* two's complement, the sign bit first. */
+int64_t BitInputStreamFetchInt(BitInputStream *bis, size_t bits) {
+    uint64_t value = BitInputStreamFetchUInt(bis, bits);
+    uint64_t sign = (uint64_t) 1 << ((bits - 1) & 0x3f);
+
+    return (int64_t) ((value ^ sign) - sign);
+}
+
+/* sign and magnitude, as BitInputStreamReadSInt. */
+int64_t BitInputStreamFetchSInt(BitInputStream *bis, size_t bits) {
+    int sign = BitInputStreamFetchBit(bis);
+    int64_t value = bits > 1 ? (int64_t) BitInputStreamFetchUInt(bis, bits - 1) : 0;
+
+    return sign ? -value : value;
+}
 
-    bis->_M_position = pos;
+BSStatus BitInputStreamGetError(BitInputStream const *bis) {
+    return (BSStatus) bis->_M_error;
+}
+
+void BitInputStreamClearError(BitInputStream *bis) {
+    bis->_M_error = BS_SUCCESS;
+}
+
+/**
+ * The next 1..64 bits without consuming them. Wider than the cached
+ * window, the byte after the window is merged in.
+ */
+ReadResult BitInputStreamPeekUInt(BitInputStream *bis, size_t bits) {
+    ReadResult result;
+    size_t pos;
+    size_t nbytes;
+
+    result._M_status = BS_SUCCESS;
+    result._M_value.uint = 0;
+    if (bits > 64) {
+        result._M_status = BS_FAIL;
+        return result;
+    }
+    if (bits == 0)
+        return result;
+    if (bis->_M_order == BS_LSB_FIRST)
+        return BitInputStreamPeekUIntLsb(bis, bits);
+    if (bits > bis->_M_cache_bits) {
+        if (bis->_M_position + bits > bis->_M_size && !BitInputStreamFill(bis, bits)) {
+            result._M_status = BS_EOS;
+            return result;
+        }
+        BitInputStreamRefill(bis);
+        if (bits > bis->_M_cache_bits) {
+            pos = bis->_M_position;
+            nbytes = (bis->_M_size + 7) >> 3;
+            result._M_value.uint = bis->_M_cache
+                | (BitStreamLoadWindow(bis->_M_bytes, nbytes, (pos >> 3) + 8) >> 56 >> (8 - (pos & 0x7)));
+            result._M_value.uint >>= 64 - bits;
+            return result;
+        }
+    }
+    result._M_value.uint = bis->_M_cache >> (64 - bits);
     return result;
 }
 
+/* moves the cursor forward, 0 on success and -1 past the end. */
+int BitInputStreamSkipBits(BitInputStream *bis, size_t bits) {
+    if (bits <= bis->_M_cache_bits) {
+        if (bits > 0)
+            BitInputStreamTake(bis, bits);
+        return 0;
+    }
+    if (BitInputStreamHasReader(bis))
+        return BitInputStreamSeekSource(bis, bis->_M_base + bis->_M_position + bits);
+    if (bits > bis->_M_size - bis->_M_position)
+        return -1;
+    bis->_M_position += bits;
+    bis->_M_cache_bits = 0;
+    return 0;
+}
+
 ReadResult BitInputStreamReadSInt(BitInputStream *bis, size_t bits) {
     ReadResult result;
     ReadResult r;
@@ -157,29 +315,12 @@ ReadResult BitInputStreamReadSInt(BitInputStream *bis, size_t bits) {
     return result;
 }
 
-ReadResult BitInputStreamReadChar8(BitInputStream *bis, size_t nbytes, char *char8String) {
-    ReadResult r;
-    size_t i;
-
-    r._M_status = BS_SUCCESS;
-    for (i = 0; i < nbytes; ++i) {
-        if (!BS_SUCCEEDED(r = BitInputStreamReadUInt(bis, 8)))
-            return r;
-        *char8String++ = (char) r._M_value.uint;
-    }
-    return r;
-}
-
-ReadResult BitInputStreamReadUtf8(BitInputStream *bis, size_t nbytes, char *utf8String) {
-    return BitInputStreamReadChar8(bis, nbytes, utf8String);
-}
-
 void const* BitInputStreamGetBuffer(BitInputStream const *bis) {
     return bis->_M_bytes;
 }
 
 size_t BitInputStreamGetBitPosition(BitInputStream const *bis) {
-    return bis->_M_position;
+    return bis->_M_base + bis->_M_position;
 }
 
 size_t BitInputStreamGetPosition(BitInputStream const *bis) {
@@ -192,19 +333,30 @@ int BitInputStreamSkipPaddingBits(BitInputStream *bis) {
         return bits;
     bits = 8 - (bis->_M_position & 0x7);
     bis->_M_position += bits;
+    bis->_M_cache_bits = 0;
     return bits;
 }
 
 int BitInputStreamSeekBits(BitInputStream *bis, long offset, int origin) {
+    BS_STAT_INC(seeks);
     switch (origin) {
         case SEEK_SET: break;
-        case SEEK_CUR: offset += bis->_M_position; break;
-        case SEEK_END: offset += bis->_M_size; break;
+        case SEEK_CUR: offset += BitInputStreamGetBitPosition(bis); break;
+        case SEEK_END:
+            if (BitInputStreamHasReader(bis))
+                BitInputStreamDrainSource(bis);
+            offset += BitInputStreamGetBitSize(bis);
+            break;
         default: return -1;
     }
-    if (offset < 0L || offset > (long) bis->_M_size)
+    if (offset < 0L)
+        return -1;
+    if (BitInputStreamHasReader(bis))
+        return BitInputStreamSeekSource(bis, (size_t) offset);
+    if (offset > (long) bis->_M_size)
         return -1;
     bis->_M_position = offset;
+    bis->_M_cache_bits = 0;
     return 0;
 }
 
@@ -212,29 +364,62 @@ int BitInputStreamSeek(BitInputStream *bis, long offset, int origin) {
     return BitInputStreamSeekBits(bis, offset * 8, origin);
 }
 
+/**
+ * A source backed stream may have to refill to tell, through a const
+ * stream too as that does not move the cursor.
+ */
 int BitInputStreamIsEOS(BitInputStream const *bis) {
-    return bis->_M_position >= bis->_M_size;
+    return bis->_M_position >= bis->_M_size && !BitInputStreamFill((BitInputStream*) bis, 1);
 }
 
+/* bits seen so far for a source backed stream. */
 size_t BitInputStreamGetBitSize(BitInputStream const *bis) {
-    return bis->_M_size;
+    return bis->_M_base + bis->_M_size;
 }
 
 size_t BitInputStreamGetSize(BitInputStream const *bis) {
     return (BitInputStreamGetBitSize(bis) + 7) >> 3;
 }
 
+static void* BitStreamDefaultMalloc(void *context, size_t n) {
+    (void) context;
+    return malloc(n);
+}
+
+static void* BitStreamDefaultRealloc(void *context, void *p, size_t n) {
+    (void) context;
+    return realloc(p, n);
+}
+
+static void BitStreamDefaultFree(void *context, void *p) {
+    (void) context;
+    free(p);
+}
+
+static BSAllocator const BS_DEFAULT_ALLOCATOR = {
+    &BitStreamDefaultMalloc,
+    &BitStreamDefaultRealloc,
+    &BitStreamDefaultFree,
+    NULL
+};
+
 BitOutputStream* BitOutputStreamInitialize(BitOutputStream *bos, void *mem, size_t bits) {
+    return BitOutputStreamInitializeWithAllocator(bos, mem, bits, NULL);
+}
+
+BitOutputStream* BitOutputStreamInitializeWithAllocator(BitOutputStream *bos, void *mem, size_t bits,
+        BSAllocator const *allocator) {
     if (!bos)
         return bos;
+    bos->_M_allocator = allocator ? *allocator : BS_DEFAULT_ALLOCATOR;
     if (mem) {
         bos->_M_fixed = 1;
         bos->_M_bytes = (uint8_t*) mem;
     } else {
-        bits = 16 << 3;
+        /* initial capacity, whole bytes. */
+        bits = bits ? (bits + 7) & ~(size_t) 0x7 : 16 << 3;
         bos->_M_fixed = 0;
-        /* initial capacity */
-        bos->_M_bytes = (uint8_t*) malloc(bits >> 3);
+        bos->_M_bytes = (uint8_t*) bos->_M_allocator._M_malloc(bos->_M_allocator._M_context, bits >> 3);
         if (!bos->_M_bytes) {
             BitOutputStreamRelease(bos);
             return NULL;
@@ -242,139 +427,199 @@ BitOutputStream* BitOutputStreamInitialize(BitOutputStream *bos, void *mem, size
     }
     bos->_M_size = bits;
     bos->_M_position = 0;
+    bos->_M_cache = 0;
+    bos->_M_cache_bits = 0;
+    bos->_M_sink = NULL;
+    bos->_M_base = 0;
+    bos->_M_order = BS_MSB_FIRST;
     return bos;
 }
 
 void BitOutputStreamRelease(BitOutputStream *bos) {
     if (bos) {
+        BitStreamSinkDestroy(bos->_M_sink);
         if (!bos->_M_fixed) {
             if (bos->_M_bytes)
-                free(bos->_M_bytes);
+                bos->_M_allocator._M_free(bos->_M_allocator._M_context, bos->_M_bytes);
+        } else if (bos->_M_bytes) {
+            /* caller owns the memory, leave it complete. */
+            BitOutputStreamFlush(bos);
         }
         bos->_M_bytes = NULL;
         bos->_M_position = 0;
         bos->_M_size = 0;
         bos->_M_fixed = 0;
+        bos->_M_cache = 0;
+        bos->_M_cache_bits = 0;
+        bos->_M_sink = NULL;
+        bos->_M_base = 0;
+        bos->_M_order = BS_MSB_FIRST;
     }
 }
 
-int SET_BIT_ONE_MASKS[] = {
-    0x1 << 7, 0x1 << 6, 0x1 << 5, 0x1 << 4,
-    0x1 << 3, 0x1 << 2, 0x1 << 1, 0x1 << 0
-};
-int SET_BIT_ZERO_MASKS[] = {
-    ~(0x1 << 7), ~(0x1 << 6), ~(0x1 << 5), ~(0x1 << 4),
-    ~(0x1 << 3), ~(0x1 << 2), ~(0x1 << 1), ~(0x1 << 0),
-};
-
-static int BitOutputStreamExpandBuffer(BitOutputStream *bos) {
+/**
+ * Grows the buffer to hold at least `bits` bits. Capacity at least doubles
+ * so that appending stays amortized O(1), and is kept a multiple of 64 bits.
+ */
+static int BitOutputStreamExpandBuffer(BitOutputStream *bos, size_t bits) {
+    BSAllocator const *allocator = &bos->_M_allocator;
+    size_t size;
     void *p = NULL;
+
+    if (bos->_M_sink)
+        return BitOutputStreamDrainSink(bos, bits - bos->_M_position);
     if (bos->_M_fixed)
         return -1;
-    p = malloc(bos->_M_size >> 2);
-    if (!p)
+    if (bits <= bos->_M_size)
+        return 0;
+    size = bos->_M_size << 1;
+    if (size < bits)
+        size = bits;
+    size = (size + 63) & ~(size_t) 63;
+    if (size < bos->_M_size)
         return -1;
-    memcpy(p, bos->_M_bytes, bos->_M_size);
-    free(bos->_M_bytes);
-    bos->_M_bytes = p;
-    bos->_M_size <<= 1;
+    BS_STAT_INC(expansions);
+    BS_STAT_ADD(expansion_bytes, bos->_M_size >> 3);
+    if (allocator->_M_realloc) {
+        p = allocator->_M_realloc(allocator->_M_context, bos->_M_bytes, size >> 3);
+        if (!p)
+            return -1;
+    } else {
+        p = allocator->_M_malloc(allocator->_M_context, size >> 3);
+        if (!p)
+            return -1;
+        memcpy(p, bos->_M_bytes, bos->_M_size >> 3);
+        allocator->_M_free(allocator->_M_context, bos->_M_bytes);
+    }
+    bos->_M_bytes = (uint8_t*) p;
+    bos->_M_size = size;
     return 0;
 }
 
+int BitOutputStreamReserve(BitOutputStream *bos, size_t bits) {
+    if (bos->_M_position + bits <= bos->_M_size)
+        return 0;
+    return BitOutputStreamExpandBuffer(bos, bos->_M_position + bits);
+}
+
+/* out of line half of BitOutputStreamWriteUIntUnchecked, the accumulator fills up. */
+void BitOutputStreamWriteUIntUncheckedSlow(BitOutputStream *bos, size_t bits, uint64_t value) {
+    BS_STAT_ADD(bits_written, bits);
+    if (bos->_M_order == BS_LSB_FIRST)
+        BitOutputStreamPutLsb(bos, bits, value);
+    else
+        BitOutputStreamPut(bos, bits, value);
+}
+
+/**
+ * Stores the complete bytes of the accumulator, and the partial trailing
+ * byte merged with the bits of memory following the cursor. The partial
+ * byte also stays in the accumulator so that writing can go on.
+ */
+static void BitOutputStreamFlushCache(BitOutputStream *bos) {
+    uint8_t *p;
+    size_t n;
+    int rbits;
+
+    if (bos->_M_cache_bits == 0)
+        return;
+    if (bos->_M_order == BS_LSB_FIRST) {
+        BitOutputStreamFlushCacheLsb(bos);
+        return;
+    }
+    p = bos->_M_bytes + ((bos->_M_position - bos->_M_cache_bits) >> 3);
+    for (n = bos->_M_cache_bits >> 3; n > 0; --n) {
+        *p++ = (uint8_t) (bos->_M_cache >> 56);
+        bos->_M_cache <<= 8;
+    }
+    rbits = bos->_M_cache_bits & 0x7;
+    bos->_M_cache_bits = rbits;
+    if (rbits)
+        *p = (uint8_t) ((bos->_M_cache >> 56) | (*p & (0xff >> rbits)));
+}
+
+/**
+ * Moves the cursor, the accumulator restarts from the byte boundary with
+ * the leading bits of the byte already in memory.
+ */
+static void BitOutputStreamMoveTo(BitOutputStream *bos, size_t pos) {
+    BitOutputStreamFlushCache(bos);
+    if (bos->_M_order == BS_LSB_FIRST) {
+        BitOutputStreamMoveToLsb(bos, pos);
+        return;
+    }
+    bos->_M_position = pos;
+    bos->_M_cache_bits = pos & 0x7;
+    bos->_M_cache = bos->_M_cache_bits
+        ? (uint64_t) (bos->_M_bytes[pos >> 3] & ~(0xff >> bos->_M_cache_bits)) << 56
+        : 0;
+}
+
+void BitOutputStreamFlush(BitOutputStream *bos) {
+    BitOutputStreamFlushCache(bos);
+}
+
+/* takes effect from the cursor on, the bits written before stay as they are. */
+void BitOutputStreamSetBitOrder(BitOutputStream *bos, BSBitOrder order) {
+    BitOutputStreamFlushCache(bos);
+    bos->_M_order = order;
+    bos->_M_cache_bits = 0;
+    BitOutputStreamMoveTo(bos, bos->_M_position);
+}
+
+BSBitOrder BitOutputStreamGetBitOrder(BitOutputStream const *bos) {
+    return bos->_M_order;
+}
+
 WriteResult BitOutputStreamWriteBit(BitOutputStream *bos, int bit) {
     WriteResult result = { BS_SUCCESS };
 
+    BS_STAT_INC(write_calls);
     if (bos->_M_position >= bos->_M_size) {
-        if (BitOutputStreamExpandBuffer(bos) != 0) {
+        BS_STAT_INC(write_misses);
+        if (BitOutputStreamExpandBuffer(bos, bos->_M_position + 1) != 0) {
+            BS_STAT_INC(failures);
             result._M_status = BS_FAIL;
             return result;
         }
     }
-    if (bit & 0x1) {
-        bos->_M_bytes[bos->_M_position >> 3] |= SET_BIT_ONE_MASKS[bos->_M_position & 0x7];
-    } else {
-        bos->_M_bytes[bos->_M_position >> 3] &= SET_BIT_ZERO_MASKS[bos->_M_position & 0x7];
-    }
-    ++bos->_M_position;
+    BS_STAT_INC(bits_written);
+    if (bos->_M_order == BS_LSB_FIRST)
+        BitOutputStreamPutLsb(bos, 1, bit & 0x1);
+    else
+        BitOutputStreamPut(bos, 1, bit & 0x1);
     return result;
 }
 
 WriteResult BitOutputStreamWriteUInt(BitOutputStream *bos, size_t bits, uint64_t value) {
     WriteResult result = { BS_SUCCESS };
-    int first_bit_of_next_byte;
-    int preserve;
-    int rbits;
-    /* byte position */
-    int bpos;
-    /* bit position */
-    int pos = bos->_M_position;
 
-    if (pos + bits > bos->_M_size) {
-        if (BitOutputStreamExpandBuffer(bos) != 0) {
+    BS_STAT_INC(write_calls);
+    if (bos->_M_position + bits > bos->_M_size) {
+        BS_STAT_INC(write_misses);
+        if (BitOutputStreamExpandBuffer(bos, bos->_M_position + bits) != 0) {
+            BS_STAT_INC(failures);
             result._M_status = BS_FAIL;
             return result;
         }
     }
+    BS_STAT_ADD(bits_written, bits);
 
     /**
      * Now, memory size is large enough, no need to check out of
-     * boundary every time after write.
+     * boundary every time after write. Fields wider than 64 bits are
+     * zero extended.
      */
-    while (bits > 0) {
-        if (!(pos & 0x7)) {
-            /**
-             * We start writing to the first leading bit.
-             */
-            while (bits >= 8) {
-                bits -= 8;
-                bos->_M_bytes[pos >> 3] = (value >> bits) & 0xff;
-                pos += 8;
-            }
-            /**
-             * Writing to the first leading bit(MSB), but not the whole byte.
-             */
-            if (bits > 0) {
-                bpos = pos >> 3;
-                preserve = bos->_M_bytes[bpos] & READ_LSB_BITS_OF_ONE_BYTE[8 - bits];
-                bos->_M_bytes[bpos] = (uint8_t) ((value & READ_LSB_BITS_OF_ONE_BYTE[bits]) << (8 - bits));
-                bos->_M_bytes[bpos] |= preserve;
-                pos += bits;
-                bits = 0;
-                break;
-            }
-        } else {
-            /**
-             * Next byte first bit position
-             */
-            first_bit_of_next_byte = ((pos >> 3) + 1) << 3;
-            if ((int) (pos + bits) >= first_bit_of_next_byte) {
-                rbits = first_bit_of_next_byte - pos;
-                /**
-                 * At least write to the last padding bits(LSB) in one byte.
-                 */
-                bpos = pos >> 3;
-                preserve = bos->_M_bytes[bpos] & (~READ_LSB_BITS_OF_ONE_BYTE[rbits]) & 0xff;
-                bits -= rbits;
-                bos->_M_bytes[bpos] = (uint8_t) ((value >> bits) & READ_LSB_BITS_OF_ONE_BYTE[rbits]);
-                bos->_M_bytes[bpos] |= preserve;
-                pos += rbits;
-            } else {
-                rbits = first_bit_of_next_byte - (pos + bits);
-                /**
-                 * Write less than one byte which does not start from the first leading bit(MSB).
-                 */
-                bpos = pos >> 3;
-                preserve = bos->_M_bytes[bpos] & ~(READ_LSB_BITS_OF_ONE_BYTE[bits] << rbits) & 0xff;
-                bos->_M_bytes[bpos] = (uint8_t) ((value & READ_LSB_BITS_OF_ONE_BYTE[bits]) << rbits);
-                bos->_M_bytes[bpos] |= preserve;
-                pos += bits;
-                bits = 0;
-                break;
-            }
-        }
+    if (BS_UNLIKELY(bos->_M_order == BS_LSB_FIRST)) {
+        BitOutputStreamWriteUIntLsb(bos, bits, value);
+        return result;
     }
-
-    bos->_M_position = pos;
+    while (bits > 64) {
+        BitOutputStreamPut(bos, bits - 64 < 32 ? bits - 64 : 32, 0);
+        bits -= bits - 64 < 32 ? bits - 64 : 32;
+    }
+    if (bits > 0)
+        BitOutputStreamPut(bos, bits, value);
     return result;
 }
 
@@ -391,45 +636,41 @@ WriteResult BitOutputStreamWriteSInt(BitOutputStream *bos, size_t bits, int64_t
     return BitOutputStreamWriteUInt(bos, bits - 1, value);
 }
 
-WriteResult BitOutputStreamWriteChar8(BitOutputStream *bos, size_t nbytes, char const *char8String) {
-    size_t i;
-    WriteResult r;
-    r._M_status = BS_SUCCESS;
-    for (i = 0; i < nbytes; ++i)
-        if (!BS_SUCCEEDED(r = BitOutputStreamWriteUInt(bos, 8, (*char8String++) & 0xff)))
-            return r;
-    return r;
-}
-
-WriteResult BitOutputStreamWriteUtf8(BitOutputStream *bos, size_t nbytes, char const *utf8String) {
-    return BitOutputStreamWriteChar8(bos, nbytes, utf8String);
-}
-
+/**
+ * The accumulator is flushed through a const stream too, the flush never
+ * changes what the stream observably holds.
+ */
 void const* BitOutputStreamGetBuffer(BitOutputStream const* bos) {
+    BitOutputStreamFlushCache((BitOutputStream*) bos);
     return bos->_M_bytes;
 }
 
+/* including the bits already handed to a sink. */
 size_t BitOutputStreamGetBitSize(BitOutputStream const* bos) {
-    return bos->_M_position;
+    return bos->_M_base + bos->_M_position;
 }
 
 size_t BitOutputStreamGetSize(BitOutputStream const* bos) {
+    BitOutputStreamFlushCache((BitOutputStream*) bos);
     return (BitOutputStreamGetBitSize(bos) + 7) >> 3;
 }
 
 void BitOutputStreamReset(BitOutputStream *bos) {
-    bos->_M_position = 0;
+    BitOutputStreamMoveTo(bos, 0);
 }
 
+/* a sink backed stream seeks only among the bits still buffered. */
 int BitOutputStreamSeekBits(BitOutputStream *bos, long offset, int origin) {
+    BS_STAT_INC(seeks);
     switch (origin) {
         case SEEK_SET: break;
-        case SEEK_CUR: offset += bos->_M_position; break;
-        case SEEK_END: offset += bos->_M_size; break;
+        case SEEK_CUR: offset += BitOutputStreamGetBitSize(bos); break;
+        case SEEK_END: offset += bos->_M_base + bos->_M_size; break;
     }
+    offset -= (long) bos->_M_base;
     if (offset < 0L || offset > (long) bos->_M_size)
         return -1;
-    bos->_M_position = offset;
+    BitOutputStreamMoveTo(bos, offset);
     return 0;
 }
 
@@ -439,10 +680,10 @@ int BitOutputStreamSeek(BitOutputStream *bos, long offset, int origin) {
 
 size_t BitOutputStreamPaddingBits(BitOutputStream *bos, int bit) {
     size_t bits;
-    size_t i;
     bits = (8 - (bos->_M_position & 0x7)) & 0x7;
-    for (i = 0; i < bits; ++i)
-        BitOutputStreamWriteBit(bos, bit);
+    if (bits > 0)
+        BitOutputStreamWriteUInt(bos, bits, bit ? 0xff : 0);
+    BitOutputStreamFlushCache(bos);
     return bits;
 }
 
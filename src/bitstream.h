@@ -3,11 +3,39 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/uio.h>
+#define BS_HAVE_IOVEC 1
+#endif
+
+#if defined(__cplusplus) || (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L)
+#define BS_API_INLINE static inline
+#elif defined(__GNUC__)
+#define BS_API_INLINE static __inline__
+#else
+#define BS_API_INLINE static
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+    /* reads up to n bytes, returns how many were read, 0 at the end. */
+    typedef size_t (*BSReadFunc)(void*, void*, size_t);
+
+    struct tagBSSource;
+    typedef struct tagBSSource BSSource;
+
+    /**
+     * Order of the bits in a byte. MSB first fields start at the most
+     * significant bit of the byte and put their most significant bit first,
+     * LSB first ones start at the least significant bit and put their least
+     * significant bit first, as DEFLATE does.
+     */
+    typedef enum tagBSBitOrder { BS_MSB_FIRST, BS_LSB_FIRST } BSBitOrder;
+
     struct tagBitInputStream;
     typedef struct tagBitInputStream BitInputStream;
     struct tagBitInputStream {
@@ -15,7 +43,21 @@ extern "C" {
         size_t          _M_position;
         size_t          _M_size;
 
+        /* next bits after _M_position, most significant bit first. */
+        uint64_t        _M_cache;
+        size_t          _M_cache_bits;
+
         size_t          _M_marked_position;
+
+        /* refillable backing, and the bits which slid out of the window. */
+        BSSource        *_M_source;
+        size_t          _M_base;
+
+        /* first failure of a Fetch read, a BSStatus. */
+        int             _M_error;
+
+        /* LSB first streams never cache, their reads load from memory. */
+        BSBitOrder      _M_order;
     };
 
     typedef enum tagBSStatus { BS_SUCCESS, BS_FAIL, BS_EOS } BSStatus;
@@ -35,19 +77,79 @@ extern "C" {
 #define BS_SUCCEEDED(R) ((R)._M_status == BS_SUCCESS)
 #define BS_FAILED(R) ((R)._M_status != BS_SUCCESS)
 
+    /* canonical prefix code, see BitStreamHuffmanCreate. */
+    struct tagBSHuffman;
+    typedef struct tagBSHuffman BSHuffman;
+
+    /* increasing bit offsets of independent segments, see bitstream_index.c. */
+    struct tagBSIndex;
+    typedef struct tagBSIndex BSIndex;
+
+    /* fields of a record, compiled by BitStreamSchemaCreate. */
+    struct tagBSSchema;
+    typedef struct tagBSSchema BSSchema;
+
+    /* rank and select directory over an input buffer, see bitstream_rank.c. */
+    struct tagBSRankIndex;
+    typedef struct tagBSRankIndex BSRankIndex;
+
+    /* how a mapped file is going to be read. */
+    typedef enum tagBSAccess {
+        BS_ACCESS_NORMAL,
+        BS_ACCESS_SEQUENTIAL,
+        BS_ACCESS_RANDOM,
+        BS_ACCESS_WILLNEED
+    } BSAccess;
+
     extern BitInputStream* BitInputStreamInitialize(BitInputStream*, void const*, size_t);
+    extern BitInputStream* BitInputStreamInitializeWithReader(BitInputStream*, BSReadFunc, void*, size_t);
+    extern BitInputStream* BitInputStreamInitializeWithFd(BitInputStream*, int, size_t);
+    extern BitInputStream* BitInputStreamInitializeWithFile(BitInputStream*, FILE*, size_t);
+    extern BitInputStream* BitInputStreamOpenFile(BitInputStream*, char const*, BSAccess);
     extern void BitInputStreamRelease(BitInputStream*);
+    extern void BitInputStreamSetBitOrder(BitInputStream*, BSBitOrder);
+    extern BSBitOrder BitInputStreamGetBitOrder(BitInputStream const*);
 
     extern ReadResult BitInputStreamReadBit(BitInputStream*);
 
+    extern ReadResult BitInputStreamReadUE(BitInputStream*);
+    extern ReadResult BitInputStreamReadSE(BitInputStream*);
+    extern ReadResult BitInputStreamReadExpGolomb(BitInputStream*, size_t);
+    extern ReadResult BitInputStreamReadRice(BitInputStream*, size_t);
     extern void BitInputStreamMark(BitInputStream*);
     extern void BitInputStreamReset(BitInputStream*);
 
     extern ReadResult BitInputStreamReadInt(BitInputStream*, size_t);
     extern ReadResult BitInputStreamReadUInt(BitInputStream*, size_t);
     extern ReadResult BitInputStreamReadSInt(BitInputStream*, size_t);
+    extern int BitInputStreamEnsure(BitInputStream*, size_t);
+    extern uint64_t BitInputStreamReadUIntUncheckedSlow(BitInputStream*, size_t);
+    extern uint64_t BitInputStreamFetchUIntSlow(BitInputStream*, size_t);
+    extern int64_t BitInputStreamFetchInt(BitInputStream*, size_t);
+    extern int64_t BitInputStreamFetchSInt(BitInputStream*, size_t);
+    extern BSStatus BitInputStreamGetError(BitInputStream const*);
+    extern void BitInputStreamClearError(BitInputStream*);
+    extern ReadResult BitInputStreamPeekUInt(BitInputStream*, size_t);
+    extern int BitInputStreamSkipBits(BitInputStream*, size_t);
+    extern ReadResult BitInputStreamReadVarUInt(BitInputStream*);
+    extern ReadResult BitInputStreamReadVarSInt(BitInputStream*);
+    extern ReadResult BitInputStreamReadVarUIntArray32(BitInputStream*, size_t, uint32_t*);
+    extern ReadResult BitInputStreamReadVarUIntArray64(BitInputStream*, size_t, uint64_t*);
+    extern ReadResult BitInputStreamReadHuffman(BitInputStream*, BSHuffman const*);
+    extern ReadResult BitInputStreamReadHuffmanArray(BitInputStream*, BSHuffman const*, size_t, uint32_t*);
     extern ReadResult BitInputStreamReadChar8(BitInputStream*, size_t, char*);
     extern ReadResult BitInputStreamReadUtf8(BitInputStream*, size_t, char*);
+    extern ReadResult BitInputStreamReadUtf8Checked(BitInputStream*, size_t, char*);
+    extern ReadResult BitInputStreamReadBytesView(BitInputStream*, size_t, void const**);
+    extern ReadResult BitInputStreamReadUIntArray8(BitInputStream*, size_t, size_t, uint8_t*);
+    extern ReadResult BitInputStreamReadUIntArray16(BitInputStream*, size_t, size_t, uint16_t*);
+    extern ReadResult BitInputStreamReadUIntArray32(BitInputStream*, size_t, size_t, uint32_t*);
+    extern ReadResult BitInputStreamReadUIntArray64(BitInputStream*, size_t, size_t, uint64_t*);
+    extern ReadResult BitInputStreamReadRecords(BitInputStream*, BSSchema const*, size_t, void*, size_t);
+    extern ReadResult BitInputStreamReadColumns(BitInputStream*, BSSchema const*, size_t, void *const*);
+    extern ReadResult BitInputStreamCountOnes(BitInputStream*, size_t);
+    extern ReadResult BitInputStreamFindNextSet(BitInputStream*);
+    extern ReadResult BitInputStreamFindNextClear(BitInputStream*);
     extern void const* BitInputStreamGetBuffer(BitInputStream const*);
     extern size_t BitInputStreamGetBitPosition(BitInputStream const*);
     extern size_t BitInputStreamGetPosition(BitInputStream const*);
@@ -58,6 +160,31 @@ extern "C" {
     extern size_t BitInputStreamGetBitSize(BitInputStream const*);
     extern size_t BitInputStreamGetSize(BitInputStream const*);
 
+    /**
+     * Memory hooks of growable output streams, each of them gets the
+     * context as first argument. Without realloc the buffer grows by
+     * malloc, memcpy and free.
+     */
+    typedef struct tagBSAllocator {
+        void* (*_M_malloc)(void*, size_t);
+        void* (*_M_realloc)(void*, void*, size_t);
+        void (*_M_free)(void*, void*);
+        void *_M_context;
+    } BSAllocator;
+
+    /* recycles the buffers of growable output streams, see bitstream_pool.c. */
+    struct tagBSPool;
+    typedef struct tagBSPool BSPool;
+
+    /* what bulk writes do with values wider than the field. */
+    typedef enum tagBSPackMode { BS_PACK_MASK, BS_PACK_CHECK } BSPackMode;
+
+    /* writes n bytes, returns how many were written. */
+    typedef size_t (*BSWriteFunc)(void*, void const*, size_t);
+
+    struct tagBSSink;
+    typedef struct tagBSSink BSSink;
+
     struct tagBitOutputStream;
     typedef struct tagBitOutputStream BitOutputStream;
     struct tagBitOutputStream {
@@ -66,10 +193,45 @@ extern "C" {
         size_t _M_size;
 
         int _M_fixed;
+        BSAllocator _M_allocator;
+
+        /**
+         * pending bits from the byte boundary at
+         * (_M_position - _M_cache_bits), most significant bit first, or
+         * least significant bit first for a LSB first stream.
+         */
+        uint64_t _M_cache;
+        size_t _M_cache_bits;
+
+        /* consumer of the complete bytes, and the bits handed to it. */
+        BSSink *_M_sink;
+        size_t _M_base;
+
+        BSBitOrder _M_order;
     };
 
     extern BitOutputStream* BitOutputStreamInitialize(BitOutputStream*, void*, size_t);
+    extern BitOutputStream* BitOutputStreamInitializeWithAllocator(BitOutputStream*, void*, size_t,
+            BSAllocator const*);
+    extern BitOutputStream* BitOutputStreamInitializeWithPool(BitOutputStream*, BSPool*);
+    extern BitOutputStream* BitOutputStreamInitializeWithWriter(BitOutputStream*, BSWriteFunc, void*, size_t);
+    extern BitOutputStream* BitOutputStreamInitializeWithFd(BitOutputStream*, int, size_t);
+
+    /**
+     * Chunked output, the stream grows by linking chunks of fixed size
+     * rather than by moving its buffer. The bytes written so far are a
+     * list of chunks, for any growable stream too as a single chunk.
+     */
+    extern BitOutputStream* BitOutputStreamInitializeChunked(BitOutputStream*, size_t, BSAllocator const*);
+    extern size_t BitOutputStreamGetChunkCount(BitOutputStream const*);
+    extern void const* BitOutputStreamGetChunk(BitOutputStream const*, size_t, size_t*);
+    extern size_t BitOutputStreamFlatten(BitOutputStream const*, void*, size_t);
+#if defined(BS_HAVE_IOVEC)
+    extern size_t BitOutputStreamGetIovec(BitOutputStream const*, struct iovec*, size_t);
+#endif
     extern void BitOutputStreamRelease(BitOutputStream*);
+    extern void BitOutputStreamSetBitOrder(BitOutputStream*, BSBitOrder);
+    extern BSBitOrder BitOutputStreamGetBitOrder(BitOutputStream const*);
 
     extern WriteResult BitOutputStreamWriteBit(BitOutputStream*, int);
     extern WriteResult BitOutputStreamWriteInt(BitOutputStream*, size_t, int64_t);
@@ -77,6 +239,25 @@ extern "C" {
     extern WriteResult BitOutputStreamWriteSInt(BitOutputStream*, size_t, int64_t);
     extern WriteResult BitOutputStreamWriteChar8(BitOutputStream*, size_t, char const*);
     extern WriteResult BitOutputStreamWriteUtf8(BitOutputStream*, size_t, char const*);
+    extern WriteResult BitOutputStreamWriteUtf8Checked(BitOutputStream*, size_t, char const*);
+    extern WriteResult BitOutputStreamWriteUE(BitOutputStream*, uint64_t);
+    extern WriteResult BitOutputStreamWriteSE(BitOutputStream*, int64_t);
+    extern WriteResult BitOutputStreamWriteExpGolomb(BitOutputStream*, size_t, uint64_t);
+    extern WriteResult BitOutputStreamWriteRice(BitOutputStream*, size_t, uint64_t);
+    extern WriteResult BitOutputStreamWriteVarUInt(BitOutputStream*, uint64_t);
+    extern WriteResult BitOutputStreamWriteVarSInt(BitOutputStream*, int64_t);
+    extern WriteResult BitOutputStreamWriteHuffman(BitOutputStream*, BSHuffman const*, size_t);
+    extern WriteResult BitOutputStreamWriteUIntArray8(BitOutputStream*, size_t, size_t, uint8_t const*, BSPackMode);
+    extern WriteResult BitOutputStreamWriteUIntArray16(BitOutputStream*, size_t, size_t, uint16_t const*, BSPackMode);
+    extern WriteResult BitOutputStreamWriteUIntArray32(BitOutputStream*, size_t, size_t, uint32_t const*, BSPackMode);
+    extern WriteResult BitOutputStreamWriteUIntArray64(BitOutputStream*, size_t, size_t, uint64_t const*, BSPackMode);
+    extern WriteResult BitOutputStreamWriteRecords(BitOutputStream*, BSSchema const*, size_t, void const*, size_t);
+    extern WriteResult BitOutputStreamWriteColumns(BitOutputStream*, BSSchema const*, size_t, void const *const*);
+    extern WriteResult BitOutputStreamWriteBits(BitOutputStream*, void const*, size_t, size_t);
+    extern WriteResult BitOutputStreamAppend(BitOutputStream*, BitOutputStream const*);
+    extern WriteResult BitStreamCopyBits(BitOutputStream*, BitInputStream*, size_t);
+    extern void BitOutputStreamFlush(BitOutputStream*);
+    extern WriteResult BitOutputStreamFinish(BitOutputStream*, int);
     extern void const* BitOutputStreamGetBuffer(BitOutputStream const*);
     extern size_t BitOutputStreamGetSize(BitOutputStream const*);
     extern size_t BitOutputStreamGetBitSize(BitOutputStream const*);
@@ -85,6 +266,203 @@ extern "C" {
     extern int BitOutputStreamSeekBits(BitOutputStream*, long, int);
     extern size_t BitOutputStreamPaddingBits(BitOutputStream*, int);
     extern size_t BitOutputStreamGetCapacity(BitOutputStream const*);
+    extern int BitOutputStreamReserve(BitOutputStream*, size_t);
+    extern void BitOutputStreamWriteUIntUncheckedSlow(BitOutputStream*, size_t, uint64_t);
+
+    /**
+     * Unchecked reads and writes for hot loops. They skip the bounds
+     * checks and the result structs, BitInputStreamEnsure or
+     * BitOutputStreamReserve must have made room for all of their bits
+     * before. Fields are 1..64 bits wide, only the refill of the window
+     * and the store of a full accumulator are out of line. LSB first
+     * streams have no window to read from, their reads are out of line.
+     */
+    BS_API_INLINE uint64_t BitInputStreamReadUIntUnchecked(BitInputStream *bis, size_t bits) {
+        uint64_t value;
+
+        if (bits > bis->_M_cache_bits)
+            return BitInputStreamReadUIntUncheckedSlow(bis, bits);
+        value = bis->_M_cache >> (64 - bits);
+        bis->_M_cache = (bis->_M_cache << (bits - 1)) << 1;
+        bis->_M_cache_bits -= bits;
+        bis->_M_position += bits;
+        return value;
+    }
+
+    /**
+     * Sticky error reads. A read which fails returns zero and records why,
+     * every Fetch read after it returns zero too until the error is
+     * cleared, so that a record is checked once with
+     * BitInputStreamGetError instead of after every field. The other
+     * reads neither set nor look at the error.
+     */
+    BS_API_INLINE uint64_t BitInputStreamFetchUInt(BitInputStream *bis, size_t bits) {
+        uint64_t value;
+
+        if (bits - 1 >= bis->_M_cache_bits || bis->_M_error)
+            return BitInputStreamFetchUIntSlow(bis, bits);
+        value = bis->_M_cache >> (64 - bits);
+        bis->_M_cache = (bis->_M_cache << (bits - 1)) << 1;
+        bis->_M_cache_bits -= bits;
+        bis->_M_position += bits;
+        return value;
+    }
+
+    BS_API_INLINE int BitInputStreamFetchBit(BitInputStream *bis) {
+        return (int) BitInputStreamFetchUInt(bis, 1);
+    }
+
+    BS_API_INLINE int BitInputStreamReadBitUnchecked(BitInputStream *bis) {
+        return (int) BitInputStreamReadUIntUnchecked(bis, 1);
+    }
+
+    /* two's complement, the sign bit first. */
+    BS_API_INLINE int64_t BitInputStreamReadIntUnchecked(BitInputStream *bis, size_t bits) {
+        uint64_t value = BitInputStreamReadUIntUnchecked(bis, bits);
+        uint64_t sign = (uint64_t) 1 << (bits - 1);
+
+        return (int64_t) ((value ^ sign) - sign);
+    }
+
+    BS_API_INLINE void BitOutputStreamWriteUIntUnchecked(BitOutputStream *bos, size_t bits, uint64_t value) {
+        size_t room = 64 - bos->_M_cache_bits;
+
+        if (bits >= room) {
+            BitOutputStreamWriteUIntUncheckedSlow(bos, bits, value);
+            return;
+        }
+        value &= ((uint64_t) 1 << bits) - 1;
+        bos->_M_cache |= bos->_M_order == BS_LSB_FIRST ? value << bos->_M_cache_bits : value << (room - bits);
+        bos->_M_cache_bits += bits;
+        bos->_M_position += bits;
+    }
+
+    BS_API_INLINE void BitOutputStreamWriteBitUnchecked(BitOutputStream *bos, int bit) {
+        BitOutputStreamWriteUIntUnchecked(bos, 1, (uint64_t) (bit & 0x1));
+    }
+
+    /* two's complement, the low `bits` bits of the value. */
+    BS_API_INLINE void BitOutputStreamWriteIntUnchecked(BitOutputStream *bos, size_t bits, int64_t value) {
+        BitOutputStreamWriteUIntUnchecked(bos, bits, (uint64_t) value);
+    }
+
+    /* non zero when the bytes are well formed UTF-8. */
+    extern int BitStreamIsValidUtf8(void const*, size_t);
+
+    /**
+     * Canonical prefix code from the code length of every symbol, zero for
+     * the unused ones. Lengths go up to 24 bits, `primaryBits` is the index
+     * width of the first level table, zero for the default of 10. NULL for
+     * lengths which are no prefix code.
+     */
+    extern BSHuffman* BitStreamHuffmanCreate(uint8_t const*, size_t, size_t);
+    extern void BitStreamHuffmanDestroy(BSHuffman*);
+    extern size_t BitStreamHuffmanGetMaxBits(BSHuffman const*);
+
+    /**
+     * Field of a record: unsigned, two's complement as BitInputStreamReadInt,
+     * sign and magnitude as BitInputStreamReadSInt, or padding which reads
+     * are skipping and writes are zeroing. A value field goes to the member
+     * of `_M_size` bytes at `_M_offset` of its struct.
+     */
+    typedef enum tagBSFieldKind { BS_FIELD_UINT, BS_FIELD_INT, BS_FIELD_SINT, BS_FIELD_PAD } BSFieldKind;
+
+    typedef struct tagBSField {
+        BSFieldKind _M_kind;
+        size_t _M_bits;
+        size_t _M_offset;
+        size_t _M_size;
+    } BSField;
+
+    extern BSSchema* BitStreamSchemaCreate(BSField const*, size_t);
+    extern void BitStreamSchemaDestroy(BSSchema*);
+    extern size_t BitStreamSchemaGetBits(BSSchema const*);
+    extern size_t BitStreamSchemaGetFieldCount(BSSchema const*);
+
+    /**
+     * Buffers go back to the pool when their stream is released, streams
+     * initialized from it start at the size recent messages reached.
+     * BitStreamPoolTrim frees cached buffers down to `keep` bytes.
+     */
+    extern BSPool* BitStreamPoolCreate(void);
+    extern void BitStreamPoolDestroy(BSPool*);
+    extern void BitStreamPoolGetAllocator(BSPool*, BSAllocator*);
+    extern size_t BitStreamPoolTrim(BSPool*, size_t);
+    extern size_t BitStreamPoolGetCachedBytes(BSPool*);
+
+    /**
+     * Rank counts the set or clear bits before a position, select finds
+     * the position of the k-th one, both in about constant time. The index
+     * refers to the buffer of the stream it was built over.
+     */
+    extern BSRankIndex* BitStreamRankIndexCreate(BitInputStream const*);
+    extern void BitStreamRankIndexDestroy(BSRankIndex*);
+    extern size_t BitStreamRankIndexGetOnes(BSRankIndex const*);
+    extern size_t BitStreamRankIndexRank1(BSRankIndex const*, size_t);
+    extern size_t BitStreamRankIndexRank0(BSRankIndex const*, size_t);
+    extern size_t BitStreamRankIndexSelect1(BSRankIndex const*, size_t);
+    extern size_t BitStreamRankIndexSelect0(BSRankIndex const*, size_t);
+
+    extern BSIndex* BitStreamIndexCreate(void);
+    extern void BitStreamIndexDestroy(BSIndex*);
+    extern void BitStreamIndexClear(BSIndex*);
+    extern int BitStreamIndexAdd(BSIndex*, uint64_t);
+    extern size_t BitStreamIndexGetCount(BSIndex const*);
+    extern uint64_t BitStreamIndexGet(BSIndex const*, size_t);
+    extern size_t BitStreamIndexFind(BSIndex const*, uint64_t);
+    extern long BitStreamIndexScan(BSIndex*, void const*, size_t, uint64_t, size_t);
+    extern int BitOutputStreamAddSyncPoint(BitOutputStream*, BSIndex*);
+
+    /**
+     * Decodes segment `i` from the stream, which covers that segment only.
+     * Runs concurrently with the other segments, returns non zero to fail
+     * the whole decode.
+     */
+    typedef int (*BSSegmentFunc)(void*, size_t, BitInputStream*);
+
+    extern int BitStreamDecodeParallel(void const*, size_t, BSIndex const*, BSSegmentFunc, void*, size_t);
+
+    /**
+     * Encodes partition `i` into the stream, concurrently with the other
+     * partitions. Returns non zero to fail the whole encode. Partitions
+     * other than the first get malloc backed streams, the allocator of the
+     * target needs no locking.
+     */
+    typedef int (*BSPartitionFunc)(void*, size_t, BitOutputStream*);
+
+    extern WriteResult BitStreamEncodeParallel(BitOutputStream*, size_t, BSPartitionFunc, void*, size_t);
+
+    /**
+     * Counters of the calling thread, kept by a library configured with
+     * --enable-stats. Reads and writes count the checked calls, the
+     * unchecked and fetch ones only when they leave their inline path.
+     * BitStreamGetStats fills in zeros and returns -1 without the counters.
+     */
+    typedef struct tagBSStats {
+        uint64_t _M_read_calls;
+        uint64_t _M_bits_read;
+        /* reads which found too few bits cached. */
+        uint64_t _M_read_misses;
+        uint64_t _M_eos;
+        uint64_t _M_write_calls;
+        uint64_t _M_bits_written;
+        /* writes which found too little room in the buffer. */
+        uint64_t _M_write_misses;
+        uint64_t _M_failures;
+        /* arrays, byte strings and bit copies, either way. */
+        uint64_t _M_bulk_calls;
+        uint64_t _M_seeks;
+        uint64_t _M_expansions;
+        /* bytes the expansions carried over, whether moved or grown in place. */
+        uint64_t _M_expansion_bytes;
+        uint64_t _M_fills;
+        uint64_t _M_fill_bytes;
+        uint64_t _M_drains;
+        uint64_t _M_drain_bytes;
+    } BSStats;
+
+    extern int BitStreamGetStats(BSStats*);
+    extern void BitStreamResetStats(void);
 
 #ifdef __cplusplus
 }
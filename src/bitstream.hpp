@@ -0,0 +1,286 @@
+#ifndef BITSTREAM_BITSTREAM_HPP_INCLUDED
+#define BITSTREAM_BITSTREAM_HPP_INCLUDED
+
+/**
+ * C++17 front end, header only.
+ *
+ * The classes wrap a BitInputStream or BitOutputStream owned by the caller
+ * and add no state to it beyond a sticky error on the output side, so C
+ * and C++ code can take turns on the same stream. Field widths are
+ * template arguments, the masks and shifts of a field fold into constants.
+ *
+ * A record is a typelist of fixed width fields. Its width is known at
+ * compile time, decoding and encoding check the bounds once per record and
+ * move the fields with fully unrolled unchecked reads and writes.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "bitstream.h"
+
+namespace bitstream {
+
+    /* the low N bits set, N = 1..64. */
+    template <std::size_t N>
+    inline constexpr std::uint64_t mask = N >= 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << (N & 63)) - 1;
+
+    /* narrowest unsigned type holding N bits. */
+    template <std::size_t N>
+    using uint_t = std::conditional_t<N <= 8, std::uint8_t,
+          std::conditional_t<N <= 16, std::uint16_t,
+          std::conditional_t<N <= 32, std::uint32_t, std::uint64_t>>>;
+
+    template <std::size_t N>
+    using int_t = std::make_signed_t<uint_t<N>>;
+
+    /* two's complement field of N bits to a signed value. */
+    template <std::size_t N>
+    constexpr std::int64_t sign_extend(std::uint64_t value) noexcept {
+        constexpr std::uint64_t sign = std::uint64_t(1) << (N - 1);
+        return static_cast<std::int64_t>((value ^ sign) - sign);
+    }
+
+    class input {
+    public:
+        explicit input(BitInputStream &bis) noexcept : _M_bis(&bis) {}
+
+        BitInputStream& stream() noexcept { return *_M_bis; }
+
+        /**
+         * Checked read with the sticky error of BitInputStreamFetchUInt,
+         * zero once a read failed, see ok().
+         */
+        template <std::size_t N>
+        std::uint64_t read() noexcept {
+            static_assert(N >= 1 && N <= 64, "fields are 1..64 bits wide");
+            BitInputStream *bis = _M_bis;
+
+            if (N - 1 >= bis->_M_cache_bits || bis->_M_error)
+                return BitInputStreamFetchUIntSlow(bis, N);
+            return take<N>();
+        }
+
+        template <std::size_t N>
+        std::int64_t read_int() noexcept {
+            return sign_extend<N>(read<N>());
+        }
+
+        /* the caller has made room with ensure(). */
+        template <std::size_t N>
+        std::uint64_t read_unchecked() noexcept {
+            static_assert(N >= 1 && N <= 64, "fields are 1..64 bits wide");
+
+            if (N > _M_bis->_M_cache_bits)
+                return BitInputStreamReadUIntUncheckedSlow(_M_bis, N);
+            return take<N>();
+        }
+
+        template <std::size_t N>
+        std::int64_t read_int_unchecked() noexcept {
+            return sign_extend<N>(read_unchecked<N>());
+        }
+
+        bool ensure(std::size_t bits) noexcept {
+            return BitInputStreamEnsure(_M_bis, bits) == 0;
+        }
+
+        bool ok() const noexcept {
+            return _M_bis->_M_error == BS_SUCCESS;
+        }
+
+        BSStatus error() const noexcept {
+            return BitInputStreamGetError(_M_bis);
+        }
+
+        void clear_error() noexcept {
+            BitInputStreamClearError(_M_bis);
+        }
+
+        /* records a failure the way a failing Fetch read does. */
+        void fail(BSStatus status) noexcept {
+            if (_M_bis->_M_error == BS_SUCCESS)
+                _M_bis->_M_error = status;
+        }
+
+    private:
+        template <std::size_t N>
+        std::uint64_t take() noexcept {
+            BitInputStream *bis = _M_bis;
+            std::uint64_t value = bis->_M_cache >> (64 - N);
+
+            if constexpr (N == 64)
+                bis->_M_cache = 0;
+            else
+                bis->_M_cache <<= N;
+            bis->_M_cache_bits -= N;
+            bis->_M_position += N;
+            return value;
+        }
+
+        BitInputStream *_M_bis;
+    };
+
+    class output {
+    public:
+        explicit output(BitOutputStream &bos) noexcept : _M_bos(&bos), _M_error(BS_SUCCESS) {}
+
+        BitOutputStream& stream() noexcept { return *_M_bos; }
+
+        /* false, and the error sticks, once the stream ran out of room. */
+        template <std::size_t N>
+        bool write(std::uint64_t value) noexcept {
+            if (!reserve(N))
+                return false;
+            write_unchecked<N>(value);
+            return true;
+        }
+
+        template <std::size_t N>
+        bool write_int(std::int64_t value) noexcept {
+            return write<N>(static_cast<std::uint64_t>(value));
+        }
+
+        /* the caller has made room with reserve(). */
+        template <std::size_t N>
+        void write_unchecked(std::uint64_t value) noexcept {
+            static_assert(N >= 1 && N <= 64, "fields are 1..64 bits wide");
+            BitOutputStream *bos = _M_bos;
+            std::size_t room = 64 - bos->_M_cache_bits;
+
+            if (N >= room) {
+                BitOutputStreamWriteUIntUncheckedSlow(bos, N, value);
+                return;
+            }
+            value &= mask<N>;
+            bos->_M_cache |= bos->_M_order == BS_LSB_FIRST ? value << bos->_M_cache_bits : value << (room - N);
+            bos->_M_cache_bits += N;
+            bos->_M_position += N;
+        }
+
+        template <std::size_t N>
+        void write_int_unchecked(std::int64_t value) noexcept {
+            write_unchecked<N>(static_cast<std::uint64_t>(value));
+        }
+
+        bool reserve(std::size_t bits) noexcept {
+            if (_M_error != BS_SUCCESS)
+                return false;
+            if (_M_bos->_M_position + bits <= _M_bos->_M_size)
+                return true;
+            if (BitOutputStreamReserve(_M_bos, bits) == 0)
+                return true;
+            _M_error = BS_FAIL;
+            return false;
+        }
+
+        bool ok() const noexcept {
+            return _M_error == BS_SUCCESS;
+        }
+
+        BSStatus error() const noexcept {
+            return _M_error;
+        }
+
+        void clear_error() noexcept {
+            _M_error = BS_SUCCESS;
+        }
+
+    private:
+        BitOutputStream *_M_bos;
+        BSStatus _M_error;
+    };
+
+    /* record fields: unsigned, two's complement and single bit flags. */
+    template <std::size_t N>
+    struct u {
+        static_assert(N >= 1 && N <= 64, "fields are 1..64 bits wide");
+        static constexpr std::size_t bits = N;
+        using value_type = uint_t<N>;
+
+        static value_type decode(input &in) noexcept {
+            return static_cast<value_type>(in.read_unchecked<N>());
+        }
+
+        static void encode(output &out, value_type value) noexcept {
+            out.write_unchecked<N>(static_cast<std::uint64_t>(value));
+        }
+    };
+
+    template <std::size_t N>
+    struct i {
+        static_assert(N >= 1 && N <= 64, "fields are 1..64 bits wide");
+        static constexpr std::size_t bits = N;
+        using value_type = int_t<N>;
+
+        static value_type decode(input &in) noexcept {
+            return static_cast<value_type>(in.read_int_unchecked<N>());
+        }
+
+        static void encode(output &out, value_type value) noexcept {
+            out.write_int_unchecked<N>(static_cast<std::int64_t>(value));
+        }
+    };
+
+    struct flag {
+        static constexpr std::size_t bits = 1;
+        using value_type = bool;
+
+        static value_type decode(input &in) noexcept {
+            return in.read_unchecked<1>() != 0;
+        }
+
+        static void encode(output &out, value_type value) noexcept {
+            out.write_unchecked<1>(value ? 1 : 0);
+        }
+    };
+
+    /**
+     * A record of fields in order, its values a std::tuple of the value
+     * types of the fields. decode() fails with BS_EOS, recorded as the
+     * sticky error of the input, when the whole record is not there, and
+     * reads nothing then. encode() fails without writing when the output
+     * has no room for the whole record.
+     */
+    template <typename... Fields>
+    struct record {
+        static constexpr std::size_t bits = (Fields::bits + ... + 0);
+        using value_type = std::tuple<typename Fields::value_type...>;
+
+        static bool decode(input &in, value_type &values) noexcept {
+            if (!in.ok())
+                return false;
+            if (!in.ensure(bits)) {
+                in.fail(BS_EOS);
+                return false;
+            }
+            decode_fields(in, values, std::index_sequence_for<Fields...>());
+            return true;
+        }
+
+        static bool encode(output &out, value_type const &values) noexcept {
+            if (!out.reserve(bits))
+                return false;
+            encode_fields(out, values, std::index_sequence_for<Fields...>());
+            return true;
+        }
+
+    private:
+        /* a fold over the comma operator runs the fields in order. */
+        template <std::size_t... I>
+        static void decode_fields(input &in, value_type &values, std::index_sequence<I...>) noexcept {
+            ((void) (std::get<I>(values) = Fields::decode(in)), ...);
+        }
+
+        template <std::size_t... I>
+        static void encode_fields(output &out, value_type const &values, std::index_sequence<I...>) noexcept {
+            (Fields::encode(out, std::get<I>(values)), ...);
+        }
+    };
+
+}
+
+#endif
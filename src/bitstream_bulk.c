@@ -0,0 +1,586 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#if BS_HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/**
+ * Bulk unpacking of `count` consecutive fields of the same width.
+ *
+ * Each width gets its own copy of the scalar loop through the switch in
+ * the dispatchers below, so that shifts and masks are constants. On x86
+ * the fields of up to 25 bits are unpacked 8 at a time by SSE4.1 or AVX2
+ * kernels chosen at runtime: 8 fields of `bits` bits are exactly `bits`
+ * bytes, so the bit offset inside the first byte and the byte shuffles
+ * stay the same for every round.
+ */
+
+/* widest field served by the SIMD kernels, 7 skipped bits + 25 in 32. */
+#define BS_SIMD_UNPACK_BITS 25
+
+#define BS_WIDTHS_1_8(X) X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8)
+#define BS_WIDTHS_9_16(X) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16)
+#define BS_WIDTHS_17_32(X) \
+    X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24) \
+    X(25) X(26) X(27) X(28) X(29) X(30) X(31) X(32)
+#define BS_WIDTHS_33_64(X) \
+    X(33) X(34) X(35) X(36) X(37) X(38) X(39) X(40) \
+    X(41) X(42) X(43) X(44) X(45) X(46) X(47) X(48) \
+    X(49) X(50) X(51) X(52) X(53) X(54) X(55) X(56) \
+    X(57) X(58) X(59) X(60) X(61) X(62) X(63) X(64)
+
+/**
+ * One field of 1..64 bits at bit position `pos`, the window load is bounded
+ * only near the end of the buffer.
+ */
+BS_INLINE uint64_t BitStreamExtract(uint8_t const *bytes, size_t nbytes, size_t pos, size_t bits) {
+    uint64_t hi;
+    if (bits <= BS_WINDOW_BITS)
+        return (BitStreamLoadWindow(bytes, nbytes, pos >> 3) << (pos & 0x7)) >> (64 - bits);
+    hi = (BitStreamLoadWindow(bytes, nbytes, pos >> 3) << (pos & 0x7)) >> (96 - bits);
+    pos += bits - 32;
+    return (hi << 32) | ((BitStreamLoadWindow(bytes, nbytes, pos >> 3) << (pos & 0x7)) >> 32);
+}
+
+#define BS_DEFINE_UNPACK_SCALAR(T, NAME) \
+    BS_INLINE void NAME##Width(uint8_t const *bytes, size_t nbytes, size_t pos, \
+            size_t const bits, size_t count, T *values) { \
+        size_t i; \
+        for (i = 0; i < count; ++i, pos += bits) \
+            values[i] = (T) BitStreamExtract(bytes, nbytes, pos, bits); \
+    }
+
+BS_DEFINE_UNPACK_SCALAR(uint8_t, BitStreamUnpack8)
+BS_DEFINE_UNPACK_SCALAR(uint16_t, BitStreamUnpack16)
+BS_DEFINE_UNPACK_SCALAR(uint32_t, BitStreamUnpack32)
+BS_DEFINE_UNPACK_SCALAR(uint64_t, BitStreamUnpack64)
+
+#define BS_UNPACK_CASE(N) case N: BS_UNPACK_WIDTH(bytes, nbytes, pos, N, count, values); break;
+
+static void BitStreamUnpack8(uint8_t const *bytes, size_t nbytes, size_t pos,
+        size_t bits, size_t count, uint8_t *values) {
+#define BS_UNPACK_WIDTH BitStreamUnpack8Width
+    switch (bits) {
+        BS_WIDTHS_1_8(BS_UNPACK_CASE)
+    }
+#undef BS_UNPACK_WIDTH
+}
+
+static void BitStreamUnpack16(uint8_t const *bytes, size_t nbytes, size_t pos,
+        size_t bits, size_t count, uint16_t *values) {
+#define BS_UNPACK_WIDTH BitStreamUnpack16Width
+    switch (bits) {
+        BS_WIDTHS_1_8(BS_UNPACK_CASE)
+        BS_WIDTHS_9_16(BS_UNPACK_CASE)
+    }
+#undef BS_UNPACK_WIDTH
+}
+
+static void BitStreamUnpack32(uint8_t const *bytes, size_t nbytes, size_t pos,
+        size_t bits, size_t count, uint32_t *values) {
+#define BS_UNPACK_WIDTH BitStreamUnpack32Width
+    switch (bits) {
+        BS_WIDTHS_1_8(BS_UNPACK_CASE)
+        BS_WIDTHS_9_16(BS_UNPACK_CASE)
+        BS_WIDTHS_17_32(BS_UNPACK_CASE)
+    }
+#undef BS_UNPACK_WIDTH
+}
+
+static void BitStreamUnpack64(uint8_t const *bytes, size_t nbytes, size_t pos,
+        size_t bits, size_t count, uint64_t *values) {
+#define BS_UNPACK_WIDTH BitStreamUnpack64Width
+    switch (bits) {
+        BS_WIDTHS_1_8(BS_UNPACK_CASE)
+        BS_WIDTHS_9_16(BS_UNPACK_CASE)
+        BS_WIDTHS_17_32(BS_UNPACK_CASE)
+        BS_WIDTHS_33_64(BS_UNPACK_CASE)
+    }
+#undef BS_UNPACK_WIDTH
+}
+
+#if BS_HAVE_X86_DISPATCH
+
+/**
+ * Shuffle and shift plan of 8 fields starting `shift` bits into the first
+ * byte. Lanes 0..3 read 16 bytes from the first byte, lanes 4..7 from
+ * `_M_offset` bytes further. Every lane gathers the 4 bytes holding its
+ * field as a big-endian 32 bits integer.
+ */
+typedef struct tagBSUnpackPlan {
+    uint8_t _M_shuffle[32];
+    uint32_t _M_shift[8];
+    size_t _M_offset;
+} BSUnpackPlan;
+
+static void BitStreamPlanUnpack(BSUnpackPlan *plan, size_t shift, size_t bits) {
+    size_t i, j, rel, base;
+
+    plan->_M_offset = (shift + 4 * bits) >> 3;
+    for (i = 0; i < 8; ++i) {
+        base = i < 4 ? 0 : plan->_M_offset << 3;
+        rel = shift + i * bits - base;
+        for (j = 0; j < 4; ++j)
+            plan->_M_shuffle[(i << 2) + j] = (uint8_t) ((rel >> 3) + 3 - j);
+        plan->_M_shift[i] = (uint32_t) (rel & 0x7);
+    }
+}
+
+/* 1 << shift of 4 lanes. */
+BS_TARGET("sse4.1") BS_INLINE __m128i BitStreamShiftMultipliers(uint32_t const *shift) {
+    return _mm_setr_epi32(1 << shift[0], 1 << shift[1], 1 << shift[2], 1 << shift[3]);
+}
+
+/* 8 fields as 32 bits lanes, lanes 0..3 in `lo` and 4..7 in `hi`. */
+BS_TARGET("sse4.1") BS_INLINE void BitStreamUnpack8x32SSE41(uint8_t const *p, BSUnpackPlan const *plan,
+        __m128i const *masks, __m128i const *multipliers, __m128i count, __m128i *lo, __m128i *hi) {
+    __m128i a = _mm_loadu_si128((__m128i const*) p);
+    __m128i b = _mm_loadu_si128((__m128i const*) (p + plan->_M_offset));
+    /* no variable shift before AVX2, multiply by 1 << shift instead. */
+    a = _mm_mullo_epi32(_mm_shuffle_epi8(a, masks[0]), multipliers[0]);
+    b = _mm_mullo_epi32(_mm_shuffle_epi8(b, masks[1]), multipliers[1]);
+    *lo = _mm_srl_epi32(a, count);
+    *hi = _mm_srl_epi32(b, count);
+}
+
+#define BS_DEFINE_UNPACK_SSE41(T, NAME, STORE) \
+    BS_TARGET("sse4.1") static size_t NAME(uint8_t const *p, uint8_t const *end, \
+            size_t shift, size_t bits, size_t count, T *values) { \
+        BSUnpackPlan plan; \
+        __m128i masks[2], multipliers[2], count_vec, lo, hi; \
+        size_t done = 0; \
+        BitStreamPlanUnpack(&plan, shift, bits); \
+        masks[0] = _mm_loadu_si128((__m128i const*) &plan._M_shuffle[0]); \
+        masks[1] = _mm_loadu_si128((__m128i const*) &plan._M_shuffle[16]); \
+        multipliers[0] = BitStreamShiftMultipliers(&plan._M_shift[0]); \
+        multipliers[1] = BitStreamShiftMultipliers(&plan._M_shift[4]); \
+        count_vec = _mm_cvtsi32_si128((int) (32 - bits)); \
+        while (done + 8 <= count && p + plan._M_offset + 16 <= end) { \
+            BitStreamUnpack8x32SSE41(p, &plan, masks, multipliers, count_vec, &lo, &hi); \
+            STORE; \
+            values += 8; \
+            done += 8; \
+            p += bits; \
+        } \
+        return done; \
+    }
+
+BS_DEFINE_UNPACK_SSE41(uint8_t, BitStreamUnpack8SSE41,
+        _mm_storel_epi64((__m128i*) values, _mm_packus_epi16(_mm_packus_epi32(lo, hi), _mm_setzero_si128())))
+BS_DEFINE_UNPACK_SSE41(uint16_t, BitStreamUnpack16SSE41,
+        _mm_storeu_si128((__m128i*) values, _mm_packus_epi32(lo, hi)))
+BS_DEFINE_UNPACK_SSE41(uint32_t, BitStreamUnpack32SSE41,
+        _mm_storeu_si128((__m128i*) values, lo); _mm_storeu_si128((__m128i*) (values + 4), hi))
+BS_DEFINE_UNPACK_SSE41(uint64_t, BitStreamUnpack64SSE41,
+        _mm_storeu_si128((__m128i*) values, _mm_cvtepu32_epi64(lo));
+        _mm_storeu_si128((__m128i*) (values + 2), _mm_cvtepu32_epi64(_mm_srli_si128(lo, 8)));
+        _mm_storeu_si128((__m128i*) (values + 4), _mm_cvtepu32_epi64(hi));
+        _mm_storeu_si128((__m128i*) (values + 6), _mm_cvtepu32_epi64(_mm_srli_si128(hi, 8))))
+
+#define BS_LO128(V) _mm256_castsi256_si128(V)
+#define BS_HI128(V) _mm256_extracti128_si256(V, 1)
+
+#define BS_DEFINE_UNPACK_AVX2(T, NAME, STORE) \
+    BS_TARGET("avx2") static size_t NAME(uint8_t const *p, uint8_t const *end, \
+            size_t shift, size_t bits, size_t count, T *values) { \
+        BSUnpackPlan plan; \
+        __m256i mask, shifts, v; \
+        __m128i count_vec; \
+        size_t done = 0; \
+        BitStreamPlanUnpack(&plan, shift, bits); \
+        mask = _mm256_loadu_si256((__m256i const*) &plan._M_shuffle[0]); \
+        shifts = _mm256_loadu_si256((__m256i const*) &plan._M_shift[0]); \
+        count_vec = _mm_cvtsi32_si128((int) (32 - bits)); \
+        while (done + 8 <= count && p + plan._M_offset + 16 <= end) { \
+            v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((__m128i const*) p)), \
+                    _mm_loadu_si128((__m128i const*) (p + plan._M_offset)), 1); \
+            v = _mm256_srl_epi32(_mm256_sllv_epi32(_mm256_shuffle_epi8(v, mask), shifts), count_vec); \
+            STORE; \
+            values += 8; \
+            done += 8; \
+            p += bits; \
+        } \
+        return done; \
+    }
+
+BS_DEFINE_UNPACK_AVX2(uint8_t, BitStreamUnpack8AVX2,
+        _mm_storel_epi64((__m128i*) values, _mm_packus_epi16(_mm_packus_epi32(BS_LO128(v), BS_HI128(v)), _mm_setzero_si128())))
+BS_DEFINE_UNPACK_AVX2(uint16_t, BitStreamUnpack16AVX2,
+        _mm_storeu_si128((__m128i*) values, _mm_packus_epi32(BS_LO128(v), BS_HI128(v))))
+BS_DEFINE_UNPACK_AVX2(uint32_t, BitStreamUnpack32AVX2,
+        _mm256_storeu_si256((__m256i*) values, v))
+BS_DEFINE_UNPACK_AVX2(uint64_t, BitStreamUnpack64AVX2,
+        _mm256_storeu_si256((__m256i*) values, _mm256_cvtepu32_epi64(BS_LO128(v)));
+        _mm256_storeu_si256((__m256i*) (values + 4), _mm256_cvtepu32_epi64(BS_HI128(v))))
+
+#endif /* BS_HAVE_X86_DISPATCH */
+
+typedef size_t (*BSUnpack8Kernel)(uint8_t const*, uint8_t const*, size_t, size_t, size_t, uint8_t*);
+typedef size_t (*BSUnpack16Kernel)(uint8_t const*, uint8_t const*, size_t, size_t, size_t, uint16_t*);
+typedef size_t (*BSUnpack32Kernel)(uint8_t const*, uint8_t const*, size_t, size_t, size_t, uint32_t*);
+typedef size_t (*BSUnpack64Kernel)(uint8_t const*, uint8_t const*, size_t, size_t, size_t, uint64_t*);
+
+typedef struct tagBSUnpackKernels {
+    BSUnpack8Kernel _M_unpack8;
+    BSUnpack16Kernel _M_unpack16;
+    BSUnpack32Kernel _M_unpack32;
+    BSUnpack64Kernel _M_unpack64;
+} BSUnpackKernels;
+
+/**
+ * Kernels of the running CPU, looked up once. Concurrent first calls race
+ * benignly, they all store the same pointers.
+ */
+static BSUnpackKernels const* BitStreamUnpackKernels(void) {
+    static BSUnpackKernels kernels;
+    static int volatile resolved = 0;
+
+    if (resolved)
+        return &kernels;
+#if BS_HAVE_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels._M_unpack8 = &BitStreamUnpack8AVX2;
+        kernels._M_unpack16 = &BitStreamUnpack16AVX2;
+        kernels._M_unpack32 = &BitStreamUnpack32AVX2;
+        kernels._M_unpack64 = &BitStreamUnpack64AVX2;
+    } else if (__builtin_cpu_supports("sse4.1")) {
+        kernels._M_unpack8 = &BitStreamUnpack8SSE41;
+        kernels._M_unpack16 = &BitStreamUnpack16SSE41;
+        kernels._M_unpack32 = &BitStreamUnpack32SSE41;
+        kernels._M_unpack64 = &BitStreamUnpack64SSE41;
+    }
+#endif
+    resolved = 1;
+    return &kernels;
+}
+
+/**
+ * Unpacks `count` fields available in memory after the cursor. The kernels
+ * are MSB first, LSB first fields go one load each.
+ */
+#define BS_DEFINE_UNPACK_ARRAY(T, WIDTH) \
+    static void BitInputStreamUnpackArray##WIDTH(BitInputStream *bis, size_t bits, size_t count, T *values) { \
+        BSUnpack##WIDTH##Kernel kernel = BitStreamUnpackKernels()->_M_unpack##WIDTH; \
+        size_t nbytes = (bis->_M_size + 7) >> 3; \
+        size_t pos = bis->_M_position; \
+        size_t done = 0; \
+        if (bis->_M_order == BS_LSB_FIRST) { \
+            for (; done < count; ++done, pos += bits) \
+                values[done] = (T) BitStreamExtractLsb(bis->_M_bytes, nbytes, pos, bits); \
+            bis->_M_position = pos; \
+            return; \
+        } \
+        if (kernel && bits <= BS_SIMD_UNPACK_BITS) \
+            done = kernel(bis->_M_bytes + (pos >> 3), bis->_M_bytes + nbytes, pos & 0x7, bits, count, values); \
+        pos += done * bits; \
+        BitStreamUnpack##WIDTH(bis->_M_bytes, nbytes, pos, bits, count - done, values + done); \
+        bis->_M_position = pos + (count - done) * bits; \
+        bis->_M_cache_bits = 0; \
+    }
+
+BS_DEFINE_UNPACK_ARRAY(uint8_t, 8)
+BS_DEFINE_UNPACK_ARRAY(uint16_t, 16)
+BS_DEFINE_UNPACK_ARRAY(uint32_t, 32)
+BS_DEFINE_UNPACK_ARRAY(uint64_t, 64)
+
+/**
+ * In memory streams read all of the fields or none of them. Source backed
+ * ones go window by window, so the fields before an EOS are consumed and
+ * counted in the result.
+ */
+#define BS_DEFINE_READ_ARRAY(T, WIDTH) \
+    ReadResult BitInputStreamReadUIntArray##WIDTH(BitInputStream *bis, size_t bits, size_t count, T *values) { \
+        ReadResult result; \
+        size_t done = 0; \
+        size_t n; \
+        result._M_status = BS_SUCCESS; \
+        result._M_value.uint = count; \
+        BS_STAT_INC(bulk_calls); \
+        if (bits == 0 || bits > WIDTH) { \
+            result._M_status = BS_FAIL; \
+            result._M_value.uint = 0; \
+            return result; \
+        } \
+        if (!BitInputStreamHasReader(bis)) { \
+            if (count > (bis->_M_size - bis->_M_position) / bits) { \
+                BS_STAT_INC(eos); \
+                result._M_status = BS_EOS; \
+                result._M_value.uint = 0; \
+            } else { \
+                BS_STAT_ADD(bits_read, bits * count); \
+                BitInputStreamUnpackArray##WIDTH(bis, bits, count, values); \
+            } \
+            return result; \
+        } \
+        while (done < count) { \
+            n = (bis->_M_size - bis->_M_position) / bits; \
+            if (n == 0) { \
+                if (!BitInputStreamFill(bis, bits)) { \
+                    BS_STAT_INC(eos); \
+                    result._M_status = BS_EOS; \
+                    break; \
+                } \
+                continue; \
+            } \
+            if (n > count - done) \
+                n = count - done; \
+            BS_STAT_ADD(bits_read, bits * n); \
+            BitInputStreamUnpackArray##WIDTH(bis, bits, n, values + done); \
+            done += n; \
+        } \
+        result._M_value.uint = done; \
+        return result; \
+    }
+
+BS_DEFINE_READ_ARRAY(uint8_t, 8)
+BS_DEFINE_READ_ARRAY(uint16_t, 16)
+BS_DEFINE_READ_ARRAY(uint32_t, 32)
+BS_DEFINE_READ_ARRAY(uint64_t, 64)
+
+/**
+ * Bulk packing of `count` values as fields of the same width, the write
+ * side of the above. Values go through the accumulator of the stream held
+ * in registers for the whole array, one width specialized loop each. With
+ * AVX2, 8 fields of up to 16 bits are first merged into two 4 * `bits`
+ * wide chunks, which cuts the accumulator work by four.
+ */
+
+#define BS_SIMD_PACK_BITS 16
+
+#define BS_DEFINE_PACK_SCALAR(T, NAME) \
+    BS_INLINE void NAME##Width(BitOutputStream *bos, size_t const bits, size_t count, T const *values) { \
+        uint64_t cache = bos->_M_cache; \
+        size_t nbits = bos->_M_cache_bits; \
+        uint8_t *p = bos->_M_bytes + ((bos->_M_position - nbits) >> 3); \
+        size_t i; \
+        for (i = 0; i < count; ++i) \
+            BitStreamAccumulate(&cache, &nbits, &p, bits, values[i]); \
+        bos->_M_cache = cache; \
+        bos->_M_cache_bits = nbits; \
+        bos->_M_position += count * bits; \
+    }
+
+BS_DEFINE_PACK_SCALAR(uint8_t, BitStreamPack8)
+BS_DEFINE_PACK_SCALAR(uint16_t, BitStreamPack16)
+BS_DEFINE_PACK_SCALAR(uint32_t, BitStreamPack32)
+BS_DEFINE_PACK_SCALAR(uint64_t, BitStreamPack64)
+
+#define BS_PACK_CASE(N) case N: BS_PACK_WIDTH(bos, N, count, values); break;
+
+static void BitStreamPack8(BitOutputStream *bos, size_t bits, size_t count, uint8_t const *values) {
+#define BS_PACK_WIDTH BitStreamPack8Width
+    switch (bits) {
+        BS_WIDTHS_1_8(BS_PACK_CASE)
+    }
+#undef BS_PACK_WIDTH
+}
+
+static void BitStreamPack16(BitOutputStream *bos, size_t bits, size_t count, uint16_t const *values) {
+#define BS_PACK_WIDTH BitStreamPack16Width
+    switch (bits) {
+        BS_WIDTHS_1_8(BS_PACK_CASE)
+        BS_WIDTHS_9_16(BS_PACK_CASE)
+    }
+#undef BS_PACK_WIDTH
+}
+
+static void BitStreamPack32(BitOutputStream *bos, size_t bits, size_t count, uint32_t const *values) {
+#define BS_PACK_WIDTH BitStreamPack32Width
+    switch (bits) {
+        BS_WIDTHS_1_8(BS_PACK_CASE)
+        BS_WIDTHS_9_16(BS_PACK_CASE)
+        BS_WIDTHS_17_32(BS_PACK_CASE)
+    }
+#undef BS_PACK_WIDTH
+}
+
+static void BitStreamPack64(BitOutputStream *bos, size_t bits, size_t count, uint64_t const *values) {
+#define BS_PACK_WIDTH BitStreamPack64Width
+    switch (bits) {
+        BS_WIDTHS_1_8(BS_PACK_CASE)
+        BS_WIDTHS_9_16(BS_PACK_CASE)
+        BS_WIDTHS_17_32(BS_PACK_CASE)
+        BS_WIDTHS_33_64(BS_PACK_CASE)
+    }
+#undef BS_PACK_WIDTH
+}
+
+#if BS_HAVE_X86_DISPATCH
+
+#define BS_DEFINE_PACK_AVX2(T, NAME, LOAD) \
+    BS_TARGET("avx2") static size_t NAME(BitOutputStream *bos, size_t bits, size_t count, T const *values) { \
+        __m256i const low = _mm256_set1_epi64x(0xffffffff); \
+        __m256i const mask = _mm256_set1_epi32((int) ((1u << bits) - 1)); \
+        __m256i const gather = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7); \
+        __m128i const width1 = _mm_cvtsi32_si128((int) bits); \
+        __m128i const width2 = _mm_cvtsi32_si128((int) (bits << 1)); \
+        uint64_t cache = bos->_M_cache; \
+        size_t nbits = bos->_M_cache_bits; \
+        uint8_t *p = bos->_M_bytes + ((bos->_M_position - nbits) >> 3); \
+        size_t done = 0; \
+        __m256i v; \
+        for (; done + 8 <= count; done += 8, values += 8) { \
+            v = _mm256_and_si256(LOAD, mask); \
+            /* pairs of fields into 64 bits lanes, then pairs of lanes. */ \
+            v = _mm256_or_si256(_mm256_sll_epi64(_mm256_and_si256(v, low), width1), _mm256_srli_epi64(v, 32)); \
+            v = _mm256_permutevar8x32_epi32(v, gather); \
+            v = _mm256_or_si256(_mm256_sll_epi64(_mm256_and_si256(v, low), width2), _mm256_srli_epi64(v, 32)); \
+            BitStreamAccumulate(&cache, &nbits, &p, bits << 2, (uint64_t) _mm256_extract_epi64(v, 0)); \
+            BitStreamAccumulate(&cache, &nbits, &p, bits << 2, (uint64_t) _mm256_extract_epi64(v, 1)); \
+        } \
+        bos->_M_cache = cache; \
+        bos->_M_cache_bits = nbits; \
+        bos->_M_position += done * bits; \
+        return done; \
+    }
+
+BS_DEFINE_PACK_AVX2(uint8_t, BitStreamPack8AVX2,
+        _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const*) values)))
+BS_DEFINE_PACK_AVX2(uint16_t, BitStreamPack16AVX2,
+        _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i const*) values)))
+BS_DEFINE_PACK_AVX2(uint32_t, BitStreamPack32AVX2,
+        _mm256_loadu_si256((__m256i const*) values))
+
+#endif /* BS_HAVE_X86_DISPATCH */
+
+typedef size_t (*BSPack8Kernel)(BitOutputStream*, size_t, size_t, uint8_t const*);
+typedef size_t (*BSPack16Kernel)(BitOutputStream*, size_t, size_t, uint16_t const*);
+typedef size_t (*BSPack32Kernel)(BitOutputStream*, size_t, size_t, uint32_t const*);
+typedef size_t (*BSPack64Kernel)(BitOutputStream*, size_t, size_t, uint64_t const*);
+
+typedef struct tagBSPackKernels {
+    BSPack8Kernel _M_pack8;
+    BSPack16Kernel _M_pack16;
+    BSPack32Kernel _M_pack32;
+    BSPack64Kernel _M_pack64;
+} BSPackKernels;
+
+static BSPackKernels const* BitStreamPackKernels(void) {
+    static BSPackKernels kernels;
+    static int volatile resolved = 0;
+
+    if (resolved)
+        return &kernels;
+#if BS_HAVE_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels._M_pack8 = &BitStreamPack8AVX2;
+        kernels._M_pack16 = &BitStreamPack16AVX2;
+        kernels._M_pack32 = &BitStreamPack32AVX2;
+    }
+#endif
+    resolved = 1;
+    return &kernels;
+}
+
+/**
+ * Whether every value fits in `bits` bits. Independent lanes of OR keep
+ * the loop free of branches, compilers vectorize it.
+ */
+#define BS_DEFINE_CHECK_ARRAY(T, NAME) \
+    static int NAME(size_t bits, size_t count, T const *values) { \
+        uint64_t acc[4] = { 0, 0, 0, 0 }; \
+        size_t i; \
+        for (i = 0; i + 4 <= count; i += 4) { \
+            acc[0] |= values[i]; \
+            acc[1] |= values[i + 1]; \
+            acc[2] |= values[i + 2]; \
+            acc[3] |= values[i + 3]; \
+        } \
+        for (; i < count; ++i) \
+            acc[0] |= values[i]; \
+        acc[0] |= acc[1] | acc[2] | acc[3]; \
+        return bits >= 64 || (acc[0] >> bits) == 0; \
+    }
+
+BS_DEFINE_CHECK_ARRAY(uint8_t, BitStreamCheckArray8)
+BS_DEFINE_CHECK_ARRAY(uint16_t, BitStreamCheckArray16)
+BS_DEFINE_CHECK_ARRAY(uint32_t, BitStreamCheckArray32)
+BS_DEFINE_CHECK_ARRAY(uint64_t, BitStreamCheckArray64)
+
+/**
+ * Packs `count` fields into the room already available after the cursor,
+ * LSB first ones one at a time.
+ */
+#define BS_DEFINE_PACK_ARRAY(T, WIDTH) \
+    static void BitOutputStreamPackArray##WIDTH(BitOutputStream *bos, size_t bits, size_t count, \
+            T const *values) { \
+        BSPack##WIDTH##Kernel kernel = BitStreamPackKernels()->_M_pack##WIDTH; \
+        size_t done = 0; \
+        if (bos->_M_order == BS_LSB_FIRST) { \
+            for (; done < count; ++done) \
+                BitOutputStreamPutLsb(bos, bits, values[done]); \
+            return; \
+        } \
+        if (kernel && bits <= BS_SIMD_PACK_BITS) \
+            done = kernel(bos, bits, count, values); \
+        BitStreamPack##WIDTH(bos, bits, count - done, values + done); \
+    }
+
+BS_DEFINE_PACK_ARRAY(uint8_t, 8)
+BS_DEFINE_PACK_ARRAY(uint16_t, 16)
+BS_DEFINE_PACK_ARRAY(uint32_t, 32)
+BS_DEFINE_PACK_ARRAY(uint64_t, 64)
+
+/**
+ * In memory streams are reserved once for the whole array. Sink backed
+ * ones go buffer by buffer, a failing sink leaves the fields before it
+ * written.
+ */
+#define BS_DEFINE_WRITE_ARRAY(T, WIDTH) \
+    WriteResult BitOutputStreamWriteUIntArray##WIDTH(BitOutputStream *bos, size_t bits, size_t count, \
+            T const *values, BSPackMode mode) { \
+        WriteResult result = { BS_SUCCESS }; \
+        size_t done = 0; \
+        size_t n; \
+        BS_STAT_INC(bulk_calls); \
+        if (bits == 0 || bits > WIDTH || count > ((size_t) -1 - bos->_M_position) / bits) { \
+            BS_STAT_INC(failures); \
+            result._M_status = BS_FAIL; \
+            return result; \
+        } \
+        if (mode == BS_PACK_CHECK && !BitStreamCheckArray##WIDTH(bits, count, values)) { \
+            BS_STAT_INC(failures); \
+            result._M_status = BS_FAIL; \
+            return result; \
+        } \
+        if (!bos->_M_sink) { \
+            if (BitOutputStreamReserve(bos, bits * count) != 0) { \
+                BS_STAT_INC(failures); \
+                result._M_status = BS_FAIL; \
+            } else { \
+                BS_STAT_ADD(bits_written, bits * count); \
+                BitOutputStreamPackArray##WIDTH(bos, bits, count, values); \
+            } \
+            return result; \
+        } \
+        while (done < count) { \
+            n = (bos->_M_size - bos->_M_position) / bits; \
+            if (n == 0) { \
+                if (BitOutputStreamDrainSink(bos, bits) != 0) { \
+                    BS_STAT_INC(failures); \
+                    result._M_status = BS_FAIL; \
+                    break; \
+                } \
+                continue; \
+            } \
+            if (n > count - done) \
+                n = count - done; \
+            BS_STAT_ADD(bits_written, bits * n); \
+            BitOutputStreamPackArray##WIDTH(bos, bits, n, values + done); \
+            done += n; \
+        } \
+        return result; \
+    }
+
+BS_DEFINE_WRITE_ARRAY(uint8_t, 8)
+BS_DEFINE_WRITE_ARRAY(uint16_t, 16)
+BS_DEFINE_WRITE_ARRAY(uint32_t, 32)
+BS_DEFINE_WRITE_ARRAY(uint64_t, 64)
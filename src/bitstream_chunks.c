@@ -0,0 +1,213 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Chunked output streams.
+ *
+ * A sink whose drain links the buffer of the stream into a list of chunks
+ * and gives the stream a fresh chunk, instead of writing the bytes out.
+ * The partial trailing byte moves to the front of the new chunk as with
+ * any sink, so that a field spanning the end of a chunk goes on in the
+ * next one. Nothing written is ever copied again: growing costs a chunk
+ * allocation, not a move of everything written so far.
+ *
+ * The chunks are the linked ones in order, then the bytes of the current
+ * one. Flattening into one buffer is a copy the caller asks for.
+ */
+
+/* 64 KiB less the 16 bytes of header a pool puts in front of a buffer. */
+#define BS_CHUNK_DEFAULT_BYTES ((64 << 10) - 16)
+#define BS_CHUNK_MIN_BYTES 64
+
+typedef struct tagBSChunk {
+    uint8_t *_M_bytes;
+    size_t _M_size;
+} BSChunk;
+
+typedef struct tagBSChunkList {
+    BSChunk *_M_chunks;
+    size_t _M_count;
+    size_t _M_capacity;
+    size_t _M_chunk_bytes;
+    /* the allocator of the stream, chunks are its buffers. */
+    BSAllocator _M_allocator;
+} BSChunkList;
+
+static int BitOutputStreamDrainToChunks(BitOutputStream *bos, size_t bits) {
+    BSSink *sink = bos->_M_sink;
+    BSChunkList *list = (BSChunkList*) sink->_M_context;
+    BSAllocator const *allocator = &list->_M_allocator;
+    BSChunk *chunks;
+    uint8_t *bytes;
+    size_t capacity;
+    size_t nbytes;
+    size_t size;
+    size_t tail;
+
+    if (sink->_M_failed)
+        return -1;
+    BitOutputStreamFlush(bos);
+    nbytes = bos->_M_position >> 3;
+    tail = bos->_M_position & 0x7;
+    if (nbytes == 0 && tail + bits <= bos->_M_size)
+        return 0;
+    /* a reservation wider than a chunk gets a chunk of its own size. */
+    size = (tail + bits + 7) >> 3;
+    if (size < list->_M_chunk_bytes)
+        size = list->_M_chunk_bytes;
+    if (nbytes > 0 && list->_M_count == list->_M_capacity) {
+        capacity = list->_M_capacity ? list->_M_capacity << 1 : 16;
+        if (!(chunks = (BSChunk*) realloc(list->_M_chunks, capacity * sizeof(BSChunk)))) {
+            sink->_M_failed = 1;
+            return -1;
+        }
+        list->_M_chunks = chunks;
+        list->_M_capacity = capacity;
+    }
+    if (!(bytes = (uint8_t*) allocator->_M_malloc(allocator->_M_context, size))) {
+        sink->_M_failed = 1;
+        return -1;
+    }
+    if (tail)
+        bytes[0] = bos->_M_bytes[nbytes];
+    if (nbytes > 0) {
+        list->_M_chunks[list->_M_count]._M_bytes = bos->_M_bytes;
+        list->_M_chunks[list->_M_count]._M_size = nbytes;
+        ++list->_M_count;
+    } else {
+        /* nothing complete to link, the small chunk is replaced. */
+        allocator->_M_free(allocator->_M_context, bos->_M_bytes);
+    }
+    bos->_M_bytes = bytes;
+    bos->_M_size = size << 3;
+    bos->_M_position -= nbytes << 3;
+    bos->_M_base += nbytes << 3;
+    return 0;
+}
+
+static void BitStreamCloseSinkChunks(BSSink *sink) {
+    BSChunkList *list = (BSChunkList*) sink->_M_context;
+    size_t i;
+
+    for (i = 0; i < list->_M_count; ++i)
+        list->_M_allocator._M_free(list->_M_allocator._M_context, list->_M_chunks[i]._M_bytes);
+    free(list->_M_chunks);
+    free(list);
+}
+
+BS_INLINE BSChunkList* BitOutputStreamGetChunkList(BitOutputStream const *bos) {
+    if (bos->_M_sink && bos->_M_sink->_M_drain == &BitOutputStreamDrainToChunks)
+        return (BSChunkList*) bos->_M_sink->_M_context;
+    return NULL;
+}
+
+/**
+ * A growable stream made of chunks of `chunk` bytes, zero for 64 KiB less
+ * a pool header, taken from `allocator`, NULL for malloc. A reservation
+ * wider than a chunk gets a chunk of its own size. As with any sink
+ * backed stream, seeking cannot go back before the start of the current
+ * chunk.
+ */
+BitOutputStream* BitOutputStreamInitializeChunked(BitOutputStream *bos, size_t chunk, BSAllocator const *allocator) {
+    BSChunkList *list;
+    BSSink *sink;
+
+    if (!bos)
+        return NULL;
+    if (chunk == 0)
+        chunk = BS_CHUNK_DEFAULT_BYTES;
+    if (chunk < BS_CHUNK_MIN_BYTES)
+        chunk = BS_CHUNK_MIN_BYTES;
+    if (!(sink = (BSSink*) calloc(1, sizeof(BSSink))))
+        return NULL;
+    if (!(list = (BSChunkList*) calloc(1, sizeof(BSChunkList)))) {
+        free(sink);
+        return NULL;
+    }
+    if (!BitOutputStreamInitializeWithAllocator(bos, NULL, chunk << 3, allocator)) {
+        free(list);
+        free(sink);
+        return NULL;
+    }
+    list->_M_chunk_bytes = chunk;
+    list->_M_allocator = bos->_M_allocator;
+    sink->_M_context = list;
+    sink->_M_drain = &BitOutputStreamDrainToChunks;
+    sink->_M_close = &BitStreamCloseSinkChunks;
+    bos->_M_sink = sink;
+    return bos;
+}
+
+/**
+ * Number of chunks holding the bytes written so far, a contiguous in
+ * memory stream being a single chunk. For other sink backed streams only
+ * the bytes still buffered.
+ */
+size_t BitOutputStreamGetChunkCount(BitOutputStream const *bos) {
+    BSChunkList const *list = BitOutputStreamGetChunkList(bos);
+
+    return (list ? list->_M_count : 0) + (bos->_M_position > 0 ? 1 : 0);
+}
+
+/**
+ * Chunk `i` and its size in bytes, NULL past the last one. The last chunk
+ * ends with the partial trailing byte, BitOutputStreamFinish pads it.
+ * Chunks stay valid until the next write.
+ */
+void const* BitOutputStreamGetChunk(BitOutputStream const *bos, size_t i, size_t *size) {
+    BSChunkList const *list = BitOutputStreamGetChunkList(bos);
+    size_t linked = list ? list->_M_count : 0;
+
+    if (i < linked) {
+        *size = list->_M_chunks[i]._M_size;
+        return list->_M_chunks[i]._M_bytes;
+    }
+    if (i > linked || bos->_M_position == 0) {
+        *size = 0;
+        return NULL;
+    }
+    *size = (bos->_M_position + 7) >> 3;
+    return BitOutputStreamGetBuffer(bos);
+}
+
+/**
+ * Copies the chunks, in order, into one buffer of `n` bytes. Returns the
+ * size of the whole output in bytes, which may be more than `n`: a call
+ * with no buffer gets the size to allocate.
+ */
+size_t BitOutputStreamFlatten(BitOutputStream const *bos, void *buffer, size_t n) {
+    uint8_t *p = (uint8_t*) buffer;
+    size_t total = 0;
+    size_t size;
+    size_t i;
+    void const *chunk;
+
+    for (i = 0; (chunk = BitOutputStreamGetChunk(bos, i, &size)); ++i) {
+        if (total < n)
+            memcpy(p + total, chunk, size < n - total ? size : n - total);
+        total += size;
+    }
+    return total;
+}
+
+#if defined(BS_HAVE_IOVEC)
+/**
+ * Fills up to `n` entries of `iov` with the chunks, for writev or sendmsg.
+ * Returns the number of chunks, which may be more than `n`.
+ */
+size_t BitOutputStreamGetIovec(BitOutputStream const *bos, struct iovec *iov, size_t n) {
+    size_t count = BitOutputStreamGetChunkCount(bos);
+    size_t size;
+    size_t i;
+
+    for (i = 0; i < n && i < count; ++i) {
+        iov[i].iov_base = (void*) BitOutputStreamGetChunk(bos, i, &size);
+        iov[i].iov_len = size;
+    }
+    return count;
+}
+#endif
@@ -0,0 +1,439 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Bit exact copies and byte strings.
+ *
+ * Long runs are written as whole bytes once the output is on a byte
+ * boundary, with memcpy when the source is byte aligned too, funnel
+ * shifted a vector of bytes at a time otherwise. Short runs and the ends
+ * of long ones are merged into the accumulator of the output stream, 56
+ * bits per load shifted into place.
+ */
+
+/* runs at least this long go through the byte copy. */
+#define BS_COPY_BYTES_MIN_BITS 128
+
+/* UTF-8 strings are read and checked a block at a time, still in cache. */
+#define BS_UTF8_BLOCK (16 << 10)
+
+/**
+ * out[i] is made of the bytes in[i] and in[i + 1] funnel shifted by
+ * `shift`, 1..7 bits, towards the first bit of the bit order. Reads n + 1
+ * bytes.
+ */
+static void BitStreamFunnelBytes(uint8_t *out, uint8_t const *in, size_t n, unsigned shift, BSBitOrder order) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i const count = _mm_cvtsi32_si128((int) shift);
+    __m128i const back = _mm_cvtsi32_si128((int) (8 - shift));
+    __m128i const first = _mm_set1_epi8((char) (order == BS_LSB_FIRST ? 0xff >> shift : (0xff << shift) & 0xff));
+    __m128i const second = _mm_set1_epi8((char) ~(order == BS_LSB_FIRST ? 0xff >> shift : (0xff << shift) & 0xff));
+    __m128i a, b;
+
+    /* shifts of 16 bits lanes, the bits crossing into the neighbour byte are masked out. */
+    if (order == BS_LSB_FIRST) {
+        for (; i + 16 <= n; i += 16) {
+            a = _mm_loadu_si128((__m128i const*) (in + i));
+            b = _mm_loadu_si128((__m128i const*) (in + i + 1));
+            _mm_storeu_si128((__m128i*) (out + i), _mm_or_si128(_mm_and_si128(_mm_srl_epi16(a, count), first),
+                        _mm_and_si128(_mm_sll_epi16(b, back), second)));
+        }
+    } else {
+        for (; i + 16 <= n; i += 16) {
+            a = _mm_loadu_si128((__m128i const*) (in + i));
+            b = _mm_loadu_si128((__m128i const*) (in + i + 1));
+            _mm_storeu_si128((__m128i*) (out + i), _mm_or_si128(_mm_and_si128(_mm_sll_epi16(a, count), first),
+                        _mm_and_si128(_mm_srl_epi16(b, back), second)));
+        }
+    }
+#endif
+    if (order == BS_LSB_FIRST) {
+        for (; i + 8 <= n; i += 8)
+            BitStreamStoreLE64(out + i, (BitStreamLoadLE64(in + i) >> shift) | ((uint64_t) in[i + 8] << (64 - shift)));
+        for (; i < n; ++i)
+            out[i] = (uint8_t) ((in[i] >> shift) | (in[i + 1] << (8 - shift)));
+    } else {
+        for (; i + 8 <= n; i += 8)
+            BitStreamStoreBE64(out + i, (BitStreamLoadBE64(in + i) << shift) | (in[i + 8] >> (8 - shift)));
+        for (; i < n; ++i)
+            out[i] = (uint8_t) ((in[i] << shift) | (in[i + 1] >> (8 - shift)));
+    }
+}
+
+/**
+ * Merges `bits` bits of `src` from bit `pos` on through the accumulator,
+ * 56 bits per load. `nbytes` bounds the loads from `src`.
+ */
+static void BitOutputStreamMergeFields(BitOutputStream *bos, uint8_t const *src, size_t nbytes, size_t pos,
+        size_t bits) {
+    uint64_t cache = bos->_M_cache;
+    size_t nbits = bos->_M_cache_bits;
+    uint8_t *p = bos->_M_bytes + ((bos->_M_position - nbits) >> 3);
+
+    bos->_M_position += bits;
+    if (bos->_M_order == BS_LSB_FIRST) {
+        for (; bits >= 56; bits -= 56, pos += 56)
+            BitStreamAccumulateLsb(&cache, &nbits, &p, 56,
+                    BitStreamLoadWindowLE(src, nbytes, pos >> 3) >> (pos & 0x7));
+        if (bits > 0)
+            BitStreamAccumulateLsb(&cache, &nbits, &p, bits,
+                    BitStreamLoadWindowLE(src, nbytes, pos >> 3) >> (pos & 0x7));
+    } else {
+        for (; bits >= 56; bits -= 56, pos += 56)
+            BitStreamAccumulate(&cache, &nbits, &p, 56,
+                    (BitStreamLoadWindow(src, nbytes, pos >> 3) << (pos & 0x7)) >> 8);
+        if (bits > 0)
+            BitStreamAccumulate(&cache, &nbits, &p, bits,
+                    (BitStreamLoadWindow(src, nbytes, pos >> 3) << (pos & 0x7)) >> (64 - bits));
+    }
+    bos->_M_cache = cache;
+    bos->_M_cache_bits = nbits;
+}
+
+/**
+ * Merges `bits` bits of `src` from bit `pos` on, the stream has room for
+ * them. Long runs bring the output to a byte boundary first, the whole
+ * bytes then go straight to memory, copied or funnel shifted by the
+ * alignment of the source. `nbytes` bounds the loads from `src`.
+ */
+static void BitOutputStreamMerge(BitOutputStream *bos, uint8_t const *src, size_t nbytes, size_t pos,
+        size_t bits) {
+    size_t head;
+    size_t n;
+    uint8_t *p;
+
+    if (bits >= BS_COPY_BYTES_MIN_BITS) {
+        head = (8 - (bos->_M_position & 0x7)) & 0x7;
+        BitOutputStreamMergeFields(bos, src, nbytes, pos, head);
+        pos += head;
+        bits -= head;
+        /* on a byte boundary the flush leaves the accumulator empty. */
+        BitOutputStreamFlush(bos);
+        n = bits >> 3;
+        p = bos->_M_bytes + (bos->_M_position >> 3);
+        if (pos & 0x7)
+            BitStreamFunnelBytes(p, src + (pos >> 3), n, (unsigned) (pos & 0x7), bos->_M_order);
+        else
+            memcpy(p, src + (pos >> 3), n);
+        bos->_M_position += n << 3;
+        pos += n << 3;
+        bits &= 0x7;
+    }
+    if (bits > 0)
+        BitOutputStreamMergeFields(bos, src, nbytes, pos, bits);
+}
+
+/**
+ * Writes `bits` bits of `buffer`, from bit `offset` on, in the bit order of
+ * the stream. In memory streams grow once for the whole run, sink backed
+ * ones go buffer by buffer.
+ */
+WriteResult BitOutputStreamWriteBits(BitOutputStream *bos, void const *buffer, size_t offset, size_t bits) {
+    WriteResult result = { BS_SUCCESS };
+    uint8_t const *src = (uint8_t const*) buffer;
+    size_t nbytes = (offset + bits + 7) >> 3;
+    size_t n;
+
+    BS_STAT_INC(bulk_calls);
+    if (!bos->_M_sink) {
+        if (BitOutputStreamReserve(bos, bits) != 0) {
+            BS_STAT_INC(failures);
+            result._M_status = BS_FAIL;
+        } else if (bits > 0) {
+            BS_STAT_ADD(bits_written, bits);
+            BitOutputStreamMerge(bos, src, nbytes, offset, bits);
+        }
+        return result;
+    }
+    while (bits > 0) {
+        n = bos->_M_size - bos->_M_position;
+        if (n == 0) {
+            if (BitOutputStreamDrainSink(bos, bits < 64 ? bits : 64) != 0) {
+                BS_STAT_INC(failures);
+                result._M_status = BS_FAIL;
+                break;
+            }
+            continue;
+        }
+        if (n > bits)
+            n = bits;
+        BS_STAT_ADD(bits_written, n);
+        BitOutputStreamMerge(bos, src, nbytes, offset, n);
+        offset += n;
+        bits -= n;
+    }
+    return result;
+}
+
+/**
+ * Appends what `src` holds, which has the bit order of the stream. A sink
+ * backed `src` which has drained bits already cannot be appended.
+ */
+WriteResult BitOutputStreamAppend(BitOutputStream *bos, BitOutputStream const *src) {
+    WriteResult result = { BS_FAIL };
+
+    if (src->_M_order != bos->_M_order || src->_M_base > 0 || src == bos)
+        return result;
+    return BitOutputStreamWriteBits(bos, BitOutputStreamGetBuffer(src), 0, src->_M_position);
+}
+
+/**
+ * Copies the next `bits` bits of the input to the output, at whatever
+ * alignment either of them is, a window of the input at a time. Both
+ * streams have the same bit order, BS_FAIL otherwise. An in memory output
+ * grows once for the whole copy. BS_EOS when the input runs short, the
+ * bits it had are copied.
+ */
+WriteResult BitStreamCopyBits(BitOutputStream *bos, BitInputStream *bis, size_t bits) {
+    WriteResult result = { BS_FAIL };
+    size_t n;
+
+    if (bis->_M_order != bos->_M_order)
+        return result;
+    if (!bos->_M_sink && BitOutputStreamReserve(bos, bits) != 0)
+        return result;
+    result._M_status = BS_SUCCESS;
+    while (bits > 0) {
+        n = bis->_M_size - bis->_M_position;
+        if (n == 0) {
+            if (!BitInputStreamFill(bis, 1)) {
+                BS_STAT_INC(eos);
+                result._M_status = BS_EOS;
+                break;
+            }
+            continue;
+        }
+        if (n > bits)
+            n = bits;
+        BS_STAT_ADD(bits_read, n);
+        result = BitOutputStreamWriteBits(bos, bis->_M_bytes, bis->_M_position, n);
+        if (!BS_SUCCEEDED(result))
+            break;
+        bis->_M_position += n;
+        bis->_M_cache_bits = 0;
+        bits -= n;
+    }
+    return result;
+}
+
+WriteResult BitOutputStreamWriteChar8(BitOutputStream *bos, size_t nbytes, char const *char8String) {
+    return BitOutputStreamWriteBits(bos, char8String, 0, nbytes << 3);
+}
+
+WriteResult BitOutputStreamWriteUtf8(BitOutputStream *bos, size_t nbytes, char const *utf8String) {
+    return BitOutputStreamWriteChar8(bos, nbytes, utf8String);
+}
+
+/**
+ * As BitOutputStreamWriteUtf8, every block is checked right before it is
+ * written, while still in cache. A string which is not valid UTF-8 is
+ * BS_FAIL and the cursor goes back to where the string started, so that
+ * nothing of it is written. Sink backed streams may have handed earlier
+ * blocks over already, they check the whole string up front instead.
+ */
+WriteResult BitOutputStreamWriteUtf8Checked(BitOutputStream *bos, size_t nbytes, char const *utf8String) {
+    WriteResult result = { BS_FAIL };
+    uint8_t const *p = (uint8_t const*) utf8String;
+    size_t start = BitOutputStreamGetBitSize(bos);
+    size_t checked = 0;
+    size_t n;
+    int rc;
+
+    if (bos->_M_sink) {
+        if (!BitStreamIsValidUtf8(utf8String, nbytes))
+            return result;
+        return BitOutputStreamWriteChar8(bos, nbytes, utf8String);
+    }
+    result._M_status = BS_SUCCESS;
+    while (checked < nbytes) {
+        n = nbytes - checked < BS_UTF8_BLOCK ? nbytes - checked : BS_UTF8_BLOCK;
+        rc = BitStreamCheckUtf8(p + checked, n, &n);
+        /* a character cut by the end of the block is checked with the next one. */
+        if (rc == BS_UTF8_INVALID || (rc == BS_UTF8_TRUNCATED && checked + BS_UTF8_BLOCK >= nbytes)) {
+            result._M_status = BS_FAIL;
+            break;
+        }
+        result = BitOutputStreamWriteBits(bos, p + checked, 0, n << 3);
+        if (!BS_SUCCEEDED(result))
+            break;
+        checked += n;
+    }
+    if (!BS_SUCCEEDED(result))
+        BitOutputStreamSeekBits(bos, (long) start, SEEK_SET);
+    return result;
+}
+
+/**
+ * Copies up to `n` whole bytes available in memory after the cursor,
+ * returns how many.
+ */
+static size_t BitInputStreamCopyBytes(BitInputStream *bis, uint8_t *out, size_t n) {
+    size_t avail = (bis->_M_size - bis->_M_position) >> 3;
+    uint8_t const *src = bis->_M_bytes + (bis->_M_position >> 3);
+    unsigned s = (unsigned) (bis->_M_position & 0x7);
+
+    if (avail > n)
+        avail = n;
+    if (avail == 0)
+        return 0;
+    if (s == 0)
+        memcpy(out, src, avail);
+    else
+        BitStreamFunnelBytes(out, src, avail, s, bis->_M_order);
+    bis->_M_position += avail << 3;
+    bis->_M_cache_bits = 0;
+    BS_STAT_ADD(bits_read, avail << 3);
+    return avail;
+}
+
+/**
+ * Reads `nbytes` bytes, the value of the result is how many were read.
+ * Short of bytes, those available are read and the result is BS_EOS.
+ */
+ReadResult BitInputStreamReadChar8(BitInputStream *bis, size_t nbytes, char *char8String) {
+    ReadResult result;
+    size_t done = 0;
+    size_t n;
+
+    result._M_status = BS_SUCCESS;
+    BS_STAT_INC(bulk_calls);
+    while (done < nbytes) {
+        n = BitInputStreamCopyBytes(bis, (uint8_t*) char8String + done, nbytes - done);
+        if (n == 0 && !BitInputStreamFill(bis, 8)) {
+            BS_STAT_INC(eos);
+            result._M_status = BS_EOS;
+            break;
+        }
+        done += n;
+    }
+    result._M_value.uint = done;
+    return result;
+}
+
+ReadResult BitInputStreamReadUtf8(BitInputStream *bis, size_t nbytes, char *utf8String) {
+    return BitInputStreamReadChar8(bis, nbytes, utf8String);
+}
+
+/**
+ * As BitInputStreamReadUtf8, every block is checked right after it was
+ * read. A string which is not valid UTF-8 is BS_FAIL, its bytes up to the
+ * failing block have been read.
+ */
+ReadResult BitInputStreamReadUtf8Checked(BitInputStream *bis, size_t nbytes, char *utf8String) {
+    ReadResult result;
+    size_t done = 0;
+    size_t checked = 0;
+    size_t n;
+
+    result._M_status = BS_SUCCESS;
+    while (done < nbytes) {
+        n = nbytes - done < BS_UTF8_BLOCK ? nbytes - done : BS_UTF8_BLOCK;
+        result = BitInputStreamReadChar8(bis, n, utf8String + done);
+        done += (size_t) result._M_value.uint;
+        if (!BS_SUCCEEDED(result))
+            break;
+        /* a character cut by the end of the block is checked with the next one. */
+        if (BitStreamCheckUtf8((uint8_t const*) utf8String + checked, done - checked, &n) == BS_UTF8_INVALID) {
+            result._M_status = BS_FAIL;
+            break;
+        }
+        checked += n;
+    }
+    if (BS_SUCCEEDED(result) && checked != nbytes)
+        result._M_status = BS_FAIL;
+    result._M_value.uint = done;
+    return result;
+}
+
+/**
+ * Points `*view` at the next `nbytes` bytes in the buffer of the stream
+ * instead of copying them, the cursor has to be on a byte boundary, BS_FAIL
+ * otherwise. The view of a source backed stream is limited to its window
+ * and lasts until the next read, BS_EOS when the bytes cannot all be in
+ * the window.
+ */
+ReadResult BitInputStreamReadBytesView(BitInputStream *bis, size_t nbytes, void const **view) {
+    ReadResult result;
+
+    result._M_status = BS_SUCCESS;
+    result._M_value.uint = 0;
+    if (bis->_M_position & 0x7) {
+        result._M_status = BS_FAIL;
+        return result;
+    }
+    BS_STAT_INC(bulk_calls);
+    if (nbytes > (bis->_M_size - bis->_M_position) >> 3 && !BitInputStreamFill(bis, nbytes << 3)) {
+        BS_STAT_INC(eos);
+        result._M_status = BS_EOS;
+        return result;
+    }
+    BS_STAT_ADD(bits_read, nbytes << 3);
+    *view = bis->_M_bytes + (bis->_M_position >> 3);
+    bis->_M_position += nbytes << 3;
+    bis->_M_cache_bits = 0;
+    result._M_value.uint = nbytes;
+    return result;
+}
+
+/**
+ * Checks `n` bytes of UTF-8 as Unicode defines it: shortest forms only, no
+ * surrogates, nothing past U+10FFFF. Runs of ASCII go 16 bytes at a time.
+ * `*done` is the length of the complete characters checked, a character
+ * cut by the end of the bytes is BS_UTF8_TRUNCATED.
+ */
+int BitStreamCheckUtf8(uint8_t const *p, size_t n, size_t *done) {
+    size_t i = 0;
+    size_t len;
+    size_t k;
+    unsigned c;
+    unsigned lo;
+    unsigned hi;
+
+    while (i < n) {
+#if defined(__SSE2__)
+        if (n - i >= 16 && !_mm_movemask_epi8(_mm_loadu_si128((__m128i const*) (p + i)))) {
+            i += 16;
+            continue;
+        }
+#endif
+        c = p[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+        if (c < 0xc2 || c > 0xf4)
+            break;
+        len = c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+        lo = c == 0xe0 ? 0xa0 : c == 0xf0 ? 0x90 : 0x80;
+        hi = c == 0xed ? 0x9f : c == 0xf4 ? 0x8f : 0xbf;
+        for (k = 1; k < len; ++k) {
+            if (i + k == n) {
+                *done = i;
+                return BS_UTF8_TRUNCATED;
+            }
+            if (p[i + k] < lo || p[i + k] > hi)
+                break;
+            lo = 0x80;
+            hi = 0xbf;
+        }
+        if (k < len)
+            break;
+        i += len;
+    }
+    *done = i;
+    return i == n ? BS_UTF8_VALID : BS_UTF8_INVALID;
+}
+
+int BitStreamIsValidUtf8(void const *bytes, size_t n) {
+    size_t done;
+    return BitStreamCheckUtf8((uint8_t const*) bytes, n, &done) == BS_UTF8_VALID;
+}
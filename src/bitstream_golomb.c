@@ -0,0 +1,240 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/**
+ * Exp-Golomb and Golomb-Rice codes.
+ *
+ * Both start with a unary prefix of zeros terminated by a one. The prefix
+ * is counted with one count-leading-zeros on the cached window, the bit
+ * by bit path only runs when the codeword crosses the end of the window.
+ * A read which fails leaves the stream where it was, unless a Rice prefix
+ * longer than the window of a reader backed stream already slid out of
+ * it. The codes are MSB first, LSB first streams fail them.
+ */
+
+/**
+ * Counts the zeros from the cursor up to the next one without consuming
+ * them, at most `limit` of them, BS_FAIL beyond.
+ */
+static BSStatus BitInputStreamPeekZeros(BitInputStream *bis, size_t limit, size_t *zeros) {
+    size_t scanned = 0;
+    size_t offset;
+    size_t avail;
+    size_t n;
+    uint64_t window;
+
+    for (;;) {
+        if (!BitInputStreamFill(bis, scanned + 1))
+            return BS_EOS;
+        offset = bis->_M_position + scanned;
+        window = BitStreamLoadWindow(bis->_M_bytes, (bis->_M_size + 7) >> 3, offset >> 3) << (offset & 0x7);
+        avail = 64 - (offset & 0x7);
+        if (avail > bis->_M_size - offset)
+            avail = bis->_M_size - offset;
+        n = BitStreamCountLeadingZeros64(window);
+        if (n < avail) {
+            scanned += n;
+            break;
+        }
+        scanned += avail;
+        if (scanned > limit)
+            return BS_FAIL;
+    }
+    if (scanned > limit)
+        return BS_FAIL;
+    *zeros = scanned;
+    return BS_SUCCESS;
+}
+
+/* skips bits known to be available, dropping the cached window. */
+static void BitInputStreamAdvance(BitInputStream *bis, size_t bits) {
+    bis->_M_position += bits;
+    bis->_M_cache_bits = 0;
+}
+
+static ReadResult BitInputStreamReadExpGolombSlow(BitInputStream *bis, size_t k) {
+    ReadResult result;
+    size_t zeros = 0;
+
+    result._M_value.uint = 0;
+    result._M_status = BitInputStreamPeekZeros(bis, 63 - k, &zeros);
+    if (result._M_status != BS_SUCCESS)
+        return result;
+    if (!BitInputStreamFill(bis, zeros + zeros + k + 1)) {
+        result._M_status = BS_EOS;
+        return result;
+    }
+    BitInputStreamAdvance(bis, zeros);
+    result = BitInputStreamReadUInt(bis, zeros + k + 1);
+    result._M_value.uint -= (uint64_t) 1 << k;
+    return result;
+}
+
+ReadResult BitInputStreamReadExpGolomb(BitInputStream *bis, size_t k) {
+    ReadResult result;
+    size_t zeros;
+    size_t n;
+
+    if (k > 63 || bis->_M_order == BS_LSB_FIRST) {
+        result._M_status = BS_FAIL;
+        result._M_value.uint = 0;
+        return result;
+    }
+    /* the codeword is the value plus 2^k, behind as many zeros as it has bits beyond k + 1. */
+    zeros = BitStreamCountLeadingZeros64(bis->_M_cache);
+    n = zeros + zeros + k + 1;
+    if (BS_UNLIKELY(n > bis->_M_cache_bits)) {
+        if (bis->_M_position + 64 > bis->_M_size)
+            return BitInputStreamReadExpGolombSlow(bis, k);
+        BitInputStreamRefill(bis);
+        zeros = BitStreamCountLeadingZeros64(bis->_M_cache);
+        n = zeros + zeros + k + 1;
+        if (n > bis->_M_cache_bits)
+            return BitInputStreamReadExpGolombSlow(bis, k);
+    }
+    result._M_status = BS_SUCCESS;
+    result._M_value.uint = BitInputStreamTake(bis, n) - ((uint64_t) 1 << k);
+    return result;
+}
+
+ReadResult BitInputStreamReadUE(BitInputStream *bis) {
+    return BitInputStreamReadExpGolomb(bis, 0);
+}
+
+/* 0, 1, -1, 2, -2, ... */
+ReadResult BitInputStreamReadSE(BitInputStream *bis) {
+    ReadResult result = BitInputStreamReadExpGolomb(bis, 0);
+    uint64_t v = result._M_value.uint;
+
+    if (BS_SUCCEEDED(result))
+        result._M_value.sint = (v & 0x1) ? (int64_t) ((v >> 1) + 1) : -(int64_t) (v >> 1);
+    return result;
+}
+
+/* back to an absolute bit position after a failed read, if still in the window. */
+static void BitInputStreamRewind(BitInputStream *bis, size_t origin) {
+    if (origin >= bis->_M_base)
+        bis->_M_position = origin - bis->_M_base;
+    bis->_M_cache_bits = 0;
+}
+
+/**
+ * The prefix of a Rice code has no bound, its zeros are consumed as they
+ * are counted so that a reader backed stream can slide its window over
+ * any number of them.
+ */
+static ReadResult BitInputStreamReadRiceSlow(BitInputStream *bis, size_t k) {
+    ReadResult result;
+    size_t origin = bis->_M_base + bis->_M_position;
+    size_t quotient = 0;
+    size_t offset;
+    size_t avail;
+    size_t n;
+    uint64_t window;
+
+    result._M_value.uint = 0;
+    for (;;) {
+        if (!BitInputStreamFill(bis, 1)) {
+            result._M_status = BS_EOS;
+            BitInputStreamRewind(bis, origin);
+            return result;
+        }
+        offset = bis->_M_position;
+        window = BitStreamLoadWindow(bis->_M_bytes, (bis->_M_size + 7) >> 3, offset >> 3) << (offset & 0x7);
+        avail = 64 - (offset & 0x7);
+        if (avail > bis->_M_size - offset)
+            avail = bis->_M_size - offset;
+        n = BitStreamCountLeadingZeros64(window);
+        if (n > avail)
+            n = avail;
+        quotient += n;
+        BitInputStreamAdvance(bis, n);
+        if (n < avail)
+            break;
+    }
+    if ((uint64_t) quotient > (~(uint64_t) 0 >> k)) {
+        result._M_status = BS_FAIL;
+        BitInputStreamRewind(bis, origin);
+        return result;
+    }
+    if (!BitInputStreamFill(bis, 1 + k)) {
+        result._M_status = BS_EOS;
+        BitInputStreamRewind(bis, origin);
+        return result;
+    }
+    BitInputStreamAdvance(bis, 1);
+    result._M_status = BS_SUCCESS;
+    if (k > 0)
+        result = BitInputStreamReadUInt(bis, k);
+    result._M_value.uint |= (uint64_t) quotient << k;
+    return result;
+}
+
+ReadResult BitInputStreamReadRice(BitInputStream *bis, size_t k) {
+    ReadResult result;
+    size_t quotient;
+    uint64_t value;
+
+    if (k > 63 || bis->_M_order == BS_LSB_FIRST) {
+        result._M_status = BS_FAIL;
+        result._M_value.uint = 0;
+        return result;
+    }
+    quotient = BitStreamCountLeadingZeros64(bis->_M_cache);
+    if (BS_UNLIKELY(quotient + 1 + k > bis->_M_cache_bits)) {
+        if (bis->_M_position + 64 > bis->_M_size)
+            return BitInputStreamReadRiceSlow(bis, k);
+        BitInputStreamRefill(bis);
+        quotient = BitStreamCountLeadingZeros64(bis->_M_cache);
+        if (quotient + 1 + k > bis->_M_cache_bits)
+            return BitInputStreamReadRiceSlow(bis, k);
+    }
+    /* the terminating one stays in front of the remainder, masked out below. */
+    value = BitInputStreamTake(bis, quotient + 1 + k) & (((uint64_t) 1 << k) - 1);
+    result._M_status = BS_SUCCESS;
+    result._M_value.uint = ((uint64_t) quotient << k) | value;
+    return result;
+}
+
+WriteResult BitOutputStreamWriteExpGolomb(BitOutputStream *bos, size_t k, uint64_t value) {
+    WriteResult result = { BS_FAIL };
+    uint64_t codeword;
+    size_t bits;
+
+    if (k > 63 || value > ~(uint64_t) 0 - ((uint64_t) 1 << k) || bos->_M_order == BS_LSB_FIRST)
+        return result;
+    codeword = value + ((uint64_t) 1 << k);
+    bits = 64 - BitStreamCountLeadingZeros64(codeword);
+    /* wider than 64 bits the field is zero extended, which writes the prefix. */
+    return BitOutputStreamWriteUInt(bos, bits + bits - k - 1, codeword);
+}
+
+WriteResult BitOutputStreamWriteUE(BitOutputStream *bos, uint64_t value) {
+    return BitOutputStreamWriteExpGolomb(bos, 0, value);
+}
+
+WriteResult BitOutputStreamWriteSE(BitOutputStream *bos, int64_t value) {
+    WriteResult result = { BS_FAIL };
+
+    if (value > 0)
+        return BitOutputStreamWriteExpGolomb(bos, 0, ((uint64_t) value << 1) - 1);
+    if (value == INT64_MIN)
+        return result;
+    return BitOutputStreamWriteExpGolomb(bos, 0, (uint64_t) -value << 1);
+}
+
+WriteResult BitOutputStreamWriteRice(BitOutputStream *bos, size_t k, uint64_t value) {
+    WriteResult result = { BS_FAIL };
+    uint64_t quotient;
+
+    if (k > 63 || bos->_M_order == BS_LSB_FIRST)
+        return result;
+    quotient = value >> k;
+    if (quotient > (uint64_t) ((size_t) -1 - 64 - k))
+        return result;
+    return BitOutputStreamWriteUInt(bos, (size_t) quotient + 1 + k,
+            ((uint64_t) 1 << k) | (value & (((uint64_t) 1 << k) - 1)));
+}
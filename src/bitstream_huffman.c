@@ -0,0 +1,275 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Canonical prefix codes.
+ *
+ * Codes are assigned from the code lengths alone, shorter codes first and
+ * symbols of the same length in increasing order, as DEFLATE does. The
+ * decoder looks up the leading `_M_primary_bits` bits of the cached window
+ * in one table. Longer codes continue in a subtable per primary entry,
+ * sized for the longest code under that prefix, so that every symbol
+ * takes at most two lookups.
+ *
+ * A table entry holds the symbol above the low byte and the code length
+ * in the low bits. Entries with BS_HUFFMAN_LINK set hold the offset of a
+ * subtable instead, with its index width in the low bits. Zero entries
+ * belong to no code.
+ *
+ * Codes go MSB first, LSB first streams fail them.
+ */
+
+#define BS_HUFFMAN_MAX_BITS 24
+#define BS_HUFFMAN_DEFAULT_PRIMARY_BITS 10
+#define BS_HUFFMAN_MAX_SYMBOLS ((size_t) 1 << 24)
+#define BS_HUFFMAN_LINK 0x80
+#define BS_HUFFMAN_LENGTH_MASK 0x3f
+
+struct tagBSHuffman {
+    uint32_t *_M_table;
+    uint32_t *_M_codes;
+    uint8_t *_M_lengths;
+    size_t _M_symbols;
+    size_t _M_primary_bits;
+    size_t _M_max_bits;
+};
+
+static void BitStreamHuffmanFill(uint32_t *table, size_t n, uint32_t entry) {
+    size_t i;
+    for (i = 0; i < n; ++i)
+        table[i] = entry;
+}
+
+BSHuffman* BitStreamHuffmanCreate(uint8_t const *lengths, size_t nsymbols, size_t primaryBits) {
+    BSHuffman *huffman = NULL;
+    size_t count[BS_HUFFMAN_MAX_BITS + 1];
+    uint32_t next[BS_HUFFMAN_MAX_BITS + 1];
+    size_t *subBits = NULL;
+    size_t *subOffset = NULL;
+    size_t maxBits = 0;
+    size_t primary;
+    size_t entries;
+    size_t i, len, prefix, sub;
+    int64_t left = 1;
+    uint32_t code = 0;
+
+    if (!lengths || nsymbols == 0 || nsymbols > BS_HUFFMAN_MAX_SYMBOLS)
+        return NULL;
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < nsymbols; ++i) {
+        if (lengths[i] > BS_HUFFMAN_MAX_BITS)
+            return NULL;
+        ++count[lengths[i]];
+        if (lengths[i] > maxBits)
+            maxBits = lengths[i];
+    }
+    if (maxBits == 0)
+        return NULL;
+    /* an oversubscribed set of lengths is no prefix code, an incomplete one is. */
+    for (len = 1; len <= maxBits; ++len) {
+        left = (left << 1) - (int64_t) count[len];
+        if (left < 0)
+            return NULL;
+    }
+    count[0] = 0;
+    for (len = 1; len <= maxBits; ++len) {
+        code = (code + (uint32_t) count[len - 1]) << 1;
+        next[len] = code;
+    }
+
+    if (primaryBits == 0)
+        primaryBits = BS_HUFFMAN_DEFAULT_PRIMARY_BITS;
+    primary = primaryBits < maxBits ? primaryBits : maxBits;
+
+    if (!(huffman = (BSHuffman*) calloc(1, sizeof(BSHuffman))))
+        return NULL;
+    huffman->_M_symbols = nsymbols;
+    huffman->_M_primary_bits = primary;
+    huffman->_M_max_bits = maxBits;
+    if (!(huffman->_M_codes = (uint32_t*) malloc(nsymbols * sizeof(uint32_t)))
+            || !(huffman->_M_lengths = (uint8_t*) malloc(nsymbols))
+            || !(subBits = (size_t*) calloc((size_t) 1 << primary, sizeof(size_t)))
+            || !(subOffset = (size_t*) calloc((size_t) 1 << primary, sizeof(size_t))))
+        goto failure;
+    memcpy(huffman->_M_lengths, lengths, nsymbols);
+    for (i = 0; i < nsymbols; ++i) {
+        len = lengths[i];
+        huffman->_M_codes[i] = len ? next[len]++ : 0;
+        if (len > primary) {
+            prefix = huffman->_M_codes[i] >> (len - primary);
+            if (len - primary > subBits[prefix])
+                subBits[prefix] = len - primary;
+        }
+    }
+
+    /* subtables follow the primary table. */
+    entries = (size_t) 1 << primary;
+    for (prefix = 0; prefix < ((size_t) 1 << primary); ++prefix) {
+        if (subBits[prefix]) {
+            subOffset[prefix] = entries;
+            entries += (size_t) 1 << subBits[prefix];
+        }
+    }
+    /* offsets have to fit above the low byte of an entry. */
+    if (entries > ((size_t) 1 << 24))
+        goto failure;
+    if (!(huffman->_M_table = (uint32_t*) calloc(entries, sizeof(uint32_t))))
+        goto failure;
+    for (prefix = 0; prefix < ((size_t) 1 << primary); ++prefix) {
+        if (subBits[prefix])
+            huffman->_M_table[prefix] = (uint32_t) (subOffset[prefix] << 8) | BS_HUFFMAN_LINK
+                | (uint32_t) subBits[prefix];
+    }
+    for (i = 0; i < nsymbols; ++i) {
+        len = lengths[i];
+        code = huffman->_M_codes[i];
+        if (len == 0)
+            continue;
+        if (len <= primary) {
+            BitStreamHuffmanFill(huffman->_M_table + ((size_t) code << (primary - len)),
+                    (size_t) 1 << (primary - len), (uint32_t) (i << 8) | (uint32_t) len);
+            continue;
+        }
+        prefix = code >> (len - primary);
+        sub = subBits[prefix];
+        code &= ((uint32_t) 1 << (len - primary)) - 1;
+        BitStreamHuffmanFill(huffman->_M_table + subOffset[prefix] + ((size_t) code << (sub - (len - primary))),
+                (size_t) 1 << (sub - (len - primary)), (uint32_t) (i << 8) | (uint32_t) len);
+    }
+    free(subBits);
+    free(subOffset);
+    return huffman;
+failure:
+    free(subBits);
+    free(subOffset);
+    BitStreamHuffmanDestroy(huffman);
+    return NULL;
+}
+
+void BitStreamHuffmanDestroy(BSHuffman *huffman) {
+    if (!huffman)
+        return;
+    free(huffman->_M_table);
+    free(huffman->_M_codes);
+    free(huffman->_M_lengths);
+    free(huffman);
+}
+
+size_t BitStreamHuffmanGetMaxBits(BSHuffman const *huffman) {
+    return huffman->_M_max_bits;
+}
+
+/* the entry of the code at the front of `window`. */
+BS_INLINE uint32_t BitStreamHuffmanLookup(BSHuffman const *huffman, uint64_t window) {
+    size_t primary = huffman->_M_primary_bits;
+    uint32_t entry = huffman->_M_table[window >> (64 - primary)];
+
+    if (entry & BS_HUFFMAN_LINK)
+        entry = huffman->_M_table[(entry >> 8) + ((window << primary) >> (64 - (entry & BS_HUFFMAN_LENGTH_MASK)))];
+    return entry;
+}
+
+/**
+ * Decodes one symbol, the window holds the longest code unless the stream
+ * ends before. Near the end a code which does not fit is EOS, past the
+ * longest code an unassigned one is FAIL.
+ */
+BS_INLINE BSStatus BitInputStreamDecodeHuffman(BitInputStream *bis, BSHuffman const *huffman,
+        uint32_t *symbol) {
+    uint64_t window;
+    uint32_t entry;
+    size_t len;
+
+    if (BS_UNLIKELY(bis->_M_cache_bits < huffman->_M_max_bits)) {
+        if (bis->_M_position + huffman->_M_max_bits > bis->_M_size)
+            BitInputStreamFill(bis, huffman->_M_max_bits);
+        if (bis->_M_position >= bis->_M_size)
+            return BS_EOS;
+        BitInputStreamRefill(bis);
+    }
+    window = bis->_M_cache;
+    if (BS_UNLIKELY(bis->_M_cache_bits < 64))
+        window &= ~(~(uint64_t) 0 >> bis->_M_cache_bits);
+    entry = BitStreamHuffmanLookup(huffman, window);
+    len = entry & BS_HUFFMAN_LENGTH_MASK;
+    if (BS_UNLIKELY(len == 0 || len > bis->_M_cache_bits))
+        return bis->_M_cache_bits < huffman->_M_max_bits ? BS_EOS : BS_FAIL;
+    BitInputStreamTake(bis, len);
+    *symbol = entry >> 8;
+    return BS_SUCCESS;
+}
+
+ReadResult BitInputStreamReadHuffman(BitInputStream *bis, BSHuffman const *huffman) {
+    ReadResult result;
+    uint32_t symbol = 0;
+
+    result._M_status = bis->_M_order == BS_LSB_FIRST ? BS_FAIL
+        : BitInputStreamDecodeHuffman(bis, huffman, &symbol);
+    result._M_value.uint = symbol;
+    return result;
+}
+
+/**
+ * Decodes up to `count` symbols, stops at the first one which fails and
+ * reports how many were decoded. Away from the end of the window, every
+ * refill serves as many symbols as it holds longest codes, with the window
+ * kept in locals.
+ */
+ReadResult BitInputStreamReadHuffmanArray(BitInputStream *bis, BSHuffman const *huffman, size_t count,
+        uint32_t *symbols) {
+    ReadResult result;
+    size_t maxBits = huffman->_M_max_bits;
+    size_t i = 0;
+    size_t avail;
+    size_t used;
+    size_t len;
+    uint64_t window;
+    uint32_t entry;
+
+    result._M_status = bis->_M_order == BS_LSB_FIRST ? BS_FAIL : BS_SUCCESS;
+    while (i < count && result._M_status == BS_SUCCESS) {
+        if (bis->_M_cache_bits < maxBits) {
+            if (bis->_M_position + 64 > bis->_M_size) {
+                /* near the end of the window, one symbol at a time. */
+                result._M_status = BitInputStreamDecodeHuffman(bis, huffman, symbols + i);
+                if (result._M_status != BS_SUCCESS)
+                    break;
+                ++i;
+                continue;
+            }
+            BitInputStreamRefill(bis);
+        }
+        window = bis->_M_cache;
+        avail = bis->_M_cache_bits;
+        used = 0;
+        while (avail - used >= maxBits && i < count) {
+            entry = BitStreamHuffmanLookup(huffman, window);
+            len = entry & BS_HUFFMAN_LENGTH_MASK;
+            if (BS_UNLIKELY(len == 0)) {
+                result._M_status = BS_FAIL;
+                break;
+            }
+            window <<= len;
+            used += len;
+            symbols[i++] = entry >> 8;
+        }
+        if (used > 0)
+            BitInputStreamTake(bis, used);
+        if (result._M_status != BS_SUCCESS)
+            break;
+    }
+    result._M_value.uint = i;
+    return result;
+}
+
+WriteResult BitOutputStreamWriteHuffman(BitOutputStream *bos, BSHuffman const *huffman, size_t symbol) {
+    WriteResult result = { BS_FAIL };
+
+    if (symbol >= huffman->_M_symbols || huffman->_M_lengths[symbol] == 0 || bos->_M_order == BS_LSB_FIRST)
+        return result;
+    return BitOutputStreamWriteUInt(bos, huffman->_M_lengths[symbol], huffman->_M_codes[symbol]);
+}
@@ -0,0 +1,129 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Seek indexes.
+ *
+ * An index is a table of increasing bit offsets, each of them the start of
+ * a segment which decodes on its own. It is either recorded by the writer
+ * at every segment it starts, or rebuilt from a stream which puts a byte
+ * aligned sync marker in front of every segment. The bits before the first
+ * offset belong to no segment.
+ */
+
+#define BS_INDEX_INITIAL_CAPACITY 64
+
+struct tagBSIndex {
+    uint64_t *_M_offsets;
+    size_t _M_count;
+    size_t _M_capacity;
+};
+
+BSIndex* BitStreamIndexCreate(void) {
+    return (BSIndex*) calloc(1, sizeof(BSIndex));
+}
+
+void BitStreamIndexDestroy(BSIndex *index) {
+    if (!index)
+        return;
+    free(index->_M_offsets);
+    free(index);
+}
+
+void BitStreamIndexClear(BSIndex *index) {
+    index->_M_count = 0;
+}
+
+/* 0 on success, -1 when out of memory or before the last offset. */
+int BitStreamIndexAdd(BSIndex *index, uint64_t offset) {
+    size_t capacity;
+    uint64_t *offsets;
+
+    if (index->_M_count > 0 && offset < index->_M_offsets[index->_M_count - 1])
+        return -1;
+    if (index->_M_count == index->_M_capacity) {
+        capacity = index->_M_capacity ? index->_M_capacity << 1 : BS_INDEX_INITIAL_CAPACITY;
+        if (capacity < index->_M_capacity)
+            return -1;
+        offsets = (uint64_t*) realloc(index->_M_offsets, capacity * sizeof(uint64_t));
+        if (!offsets)
+            return -1;
+        index->_M_offsets = offsets;
+        index->_M_capacity = capacity;
+    }
+    index->_M_offsets[index->_M_count++] = offset;
+    return 0;
+}
+
+size_t BitStreamIndexGetCount(BSIndex const *index) {
+    return index->_M_count;
+}
+
+uint64_t BitStreamIndexGet(BSIndex const *index, size_t i) {
+    return index->_M_offsets[i];
+}
+
+/**
+ * Number of the segment holding the bit at `offset`, the last one with a
+ * start not after it. The count when the offset is before the first one.
+ */
+size_t BitStreamIndexFind(BSIndex const *index, uint64_t offset) {
+    size_t lo = 0;
+    size_t hi = index->_M_count;
+    size_t mid;
+
+    while (lo < hi) {
+        mid = lo + ((hi - lo) >> 1);
+        if (index->_M_offsets[mid] <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo ? lo - 1 : index->_M_count;
+}
+
+/* records the cursor of the writer as the start of a segment. */
+int BitOutputStreamAddSyncPoint(BitOutputStream *bos, BSIndex *index) {
+    return BitStreamIndexAdd(index, BitOutputStreamGetBitSize(bos));
+}
+
+/**
+ * Appends the offset of every byte aligned occurrence of the `markerBits`
+ * wide marker, 8..64 bits in whole bytes, its first byte in the most
+ * significant bits. Occurrences do not overlap. Candidates come from
+ * memchr on the first byte of the marker, the rest of it is compared
+ * after. Returns the number of offsets appended, -1 on failure.
+ */
+long BitStreamIndexScan(BSIndex *index, void const *buffer, size_t bits, uint64_t marker, size_t markerBits) {
+    uint8_t const *bytes = (uint8_t const*) buffer;
+    uint8_t const *p = bytes;
+    uint8_t const *end;
+    uint8_t pattern[8];
+    size_t nbytes = bits >> 3;
+    size_t width = markerBits >> 3;
+    long found = 0;
+    size_t i;
+
+    if (markerBits == 0 || markerBits > 64 || (markerBits & 0x7))
+        return -1;
+    for (i = 0; i < width; ++i)
+        pattern[i] = (uint8_t) (marker >> ((width - 1 - i) << 3));
+    if (nbytes < width)
+        return 0;
+    end = bytes + nbytes - width + 1;
+    while (p < end && (p = (uint8_t const*) memchr(p, pattern[0], (size_t) (end - p))) != NULL) {
+        if (memcmp(p + 1, pattern + 1, width - 1) != 0) {
+            ++p;
+            continue;
+        }
+        if (BitStreamIndexAdd(index, (uint64_t) (p - bytes) << 3) != 0)
+            return -1;
+        ++found;
+        p += width;
+    }
+    return found;
+}
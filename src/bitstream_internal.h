@@ -0,0 +1,390 @@
+#ifndef BITSTREAM_BITSTREAM_INTERNAL_H_INCLUDED
+#define BITSTREAM_BITSTREAM_INTERNAL_H_INCLUDED
+
+/**
+ * Helpers shared by the translation units of the library, not installed.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bitstream.h"
+
+#if defined(__GNUC__)
+#define BS_INLINE static __inline__ __attribute__((always_inline))
+#define BS_LIKELY(X) __builtin_expect(!!(X), 1)
+#define BS_UNLIKELY(X) __builtin_expect(!!(X), 0)
+#else
+#define BS_INLINE static
+#define BS_LIKELY(X) (X)
+#define BS_UNLIKELY(X) (X)
+#endif
+
+/**
+ * x86 SIMD kernels are compiled with per function target attributes and
+ * picked at runtime, the rest of the library stays baseline.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BS_HAVE_X86_DISPATCH 1
+#define BS_TARGET(ISA) __attribute__((target(ISA)))
+#else
+#define BS_HAVE_X86_DISPATCH 0
+#endif
+
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BS_LITTLE_ENDIAN_HOST 1
+#elif defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define BS_BIG_ENDIAN_HOST 1
+#endif
+
+/**
+ * Operation counters, compiled in with BS_ENABLE_STATS (configure
+ * --enable-stats) and to nothing otherwise. Each thread counts on its own
+ * so that no counter is shared between cores. `N` is not evaluated when
+ * the counters are compiled out.
+ */
+#if defined(BS_ENABLE_STATS)
+#if defined(__GNUC__)
+#define BS_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define BS_THREAD_LOCAL __declspec(thread)
+#else
+#define BS_THREAD_LOCAL _Thread_local
+#endif
+extern BS_THREAD_LOCAL BSStats BitStreamThreadStats;
+#define BS_STAT_ADD(FIELD, N) (BitStreamThreadStats._M_##FIELD += (uint64_t) (N))
+#else
+#define BS_STAT_ADD(FIELD, N) ((void) 0)
+#endif
+#define BS_STAT_INC(FIELD) BS_STAT_ADD(FIELD, 1)
+
+/**
+ * Widest field the cached window is guaranteed to serve after one refill,
+ * 64 bits minus the up to 7 bits skipped in the first byte.
+ */
+#define BS_WINDOW_BITS 57
+
+/**
+ * Loads 8 bytes as a big-endian word, the first byte ends up in the most
+ * significant bits.
+ */
+BS_INLINE uint64_t BitStreamLoadBE64(uint8_t const *p) {
+#if defined(BS_LITTLE_ENDIAN_HOST)
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return __builtin_bswap64(v);
+#elif defined(BS_BIG_ENDIAN_HOST)
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+#else
+    return ((uint64_t) p[0] << 56) | ((uint64_t) p[1] << 48)
+        | ((uint64_t) p[2] << 40) | ((uint64_t) p[3] << 32)
+        | ((uint64_t) p[4] << 24) | ((uint64_t) p[5] << 16)
+        | ((uint64_t) p[6] << 8) | (uint64_t) p[7];
+#endif
+}
+
+BS_INLINE void BitStreamStoreBE64(uint8_t *p, uint64_t v) {
+#if defined(BS_LITTLE_ENDIAN_HOST)
+    v = __builtin_bswap64(v);
+    memcpy(p, &v, sizeof(v));
+#elif defined(BS_BIG_ENDIAN_HOST)
+    memcpy(p, &v, sizeof(v));
+#else
+    int i;
+    for (i = 0; i < 8; ++i)
+        p[i] = (uint8_t) (v >> (56 - (i << 3)));
+#endif
+}
+
+/* 8 bytes as a little-endian word, the first byte in the least significant bits. */
+BS_INLINE uint64_t BitStreamLoadLE64(uint8_t const *p) {
+#if defined(BS_LITTLE_ENDIAN_HOST)
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+#elif defined(BS_BIG_ENDIAN_HOST)
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return __builtin_bswap64(v);
+#else
+    return ((uint64_t) p[7] << 56) | ((uint64_t) p[6] << 48)
+        | ((uint64_t) p[5] << 40) | ((uint64_t) p[4] << 32)
+        | ((uint64_t) p[3] << 24) | ((uint64_t) p[2] << 16)
+        | ((uint64_t) p[1] << 8) | (uint64_t) p[0];
+#endif
+}
+
+BS_INLINE void BitStreamStoreLE64(uint8_t *p, uint64_t v) {
+#if defined(BS_LITTLE_ENDIAN_HOST)
+    memcpy(p, &v, sizeof(v));
+#elif defined(BS_BIG_ENDIAN_HOST)
+    v = __builtin_bswap64(v);
+    memcpy(p, &v, sizeof(v));
+#else
+    int i;
+    for (i = 0; i < 8; ++i)
+        p[i] = (uint8_t) (v >> (i << 3));
+#endif
+}
+
+/**
+ * The 64 bits window starting at byte `bpos` of a `nbytes` long buffer,
+ * bytes beyond the end read as zero.
+ */
+BS_INLINE uint64_t BitStreamLoadWindow(uint8_t const *bytes, size_t nbytes, size_t bpos) {
+    uint64_t window = 0;
+    int shift = 56;
+
+    if (BS_LIKELY(bpos + 8 <= nbytes))
+        return BitStreamLoadBE64(bytes + bpos);
+    /* near the end of buffer, never touch memory out of it. */
+    while (bpos < nbytes) {
+        window |= (uint64_t) bytes[bpos++] << shift;
+        shift -= 8;
+    }
+    return window;
+}
+
+/* as BitStreamLoadWindow, little-endian. */
+BS_INLINE uint64_t BitStreamLoadWindowLE(uint8_t const *bytes, size_t nbytes, size_t bpos) {
+    uint64_t window = 0;
+    int shift = 0;
+
+    if (BS_LIKELY(bpos + 8 <= nbytes))
+        return BitStreamLoadLE64(bytes + bpos);
+    while (bpos < nbytes) {
+        window |= (uint64_t) bytes[bpos++] << shift;
+        shift += 8;
+    }
+    return window;
+}
+
+/**
+ * One LSB first field of 1..64 bits at bit position `pos`, its first bit
+ * ends up in the least significant bit.
+ */
+BS_INLINE uint64_t BitStreamExtractLsb(uint8_t const *bytes, size_t nbytes, size_t pos, size_t bits) {
+    uint64_t value = BitStreamLoadWindowLE(bytes, nbytes, pos >> 3) >> (pos & 0x7);
+
+    if (bits > BS_WINDOW_BITS) {
+        pos += 32;
+        value = (value & 0xffffffff) | ((BitStreamLoadWindowLE(bytes, nbytes, pos >> 3) >> (pos & 0x7)) << 32);
+    }
+    return bits < 64 ? value & (((uint64_t) 1 << bits) - 1) : value;
+}
+
+/* number of leading zero bits, 64 for zero. */
+BS_INLINE size_t BitStreamCountLeadingZeros64(uint64_t v) {
+#if defined(__GNUC__)
+    return v ? (size_t) __builtin_clzll(v) : 64;
+#else
+    size_t n = 0;
+    if (!v)
+        return 64;
+    while (!(v & 0x8000000000000000ULL)) {
+        v <<= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+/* number of trailing zero bits, 64 for zero. */
+BS_INLINE size_t BitStreamCountTrailingZeros64(uint64_t v) {
+#if defined(__GNUC__)
+    return v ? (size_t) __builtin_ctzll(v) : 64;
+#else
+    size_t n = 0;
+    if (!v)
+        return 64;
+    while (!(v & 0x1)) {
+        v >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+/* number of set bits, a single instruction when the build targets POPCNT. */
+BS_INLINE size_t BitStreamPopCount64(uint64_t v) {
+#if defined(__GNUC__) && defined(__POPCNT__)
+    return (size_t) __builtin_popcountll(v);
+#else
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (size_t) ((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/**
+ * Reloads the cached window from the current position with one word load.
+ * At least 57 bits are cached afterwards unless the stream ends earlier.
+ */
+BS_INLINE void BitInputStreamRefill(BitInputStream *bis) {
+    size_t pos = bis->_M_position;
+    size_t remain = bis->_M_size - pos;
+
+    bis->_M_cache = BitStreamLoadWindow(bis->_M_bytes, (bis->_M_size + 7) >> 3, pos >> 3) << (pos & 0x7);
+    bis->_M_cache_bits = 64 - (pos & 0x7);
+    if (bis->_M_cache_bits > remain)
+        bis->_M_cache_bits = remain;
+}
+
+/**
+ * Takes 1..64 bits out of the cached window, caller guarantees there are
+ * enough of them.
+ */
+BS_INLINE uint64_t BitInputStreamTake(BitInputStream *bis, size_t bits) {
+    uint64_t value = bis->_M_cache >> (64 - bits);
+    bis->_M_cache = (bis->_M_cache << (bits - 1)) << 1;
+    bis->_M_cache_bits -= bits;
+    bis->_M_position += bits;
+    return value;
+}
+
+/**
+ * Backing of the input streams which do not own their whole data in
+ * memory. `_M_close` releases whatever `_M_context` holds. A source
+ * without `_M_read` only keeps its memory alive, like a file mapping.
+ */
+struct tagBSSource {
+    BSReadFunc _M_read;
+    void (*_M_close)(BSSource*);
+    void *_M_context;
+    uint8_t *_M_window;
+    size_t _M_capacity;
+    int _M_eof;
+};
+
+/* marked position of a stream which has no mark. */
+#define BS_NO_MARK ((size_t) -1)
+
+/* whether the stream refills its window from a reader. */
+BS_INLINE int BitInputStreamHasReader(BitInputStream const *bis) {
+    return bis->_M_source && bis->_M_source->_M_read;
+}
+
+extern BSSource* BitStreamSourceCreate(size_t);
+extern void BitStreamSourceDestroy(BSSource*);
+
+/**
+ * Refills the window until `bits` more bits are available after the
+ * cursor, returns 0 when the data ends before. Without a reader it only
+ * checks the bounds.
+ */
+extern int BitInputStreamFill(BitInputStream*, size_t);
+extern int BitInputStreamSeekSource(BitInputStream*, size_t);
+extern void BitInputStreamDrainSource(BitInputStream*);
+
+/**
+ * Consumer of the output streams which do not keep their whole data in
+ * memory. `_M_drain` makes room in the buffer of the stream for `bits`
+ * more bits after the cursor, returns non zero on failure.
+ */
+struct tagBSSink {
+    BSWriteFunc _M_write;
+    int (*_M_drain)(BitOutputStream*, size_t);
+    void (*_M_close)(BSSink*);
+    void *_M_context;
+    int _M_failed;
+};
+
+extern void BitStreamSinkDestroy(BSSink*);
+extern int BitOutputStreamDrainToWriter(BitOutputStream*, size_t);
+
+/**
+ * Makes room for `bits` more bits after the cursor by draining the buffer
+ * to the sink.
+ */
+extern int BitOutputStreamDrainSink(BitOutputStream*, size_t);
+
+/**
+ * Appends 1..64 bits to an accumulator of `*nbits` pending bits which
+ * starts at byte `*p`. A completed word is stored to memory as one big-endian
+ * store and `*p` moves past it. The caller has made sure that the buffer is
+ * large enough.
+ */
+BS_INLINE void BitStreamAccumulate(uint64_t *cache, size_t *nbits, uint8_t **p, size_t bits, uint64_t value) {
+    size_t room = 64 - *nbits;
+
+    if (bits < 64)
+        value &= ((uint64_t) 1 << bits) - 1;
+    if (bits < room) {
+        *cache |= value << (room - bits);
+        *nbits += bits;
+    } else {
+        *cache |= value >> (bits - room);
+        BitStreamStoreBE64(*p, *cache);
+        *p += 8;
+        bits -= room;
+        *cache = bits ? value << (64 - bits) : 0;
+        *nbits = bits;
+    }
+}
+
+/**
+ * Appends 1..64 bits to the accumulator of the stream, which always starts
+ * at a byte boundary.
+ */
+BS_INLINE void BitOutputStreamPut(BitOutputStream *bos, size_t bits, uint64_t value) {
+    uint8_t *p = bos->_M_bytes + ((bos->_M_position - bos->_M_cache_bits) >> 3);
+    BitStreamAccumulate(&bos->_M_cache, &bos->_M_cache_bits, &p, bits, value);
+    bos->_M_position += bits;
+}
+
+/**
+ * LSB first counterpart of BitStreamAccumulate, the pending bits fill the
+ * accumulator from its least significant bit and completed words are
+ * stored little-endian.
+ */
+BS_INLINE void BitStreamAccumulateLsb(uint64_t *cache, size_t *nbits, uint8_t **p, size_t bits, uint64_t value) {
+    size_t room = 64 - *nbits;
+
+    if (bits < 64)
+        value &= ((uint64_t) 1 << bits) - 1;
+    *cache |= value << *nbits;
+    if (bits < room) {
+        *nbits += bits;
+    } else {
+        BitStreamStoreLE64(*p, *cache);
+        *p += 8;
+        bits -= room;
+        *cache = bits ? value >> room : 0;
+        *nbits = bits;
+    }
+}
+
+BS_INLINE void BitOutputStreamPutLsb(BitOutputStream *bos, size_t bits, uint64_t value) {
+    uint8_t *p = bos->_M_bytes + ((bos->_M_position - bos->_M_cache_bits) >> 3);
+    BitStreamAccumulateLsb(&bos->_M_cache, &bos->_M_cache_bits, &p, bits, value);
+    bos->_M_position += bits;
+}
+
+/* outcomes of BitStreamCheckUtf8. */
+#define BS_UTF8_VALID 0
+#define BS_UTF8_INVALID 1
+#define BS_UTF8_TRUNCATED 2
+
+extern int BitStreamCheckUtf8(uint8_t const*, size_t, size_t*);
+
+/* task `i` of a parallel run, non zero fails the run. */
+typedef int (*BSTaskFunc)(void*, size_t);
+
+extern int BitStreamRunParallel(size_t, size_t, BSTaskFunc, void*);
+
+/**
+ * The LSB first engine, see bitstream_lsb.c. Reads go straight to memory
+ * and leave the cached window empty, so that every MSB first fast path
+ * misses on a LSB first stream and ends up in here.
+ */
+extern ReadResult BitInputStreamReadUIntLsb(BitInputStream*, size_t);
+extern ReadResult BitInputStreamPeekUIntLsb(BitInputStream*, size_t);
+extern void BitOutputStreamWriteUIntLsb(BitOutputStream*, size_t, uint64_t);
+extern void BitOutputStreamFlushCacheLsb(BitOutputStream*);
+extern void BitOutputStreamMoveToLsb(BitOutputStream*, size_t);
+
+#endif /* BITSTREAM_BITSTREAM_INTERNAL_H_INCLUDED */
@@ -0,0 +1,95 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdint.h>
+
+/**
+ * LSB first bit order.
+ *
+ * Reads load the little-endian word at the cursor and shift it down by
+ * the bit offset within the byte, one load serves up to 57 bits. They keep
+ * no window, the cached one stays empty. Writes go through the accumulator
+ * of the stream filled from its least significant bit. Seeks and padding
+ * only move positions and are shared with the MSB first engine.
+ */
+
+/**
+ * Only the first 64 bits of a wider field are kept, they are its least
+ * significant ones.
+ */
+ReadResult BitInputStreamReadUIntLsb(BitInputStream *bis, size_t bits) {
+    ReadResult result;
+
+    result._M_status = BS_SUCCESS;
+    result._M_value.uint = 0;
+    if (bis->_M_position + bits > bis->_M_size && !BitInputStreamFill(bis, bits)) {
+        BS_STAT_INC(eos);
+        result._M_status = BS_EOS;
+        return result;
+    }
+    BS_STAT_ADD(bits_read, bits);
+    if (bits > 0)
+        result._M_value.uint = BitStreamExtractLsb(bis->_M_bytes, (bis->_M_size + 7) >> 3,
+                bis->_M_position, bits < 64 ? bits : 64);
+    bis->_M_position += bits;
+    return result;
+}
+
+/* 1..64 bits, the caller checks the width. */
+ReadResult BitInputStreamPeekUIntLsb(BitInputStream *bis, size_t bits) {
+    ReadResult result;
+
+    result._M_status = BS_SUCCESS;
+    result._M_value.uint = 0;
+    if (bis->_M_position + bits > bis->_M_size && !BitInputStreamFill(bis, bits)) {
+        result._M_status = BS_EOS;
+        return result;
+    }
+    result._M_value.uint = BitStreamExtractLsb(bis->_M_bytes, (bis->_M_size + 7) >> 3,
+            bis->_M_position, bits);
+    return result;
+}
+
+/**
+ * Any width, the caller has made room for it. Wider than 64 bits the field
+ * is zero extended, the value goes first.
+ */
+void BitOutputStreamWriteUIntLsb(BitOutputStream *bos, size_t bits, uint64_t value) {
+    size_t n;
+
+    while (bits > 0) {
+        n = bits < 64 ? bits : 64;
+        BitOutputStreamPutLsb(bos, n, value);
+        value = 0;
+        bits -= n;
+    }
+}
+
+/**
+ * Stores the complete bytes of the accumulator, and the partial trailing
+ * byte merged with the bits of memory following the cursor, which are the
+ * high bits of the byte. The partial byte stays in the accumulator.
+ */
+void BitOutputStreamFlushCacheLsb(BitOutputStream *bos) {
+    uint8_t *p = bos->_M_bytes + ((bos->_M_position - bos->_M_cache_bits) >> 3);
+    size_t n;
+    int rbits;
+
+    for (n = bos->_M_cache_bits >> 3; n > 0; --n) {
+        *p++ = (uint8_t) bos->_M_cache;
+        bos->_M_cache >>= 8;
+    }
+    rbits = bos->_M_cache_bits & 0x7;
+    bos->_M_cache_bits = rbits;
+    if (rbits)
+        *p = (uint8_t) (bos->_M_cache | (*p & (0xff << rbits)));
+}
+
+/* restarts the flushed accumulator at `pos` with the low bits of its byte. */
+void BitOutputStreamMoveToLsb(BitOutputStream *bos, size_t pos) {
+    bos->_M_position = pos;
+    bos->_M_cache_bits = pos & 0x7;
+    bos->_M_cache = bos->_M_cache_bits
+        ? (uint64_t) (bos->_M_bytes[pos >> 3] & ((1u << bos->_M_cache_bits) - 1))
+        : 0;
+}
@@ -0,0 +1,113 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define BS_HAVE_MMAP 1
+#endif
+
+/**
+ * Memory mapped file input streams.
+ *
+ * The stream reads the mapping in place like any in memory stream, its
+ * source has no reader and only owns the mapping, which goes away with
+ * BitInputStreamRelease.
+ */
+
+#if defined(BS_HAVE_MMAP)
+
+typedef struct tagBSMapping {
+    void *_M_address;
+    size_t _M_length;
+} BSMapping;
+
+static void BitStreamCloseMapping(BSSource *source) {
+    BSMapping *mapping = (BSMapping*) source->_M_context;
+    munmap(mapping->_M_address, mapping->_M_length);
+    free(mapping);
+}
+
+/* the hints are advisory, a kernel which ignores them changes nothing. */
+static void BitStreamAdvise(void *address, size_t length, BSAccess access) {
+    switch (access) {
+#if defined(MADV_SEQUENTIAL) && defined(MADV_WILLNEED)
+        case BS_ACCESS_SEQUENTIAL:
+            madvise(address, length, MADV_SEQUENTIAL);
+            madvise(address, length, MADV_WILLNEED);
+            break;
+#endif
+#if defined(MADV_RANDOM)
+        case BS_ACCESS_RANDOM:
+            madvise(address, length, MADV_RANDOM);
+            break;
+#endif
+#if defined(MADV_WILLNEED)
+        case BS_ACCESS_WILLNEED:
+            madvise(address, length, MADV_WILLNEED);
+            break;
+#endif
+        default: break;
+    }
+}
+
+BitInputStream* BitInputStreamOpenFile(BitInputStream *bis, char const *path, BSAccess access) {
+    int fd;
+    struct stat st;
+    BSSource *source = NULL;
+    BSMapping *mapping = NULL;
+    void *address = MAP_FAILED;
+
+    if (!bis || !path)
+        return NULL;
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size < 0
+            || (uint64_t) st.st_size > (uint64_t) ((size_t) -1 >> 3))
+        goto failure;
+    if (st.st_size == 0) {
+        /* nothing to map, an empty stream it is. */
+        close(fd);
+        return BitInputStreamInitialize(bis, NULL, 0);
+    }
+    if (!(source = BitStreamSourceCreate(0))
+            || !(mapping = (BSMapping*) malloc(sizeof(BSMapping))))
+        goto failure;
+    address = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED)
+        goto failure;
+    /* the mapping outlives the descriptor. */
+    close(fd);
+    BitStreamAdvise(address, (size_t) st.st_size, access);
+
+    mapping->_M_address = address;
+    mapping->_M_length = (size_t) st.st_size;
+    source->_M_context = mapping;
+    source->_M_close = &BitStreamCloseMapping;
+    source->_M_eof = 1;
+    BitInputStreamInitialize(bis, address, (size_t) st.st_size << 3);
+    bis->_M_source = source;
+    return bis;
+failure:
+    free(mapping);
+    BitStreamSourceDestroy(source);
+    close(fd);
+    return NULL;
+}
+
+#else
+
+BitInputStream* BitInputStreamOpenFile(BitInputStream *bis, char const *path, BSAccess access) {
+    (void) bis;
+    (void) path;
+    (void) access;
+    return NULL;
+}
+
+#endif /* BS_HAVE_MMAP */
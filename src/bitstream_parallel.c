@@ -0,0 +1,230 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <unistd.h>
+#define BS_HAVE_PTHREADS 1
+#endif
+
+/**
+ * Parallel drivers.
+ *
+ * A call runs its tasks on a pool of worker threads which lives as long as
+ * the call, the calling thread being one of the workers. Workers claim the
+ * next task one at a time, so that uneven tasks still spread evenly. The
+ * first task which fails stops the claiming, tasks already running finish.
+ * Without threads the tasks run in order on the calling thread.
+ */
+
+#define BS_PARALLEL_MAX_THREADS 256
+
+typedef struct tagBSParallelJob {
+    BSTaskFunc _M_task;
+    void *_M_context;
+    size_t _M_tasks;
+    size_t _M_next;
+    int _M_result;
+#if defined(BS_HAVE_PTHREADS)
+    pthread_mutex_t _M_lock;
+#endif
+} BSParallelJob;
+
+/**
+ * Records the result of the task just run and hands out the next one,
+ * `_M_tasks` once there is none left or a task failed.
+ */
+static size_t BitStreamParallelClaim(BSParallelJob *job, int rc) {
+    size_t i;
+
+#if defined(BS_HAVE_PTHREADS)
+    pthread_mutex_lock(&job->_M_lock);
+#endif
+    if (rc != 0 && job->_M_result == 0)
+        job->_M_result = rc;
+    i = job->_M_result == 0 && job->_M_next < job->_M_tasks ? job->_M_next++ : job->_M_tasks;
+#if defined(BS_HAVE_PTHREADS)
+    pthread_mutex_unlock(&job->_M_lock);
+#endif
+    return i;
+}
+
+static void* BitStreamParallelWorker(void *arg) {
+    BSParallelJob *job = (BSParallelJob*) arg;
+    size_t i;
+    int rc = 0;
+
+    while ((i = BitStreamParallelClaim(job, rc)) < job->_M_tasks)
+        rc = job->_M_task(job->_M_context, i);
+    return NULL;
+}
+
+/* number of threads to use for 0, the online processors. */
+static size_t BitStreamParallelThreads(size_t threads, size_t tasks) {
+#if defined(BS_HAVE_PTHREADS) && defined(_SC_NPROCESSORS_ONLN)
+    long n;
+
+    if (threads == 0) {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = n > 0 ? (size_t) n : 1;
+    }
+#else
+    if (threads == 0)
+        threads = 1;
+#endif
+    if (threads > BS_PARALLEL_MAX_THREADS)
+        threads = BS_PARALLEL_MAX_THREADS;
+    return threads < tasks ? threads : tasks;
+}
+
+/**
+ * Runs `task(context, i)` for i in 0..tasks - 1 on up to `threads`
+ * threads, 0 for one per online processor. Returns 0 when every task
+ * returned 0, the non zero result of the first failing one otherwise.
+ * Threads which cannot be started leave their share to the others.
+ */
+int BitStreamRunParallel(size_t threads, size_t tasks, BSTaskFunc task, void *context) {
+    BSParallelJob job;
+#if defined(BS_HAVE_PTHREADS)
+    pthread_t workers[BS_PARALLEL_MAX_THREADS];
+    size_t started = 0;
+    size_t i;
+#endif
+
+    job._M_task = task;
+    job._M_context = context;
+    job._M_tasks = tasks;
+    job._M_next = 0;
+    job._M_result = 0;
+    threads = BitStreamParallelThreads(threads, tasks);
+#if defined(BS_HAVE_PTHREADS)
+    if (pthread_mutex_init(&job._M_lock, NULL) != 0)
+        return -1;
+    for (i = 1; i < threads; ++i) {
+        if (pthread_create(&workers[started], NULL, &BitStreamParallelWorker, &job) == 0)
+            ++started;
+    }
+    BitStreamParallelWorker(&job);
+    for (i = 0; i < started; ++i)
+        pthread_join(workers[i], NULL);
+    pthread_mutex_destroy(&job._M_lock);
+#else
+    BitStreamParallelWorker(&job);
+#endif
+    return job._M_result;
+}
+
+typedef struct tagBSDecodeJob {
+    uint8_t const *_M_bytes;
+    size_t _M_bits;
+    BSIndex const *_M_index;
+    BSSegmentFunc _M_decode;
+    void *_M_context;
+} BSDecodeJob;
+
+/**
+ * The view of a segment starts at the byte holding its first bit with the
+ * cursor on that bit, and ends with the segment.
+ */
+static int BitStreamDecodeSegment(void *context, size_t i) {
+    BSDecodeJob *job = (BSDecodeJob*) context;
+    BitInputStream view;
+    size_t count = BitStreamIndexGetCount(job->_M_index);
+    size_t start = (size_t) BitStreamIndexGet(job->_M_index, i);
+    size_t end = i + 1 < count ? (size_t) BitStreamIndexGet(job->_M_index, i + 1) : job->_M_bits;
+    int rc;
+
+    if (start > end || end > job->_M_bits)
+        return -1;
+    BitInputStreamInitialize(&view, job->_M_bytes + (start >> 3), end - (start & ~(size_t) 0x7));
+    BitInputStreamSkipBits(&view, start & 0x7);
+    rc = job->_M_decode(job->_M_context, i, &view);
+    BitInputStreamRelease(&view);
+    return rc;
+}
+
+/**
+ * Decodes every segment of the `bits` long buffer listed in the index, in
+ * parallel on up to `threads` threads. Each call of `decode` gets the
+ * number of the segment and a stream of its own over that segment only.
+ * Returns 0 when all of them returned 0, the result of the first failing
+ * one otherwise, and -1 for an index which does not fit the buffer.
+ */
+int BitStreamDecodeParallel(void const *buffer, size_t bits, BSIndex const *index, BSSegmentFunc decode,
+        void *context, size_t threads) {
+    BSDecodeJob job;
+
+    job._M_bytes = (uint8_t const*) buffer;
+    job._M_bits = bits;
+    job._M_index = index;
+    job._M_decode = decode;
+    job._M_context = context;
+    return BitStreamRunParallel(threads, BitStreamIndexGetCount(index), &BitStreamDecodeSegment, &job);
+}
+
+typedef struct tagBSEncodeJob {
+    BitOutputStream *_M_target;
+    BitOutputStream *_M_parts;
+    BSPartitionFunc _M_encode;
+    void *_M_context;
+} BSEncodeJob;
+
+/* the first partition goes straight into the target, the others into streams of their own. */
+static int BitStreamEncodePartition(void *context, size_t i) {
+    BSEncodeJob *job = (BSEncodeJob*) context;
+    return job->_M_encode(job->_M_context, i, i ? job->_M_parts + i - 1 : job->_M_target);
+}
+
+/**
+ * Encodes `partitions` partitions in parallel on up to `threads` threads
+ * and appends them to the stream in order. The first one is written in
+ * place, the others into private malloc backed streams of the same bit
+ * order which are merged in once all of them are done, after growing the
+ * stream once. Only one thread at a time uses the allocator of the
+ * stream, which need not be thread safe. BS_FAIL when an encoder returns
+ * non zero or memory runs out, the stream then holds some of the
+ * partitions.
+ */
+WriteResult BitStreamEncodeParallel(BitOutputStream *bos, size_t partitions, BSPartitionFunc encode,
+        void *context, size_t threads) {
+    WriteResult result = { BS_FAIL };
+    BSEncodeJob job;
+    size_t initialized = 0;
+    size_t total = 0;
+    size_t i;
+
+    if (partitions == 0) {
+        result._M_status = BS_SUCCESS;
+        return result;
+    }
+    job._M_target = bos;
+    job._M_encode = encode;
+    job._M_context = context;
+    job._M_parts = (BitOutputStream*) calloc(partitions, sizeof(BitOutputStream));
+    if (!job._M_parts)
+        return result;
+    for (; initialized + 1 < partitions; ++initialized) {
+        if (!BitOutputStreamInitialize(job._M_parts + initialized, NULL, 0))
+            goto cleanup;
+        BitOutputStreamSetBitOrder(job._M_parts + initialized, bos->_M_order);
+    }
+    if (BitStreamRunParallel(threads, partitions, &BitStreamEncodePartition, &job) != 0)
+        goto cleanup;
+    for (i = 0; i < initialized; ++i)
+        total += job._M_parts[i]._M_position;
+    if (!bos->_M_sink && BitOutputStreamReserve(bos, total) != 0)
+        goto cleanup;
+    for (i = 0; i < initialized; ++i) {
+        if (!BS_SUCCEEDED(BitOutputStreamAppend(bos, job._M_parts + i)))
+            goto cleanup;
+    }
+    result._M_status = BS_SUCCESS;
+cleanup:
+    for (i = 0; i < initialized; ++i)
+        BitOutputStreamRelease(job._M_parts + i);
+    free(job._M_parts);
+    return result;
+}
@@ -0,0 +1,404 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define BS_HAVE_PTHREADS 1
+#endif
+
+/**
+ * Buffer pool of growable output streams.
+ *
+ * Buffers come in power of two size classes, from 64 bytes to 16 MiB, and
+ * carry their class in a header in front of them. A released buffer goes
+ * to the cache of the releasing thread, which holds a few buffers of each
+ * class and hands half of them over to the shared depot when it overflows.
+ * Allocations take from the cache of the thread, then from the depot, then
+ * from malloc. Only the depot takes the lock. Growing a pooled buffer
+ * moves it to the next class, which takes the place of a realloc.
+ *
+ * Every cache also keeps the high-water mark of the buffers released
+ * through it, the largest one over the last two windows of releases.
+ * Streams initialized from the pool start at that size, so that a thread
+ * encoding similar messages stops growing buffers after the first few.
+ *
+ * The cache of a thread goes back to the depot when the thread exits.
+ * Larger buffers bypass the pool.
+ */
+
+#define BS_POOL_MIN_SHIFT 6
+#define BS_POOL_CLASSES 19
+
+/* buffers of a class a thread keeps before it hands half of them over. */
+#define BS_POOL_CACHE_BUFFERS 8
+
+/* releases after which the high-water mark forgets older messages. */
+#define BS_POOL_WINDOW 64
+
+/* keeps the buffers 16 bytes aligned. */
+#define BS_POOL_HEADER 16
+
+typedef struct tagBSPoolHeader {
+    size_t _M_class;
+    size_t _M_capacity;
+} BSPoolHeader;
+
+typedef struct tagBSPoolBuffer {
+    struct tagBSPoolBuffer *_M_next;
+} BSPoolBuffer;
+
+typedef struct tagBSPoolCache {
+    BSPoolBuffer *_M_free[BS_POOL_CLASSES];
+    size_t _M_count[BS_POOL_CLASSES];
+    /* bytes, the largest release of the previous window and of the current one. */
+    size_t _M_high_water;
+    size_t _M_window_high;
+    size_t _M_window;
+    struct tagBSPoolCache *_M_next;
+    struct tagBSPoolCache *_M_prev;
+    BSPool *_M_pool;
+} BSPoolCache;
+
+struct tagBSPool {
+    /* shared, and the only cache without threads. */
+    BSPoolCache _M_depot;
+#if defined(BS_HAVE_PTHREADS)
+    pthread_mutex_t _M_lock;
+    pthread_key_t _M_key;
+    /* caches of the live threads, freed with the pool. */
+    BSPoolCache *_M_caches;
+#endif
+};
+
+BS_INLINE void BitStreamPoolLock(BSPool *pool) {
+#if defined(BS_HAVE_PTHREADS)
+    pthread_mutex_lock(&pool->_M_lock);
+#else
+    (void) pool;
+#endif
+}
+
+BS_INLINE void BitStreamPoolUnlock(BSPool *pool) {
+#if defined(BS_HAVE_PTHREADS)
+    pthread_mutex_unlock(&pool->_M_lock);
+#else
+    (void) pool;
+#endif
+}
+
+BS_INLINE BSPoolHeader* BitStreamPoolHeader(void *p) {
+    return (BSPoolHeader*) ((uint8_t*) p - BS_POOL_HEADER);
+}
+
+/* usable bytes of a class. */
+BS_INLINE size_t BitStreamPoolCapacity(size_t c) {
+    return ((size_t) 1 << (c + BS_POOL_MIN_SHIFT)) - BS_POOL_HEADER;
+}
+
+/* smallest class holding `n` bytes, BS_POOL_CLASSES for none. */
+static size_t BitStreamPoolClass(size_t n) {
+    size_t c;
+
+    for (c = 0; c < BS_POOL_CLASSES; ++c) {
+        if (n <= BitStreamPoolCapacity(c))
+            return c;
+    }
+    return BS_POOL_CLASSES;
+}
+
+BS_INLINE void BitStreamPoolPush(BSPoolCache *cache, size_t c, void *p) {
+    BSPoolBuffer *buffer = (BSPoolBuffer*) p;
+
+    buffer->_M_next = cache->_M_free[c];
+    cache->_M_free[c] = buffer;
+    ++cache->_M_count[c];
+}
+
+BS_INLINE void* BitStreamPoolPop(BSPoolCache *cache, size_t c) {
+    BSPoolBuffer *buffer = cache->_M_free[c];
+
+    if (buffer) {
+        cache->_M_free[c] = buffer->_M_next;
+        --cache->_M_count[c];
+    }
+    return buffer;
+}
+
+/* moves up to `n` buffers of class `c`, returns how many moved. */
+static size_t BitStreamPoolMove(BSPoolCache *to, BSPoolCache *from, size_t c, size_t n) {
+    size_t moved;
+    void *p;
+
+    for (moved = 0; moved < n && (p = BitStreamPoolPop(from, c)); ++moved)
+        BitStreamPoolPush(to, c, p);
+    return moved;
+}
+
+/* frees the buffers of the largest classes first until at most `keep` bytes are left, returns the bytes freed. */
+static size_t BitStreamPoolRelease(BSPoolCache *cache, size_t keep) {
+    size_t cached = 0;
+    size_t freed = 0;
+    size_t c;
+    void *p;
+
+    for (c = 0; c < BS_POOL_CLASSES; ++c)
+        cached += cache->_M_count[c] * BitStreamPoolCapacity(c);
+    for (c = BS_POOL_CLASSES; c-- > 0 && cached > keep;) {
+        while (cached > keep && (p = BitStreamPoolPop(cache, c))) {
+            free(BitStreamPoolHeader(p));
+            cached -= BitStreamPoolCapacity(c);
+            freed += BitStreamPoolCapacity(c);
+        }
+    }
+    return freed;
+}
+
+#if defined(BS_HAVE_PTHREADS)
+static void BitStreamPoolUnlink(BSPool *pool, BSPoolCache *cache) {
+    if (cache->_M_prev)
+        cache->_M_prev->_M_next = cache->_M_next;
+    else
+        pool->_M_caches = cache->_M_next;
+    if (cache->_M_next)
+        cache->_M_next->_M_prev = cache->_M_prev;
+}
+
+/* a thread exits, its buffers go to the depot. */
+static void BitStreamPoolThreadExit(void *arg) {
+    BSPoolCache *cache = (BSPoolCache*) arg;
+    BSPool *pool = cache->_M_pool;
+    size_t c;
+
+    BitStreamPoolLock(pool);
+    for (c = 0; c < BS_POOL_CLASSES; ++c)
+        BitStreamPoolMove(&pool->_M_depot, cache, c, cache->_M_count[c]);
+    BitStreamPoolUnlink(pool, cache);
+    BitStreamPoolUnlock(pool);
+    free(cache);
+}
+#endif
+
+/* the cache of the calling thread, NULL when the thread has to use the depot. */
+static BSPoolCache* BitStreamPoolGetCache(BSPool *pool) {
+#if defined(BS_HAVE_PTHREADS)
+    BSPoolCache *cache = (BSPoolCache*) pthread_getspecific(pool->_M_key);
+
+    if (BS_LIKELY(cache != NULL))
+        return cache;
+    if (!(cache = (BSPoolCache*) calloc(1, sizeof(BSPoolCache))))
+        return NULL;
+    cache->_M_pool = pool;
+    if (pthread_setspecific(pool->_M_key, cache) != 0) {
+        free(cache);
+        return NULL;
+    }
+    BitStreamPoolLock(pool);
+    cache->_M_next = pool->_M_caches;
+    if (pool->_M_caches)
+        pool->_M_caches->_M_prev = cache;
+    pool->_M_caches = cache;
+    BitStreamPoolUnlock(pool);
+    return cache;
+#else
+    (void) pool;
+    return NULL;
+#endif
+}
+
+static void* BitStreamPoolMalloc(void *context, size_t n) {
+    BSPool *pool = (BSPool*) context;
+    BSPoolCache *cache;
+    BSPoolHeader *header;
+    size_t c = BitStreamPoolClass(n);
+    void *p = NULL;
+
+    if (c < BS_POOL_CLASSES) {
+        if ((cache = BitStreamPoolGetCache(pool)) && (p = BitStreamPoolPop(cache, c)))
+            return p;
+        BitStreamPoolLock(pool);
+        if ((p = BitStreamPoolPop(&pool->_M_depot, c)) && cache)
+            BitStreamPoolMove(cache, &pool->_M_depot, c, BS_POOL_CACHE_BUFFERS >> 1);
+        BitStreamPoolUnlock(pool);
+        if (p)
+            return p;
+        n = BitStreamPoolCapacity(c);
+    }
+    if (n > (size_t) -1 - BS_POOL_HEADER || !(header = (BSPoolHeader*) malloc(n + BS_POOL_HEADER)))
+        return NULL;
+    header->_M_class = c;
+    header->_M_capacity = n;
+    return (uint8_t*) header + BS_POOL_HEADER;
+}
+
+/* takes a buffer back, into the cache of the thread while it has room. */
+static void BitStreamPoolRecycle(BSPool *pool, BSPoolCache *cache, void *p) {
+    size_t c = BitStreamPoolHeader(p)->_M_class;
+
+    if (c >= BS_POOL_CLASSES) {
+        free(BitStreamPoolHeader(p));
+        return;
+    }
+    if (cache) {
+        BitStreamPoolPush(cache, c, p);
+        if (cache->_M_count[c] <= BS_POOL_CACHE_BUFFERS)
+            return;
+        BitStreamPoolLock(pool);
+        BitStreamPoolMove(&pool->_M_depot, cache, c, BS_POOL_CACHE_BUFFERS >> 1);
+        BitStreamPoolUnlock(pool);
+        return;
+    }
+    BitStreamPoolLock(pool);
+    BitStreamPoolPush(&pool->_M_depot, c, p);
+    BitStreamPoolUnlock(pool);
+}
+
+/* a stream is done with its buffer, the size it reached counts for the high-water mark. */
+static void BitStreamPoolFree(void *context, void *p) {
+    BSPool *pool = (BSPool*) context;
+    BSPoolCache *cache = BitStreamPoolGetCache(pool);
+    BSPoolCache *marks = cache ? cache : &pool->_M_depot;
+    size_t capacity;
+
+    if (!p)
+        return;
+    capacity = BitStreamPoolHeader(p)->_M_capacity;
+    if (!cache)
+        BitStreamPoolLock(pool);
+    if (capacity > marks->_M_window_high)
+        marks->_M_window_high = capacity;
+    if (++marks->_M_window == BS_POOL_WINDOW) {
+        marks->_M_high_water = marks->_M_window_high;
+        marks->_M_window_high = 0;
+        marks->_M_window = 0;
+    }
+    if (!cache)
+        BitStreamPoolUnlock(pool);
+    BitStreamPoolRecycle(pool, cache, p);
+}
+
+static void* BitStreamPoolRealloc(void *context, void *p, size_t n) {
+    BSPool *pool = (BSPool*) context;
+    size_t capacity;
+    void *q;
+
+    if (!p)
+        return BitStreamPoolMalloc(context, n);
+    capacity = BitStreamPoolHeader(p)->_M_capacity;
+    if (n <= capacity)
+        return p;
+    if (!(q = BitStreamPoolMalloc(context, n)))
+        return NULL;
+    memcpy(q, p, capacity);
+    BitStreamPoolRecycle(pool, BitStreamPoolGetCache(pool), p);
+    return q;
+}
+
+BSPool* BitStreamPoolCreate(void) {
+    BSPool *pool = (BSPool*) calloc(1, sizeof(BSPool));
+
+    if (!pool)
+        return NULL;
+#if defined(BS_HAVE_PTHREADS)
+    if (pthread_mutex_init(&pool->_M_lock, NULL) != 0) {
+        free(pool);
+        return NULL;
+    }
+    if (pthread_key_create(&pool->_M_key, &BitStreamPoolThreadExit) != 0) {
+        pthread_mutex_destroy(&pool->_M_lock);
+        free(pool);
+        return NULL;
+    }
+#endif
+    return pool;
+}
+
+/**
+ * Frees every cached buffer, those of the other threads too: no thread may
+ * use the pool any more, and no stream may still hold a buffer of it.
+ */
+void BitStreamPoolDestroy(BSPool *pool) {
+#if defined(BS_HAVE_PTHREADS)
+    BSPoolCache *cache;
+#endif
+
+    if (!pool)
+        return;
+#if defined(BS_HAVE_PTHREADS)
+    pthread_key_delete(pool->_M_key);
+    while ((cache = pool->_M_caches)) {
+        pool->_M_caches = cache->_M_next;
+        BitStreamPoolRelease(cache, 0);
+        free(cache);
+    }
+    pthread_mutex_destroy(&pool->_M_lock);
+#endif
+    BitStreamPoolRelease(&pool->_M_depot, 0);
+    free(pool);
+}
+
+/* hooks which take buffers from the pool, for BitOutputStreamInitializeWithAllocator. */
+void BitStreamPoolGetAllocator(BSPool *pool, BSAllocator *allocator) {
+    allocator->_M_malloc = &BitStreamPoolMalloc;
+    allocator->_M_realloc = &BitStreamPoolRealloc;
+    allocator->_M_free = &BitStreamPoolFree;
+    allocator->_M_context = pool;
+}
+
+/**
+ * Frees cached buffers, of the largest classes first, until the depot and
+ * the cache of the calling thread hold at most `keep` bytes each. The
+ * caches of the other threads are theirs. Returns the bytes freed.
+ */
+size_t BitStreamPoolTrim(BSPool *pool, size_t keep) {
+    BSPoolCache *cache = BitStreamPoolGetCache(pool);
+    size_t freed = 0;
+
+    if (cache)
+        freed += BitStreamPoolRelease(cache, keep);
+    BitStreamPoolLock(pool);
+    freed += BitStreamPoolRelease(&pool->_M_depot, keep);
+    BitStreamPoolUnlock(pool);
+    return freed;
+}
+
+/* bytes cached by the depot and by the calling thread. */
+size_t BitStreamPoolGetCachedBytes(BSPool *pool) {
+    BSPoolCache *cache = BitStreamPoolGetCache(pool);
+    size_t cached = 0;
+    size_t c;
+
+    BitStreamPoolLock(pool);
+    for (c = 0; c < BS_POOL_CLASSES; ++c) {
+        cached += pool->_M_depot._M_count[c] * BitStreamPoolCapacity(c);
+        if (cache)
+            cached += cache->_M_count[c] * BitStreamPoolCapacity(c);
+    }
+    BitStreamPoolUnlock(pool);
+    return cached;
+}
+
+/**
+ * A growable stream whose buffer comes from the pool, presized to the
+ * high-water mark of the messages the calling thread encoded recently.
+ */
+BitOutputStream* BitOutputStreamInitializeWithPool(BitOutputStream *bos, BSPool *pool) {
+    BSPoolCache *cache = BitStreamPoolGetCache(pool);
+    BSPoolCache *marks = cache ? cache : &pool->_M_depot;
+    BSAllocator allocator;
+    size_t bytes;
+
+    BitStreamPoolGetAllocator(pool, &allocator);
+    if (!cache)
+        BitStreamPoolLock(pool);
+    bytes = marks->_M_high_water > marks->_M_window_high ? marks->_M_high_water : marks->_M_window_high;
+    if (!cache)
+        BitStreamPoolUnlock(pool);
+    /* a huge message does not make every later one huge. */
+    if (bytes > BitStreamPoolCapacity(BS_POOL_CLASSES - 1))
+        bytes = BitStreamPoolCapacity(BS_POOL_CLASSES - 1);
+    return BitOutputStreamInitializeWithAllocator(bos, NULL, bytes << 3, &allocator);
+}
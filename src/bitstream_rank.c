@@ -0,0 +1,547 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if BS_HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/**
+ * Bitmap queries: population counts, searches for the next set or clear
+ * bit, and a rank/select index.
+ *
+ * Whole bytes hold the same bits in either bit order, so counts and
+ * searches only care about the order in the partial bytes at both ends
+ * of a range. The whole bytes go through kernels picked at runtime: AVX2
+ * counts with a nibble lookup summed by SAD, and skips 32 bytes per
+ * compare, POPCNT counts a word per instruction.
+ *
+ * The index is a two-level directory over an in memory buffer which it
+ * does not copy: the ones before every superblock of 64 Ki bits as 64
+ * bits, the ones before every block of 512 bits inside its superblock as
+ * 16 bits, 3.2% of the bitmap. Rank adds the two entries and counts at
+ * most 8 words. Select starts from a sample of the superblock holding
+ * every 8192nd one or zero, binary searches the superblocks and then the
+ * blocks, and counts the words of one block.
+ */
+
+#define BS_RANK_BLOCK_BITS 512
+#define BS_RANK_SUPER_BITS 65536
+#define BS_RANK_BLOCKS_PER_SUPER (BS_RANK_SUPER_BITS / BS_RANK_BLOCK_BITS)
+#define BS_RANK_SAMPLE 8192
+
+typedef uint64_t (*BSCountKernel)(uint8_t const*, size_t);
+typedef size_t (*BSSkipKernel)(uint8_t const*, size_t, uint8_t);
+
+typedef struct tagBSBitmapKernels {
+    BSCountKernel _M_count;
+    BSSkipKernel _M_skip;
+} BSBitmapKernels;
+
+/* set bits of `n` bytes. */
+static uint64_t BitStreamCountBytes(uint8_t const *p, size_t n) {
+    uint64_t ones = 0;
+    uint64_t w;
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        memcpy(&w, p + i, 8);
+        ones += BitStreamPopCount64(w);
+    }
+    for (; i < n; ++i)
+        ones += BitStreamPopCount64(p[i]);
+    return ones;
+}
+
+/* number of leading bytes equal to `fill`. */
+static size_t BitStreamSkipBytes(uint8_t const *p, size_t n, uint8_t fill) {
+    uint64_t pattern = fill ? ~(uint64_t) 0 : 0;
+    uint64_t w;
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        memcpy(&w, p + i, 8);
+        if (w != pattern)
+            break;
+    }
+    while (i < n && p[i] == fill)
+        ++i;
+    return i;
+}
+
+#if BS_HAVE_X86_DISPATCH
+BS_TARGET("popcnt") static uint64_t BitStreamCountBytesPOPCNT(uint8_t const *p, size_t n) {
+    uint64_t ones = 0;
+    uint64_t w;
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        memcpy(&w, p + i, 8);
+        ones += (uint64_t) __builtin_popcountll(w);
+    }
+    for (; i < n; ++i)
+        ones += (uint64_t) __builtin_popcount(p[i]);
+    return ones;
+}
+
+/**
+ * Counts of the two nibbles of every byte looked up by shuffles, summed
+ * as bytes for up to 31 rounds, which cannot overflow, then into 64 bits
+ * lanes by SAD.
+ */
+BS_TARGET("avx2,popcnt") static uint64_t BitStreamCountBytesAVX2(uint8_t const *p, size_t n) {
+    __m256i const lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    __m256i const low = _mm256_set1_epi8(0x0f);
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i total = zero;
+    __m256i local;
+    __m256i v;
+    uint64_t ones;
+    uint64_t w;
+    size_t i = 0;
+    int rounds;
+
+    while (i + 32 <= n) {
+        local = zero;
+        for (rounds = 0; rounds < 31 && i + 32 <= n; ++rounds, i += 32) {
+            v = _mm256_loadu_si256((__m256i const*) (p + i));
+            local = _mm256_add_epi8(local, _mm256_add_epi8(
+                        _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low)),
+                        _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low))));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(local, zero));
+    }
+    ones = (uint64_t) _mm256_extract_epi64(total, 0) + (uint64_t) _mm256_extract_epi64(total, 1)
+        + (uint64_t) _mm256_extract_epi64(total, 2) + (uint64_t) _mm256_extract_epi64(total, 3);
+    for (; i + 8 <= n; i += 8) {
+        memcpy(&w, p + i, 8);
+        ones += (uint64_t) __builtin_popcountll(w);
+    }
+    for (; i < n; ++i)
+        ones += (uint64_t) __builtin_popcount(p[i]);
+    return ones;
+}
+
+BS_TARGET("avx2") static size_t BitStreamSkipBytesAVX2(uint8_t const *p, size_t n, uint8_t fill) {
+    __m256i const pattern = _mm256_set1_epi8((char) fill);
+    uint32_t equal;
+    size_t i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        equal = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const*) (p + i)),
+                    pattern));
+        if (equal != 0xffffffffu)
+            return i + BitStreamCountTrailingZeros64(~equal & 0xffffffffu);
+    }
+    while (i < n && p[i] == fill)
+        ++i;
+    return i;
+}
+#endif /* BS_HAVE_X86_DISPATCH */
+
+/**
+ * Kernels of the running CPU, looked up once. Concurrent first calls race
+ * benignly, they all store the same pointers.
+ */
+static BSBitmapKernels const* BitStreamBitmapKernels(void) {
+    static BSBitmapKernels kernels = { &BitStreamCountBytes, &BitStreamSkipBytes };
+    static int volatile resolved = 0;
+
+    if (resolved)
+        return &kernels;
+#if BS_HAVE_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        kernels._M_count = &BitStreamCountBytesAVX2;
+        kernels._M_skip = &BitStreamSkipBytesAVX2;
+    } else if (__builtin_cpu_supports("popcnt")) {
+        kernels._M_count = &BitStreamCountBytesPOPCNT;
+    }
+#endif
+    resolved = 1;
+    return &kernels;
+}
+
+/* bits [lo, hi) of a byte, in stream order. */
+BS_INLINE unsigned BitStreamByteMask(size_t lo, size_t hi, BSBitOrder order) {
+    if (order == BS_LSB_FIRST)
+        return (0xffu << lo) & (0xffu >> (8 - hi));
+    return (0xffu >> lo) & (0xffu << (8 - hi)) & 0xffu;
+}
+
+/* offset of the first set bit of a non zero byte, in stream order. */
+BS_INLINE size_t BitStreamFirstInByte(unsigned x, BSBitOrder order) {
+    if (order == BS_LSB_FIRST)
+        return BitStreamCountTrailingZeros64(x);
+    return BitStreamCountLeadingZeros64((uint64_t) x << 56);
+}
+
+/* set bits of the `bits` bits at `pos`, all of them in the buffer. */
+static uint64_t BitStreamCountRange(uint8_t const *bytes, size_t pos, size_t bits, BSBitOrder order) {
+    uint8_t const *p = bytes + (pos >> 3);
+    size_t lo = pos & 0x7;
+    size_t n;
+    uint64_t ones = 0;
+
+    if (bits == 0)
+        return 0;
+    if (lo) {
+        n = 8 - lo < bits ? 8 - lo : bits;
+        ones += BitStreamPopCount64(*p++ & BitStreamByteMask(lo, lo + n, order));
+        bits -= n;
+    }
+    ones += BitStreamBitmapKernels()->_M_count(p, bits >> 3);
+    p += bits >> 3;
+    if (bits & 0x7)
+        ones += BitStreamPopCount64(*p & BitStreamByteMask(0, bits & 0x7, order));
+    return ones;
+}
+
+/* position of the first bit equal to `value` in [pos, end), `end` for none. */
+static size_t BitStreamFindRange(uint8_t const *bytes, size_t pos, size_t end, int value, BSBitOrder order) {
+    BSSkipKernel skip = BitStreamBitmapKernels()->_M_skip;
+    uint8_t fill = value ? 0x00 : 0xff;
+    size_t lo;
+    size_t hi;
+    unsigned x;
+
+    while (pos < end) {
+        if (!(pos & 0x7) && end - pos >= 8) {
+            /* whole bytes without such a bit. */
+            pos += skip(bytes + (pos >> 3), (end - pos) >> 3, fill) << 3;
+            if (pos >= end)
+                break;
+        }
+        lo = pos & 0x7;
+        hi = end - (pos - lo) < 8 ? end - (pos - lo) : 8;
+        x = (bytes[pos >> 3] ^ fill) & BitStreamByteMask(lo, hi, order);
+        if (x)
+            return pos - lo + BitStreamFirstInByte(x, order);
+        pos += hi - lo;
+    }
+    return end;
+}
+
+/**
+ * Set bits among the next `bits` bits, which the cursor moves past. An in
+ * memory stream with fewer bits left fails with EOS and stays put. A source
+ * backed one goes window by window, the value counts the bits read before
+ * an EOS.
+ */
+ReadResult BitInputStreamCountOnes(BitInputStream *bis, size_t bits) {
+    ReadResult result;
+    size_t n;
+
+    result._M_status = BS_SUCCESS;
+    result._M_value.uint = 0;
+    BS_STAT_INC(bulk_calls);
+    bis->_M_cache_bits = 0;
+    if (!BitInputStreamHasReader(bis)) {
+        if (bits > bis->_M_size - bis->_M_position) {
+            BS_STAT_INC(eos);
+            result._M_status = BS_EOS;
+            return result;
+        }
+        BS_STAT_ADD(bits_read, bits);
+        result._M_value.uint = BitStreamCountRange(bis->_M_bytes, bis->_M_position, bits, bis->_M_order);
+        bis->_M_position += bits;
+        return result;
+    }
+    while (bits > 0) {
+        if (bis->_M_position == bis->_M_size && !BitInputStreamFill(bis, 1)) {
+            BS_STAT_INC(eos);
+            result._M_status = BS_EOS;
+            break;
+        }
+        n = bis->_M_size - bis->_M_position < bits ? bis->_M_size - bis->_M_position : bits;
+        BS_STAT_ADD(bits_read, n);
+        result._M_value.uint += BitStreamCountRange(bis->_M_bytes, bis->_M_position, n, bis->_M_order);
+        bis->_M_position += n;
+        bis->_M_cache_bits = 0;
+        bits -= n;
+    }
+    return result;
+}
+
+/**
+ * Moves the cursor to the next bit equal to `value`, the value of the
+ * result being the number of bits skipped. Without one, EOS with the
+ * cursor at the end of the data.
+ */
+static ReadResult BitInputStreamFindNext(BitInputStream *bis, int value) {
+    ReadResult result;
+    size_t start = bis->_M_base + bis->_M_position;
+
+    result._M_status = BS_SUCCESS;
+    BS_STAT_INC(bulk_calls);
+    bis->_M_cache_bits = 0;
+    for (;;) {
+        bis->_M_position = BitStreamFindRange(bis->_M_bytes, bis->_M_position, bis->_M_size, value, bis->_M_order);
+        bis->_M_cache_bits = 0;
+        if (bis->_M_position < bis->_M_size)
+            break;
+        if (!BitInputStreamFill(bis, 1)) {
+            BS_STAT_INC(eos);
+            result._M_status = BS_EOS;
+            break;
+        }
+    }
+    result._M_value.uint = bis->_M_base + bis->_M_position - start;
+    return result;
+}
+
+ReadResult BitInputStreamFindNextSet(BitInputStream *bis) {
+    return BitInputStreamFindNext(bis, 1);
+}
+
+ReadResult BitInputStreamFindNextClear(BitInputStream *bis) {
+    return BitInputStreamFindNext(bis, 0);
+}
+
+struct tagBSRankIndex {
+    uint8_t const *_M_bytes;
+    size_t _M_bits;
+    BSBitOrder _M_order;
+    /* ones before every superblock, and before every block inside its superblock. */
+    uint64_t *_M_supers;
+    uint16_t *_M_blocks;
+    size_t _M_super_count;
+    size_t _M_ones;
+    /* superblocks holding every BS_RANK_SAMPLE-th one, and zero. */
+    size_t *_M_samples[2];
+    size_t _M_sample_count[2];
+};
+
+/* word `w` with its first bit most significant MSB first, least significant LSB first, zeros past the end. */
+BS_INLINE uint64_t BitStreamRankWord(BSRankIndex const *index, size_t w) {
+    size_t nbytes = (index->_M_bits + 7) >> 3;
+    size_t valid = index->_M_bits - (w << 6);
+    uint64_t word;
+
+    if (index->_M_order == BS_LSB_FIRST) {
+        word = BitStreamLoadWindowLE(index->_M_bytes, nbytes, w << 3);
+        return valid >= 64 ? word : word & (((uint64_t) 1 << valid) - 1);
+    }
+    word = BitStreamLoadWindow(index->_M_bytes, nbytes, w << 3);
+    return valid >= 64 ? word : word & ~(~(uint64_t) 0 >> valid);
+}
+
+/* ones among the first `n` bits of a word, n = 0..63. */
+BS_INLINE size_t BitStreamRankPrefix(uint64_t word, size_t n, BSBitOrder order) {
+    if (n == 0)
+        return 0;
+    if (order == BS_LSB_FIRST)
+        return BitStreamPopCount64(word & (((uint64_t) 1 << n) - 1));
+    return BitStreamPopCount64(word >> (64 - n));
+}
+
+/* offset of the `k`-th set bit of a word, in stream order, k below its count. */
+static size_t BitStreamSelectInWord(uint64_t word, size_t k, BSBitOrder order) {
+    size_t offset = 0;
+    size_t ones;
+
+    /* a byte at a time, then a bit at a time. */
+    for (;; offset += 8) {
+        ones = BitStreamPopCount64(order == BS_LSB_FIRST ? (word >> offset) & 0xff : (word << offset) >> 56);
+        if (k < ones)
+            break;
+        k -= ones;
+    }
+    if (order == BS_LSB_FIRST) {
+        word >>= offset;
+        for (; k > 0; --k)
+            word &= word - 1;
+        return offset + BitStreamCountTrailingZeros64(word);
+    }
+    word <<= offset;
+    for (; k > 0; --k)
+        word &= ~(uint64_t) 0 >> (BitStreamCountLeadingZeros64(word) + 1);
+    return offset + BitStreamCountLeadingZeros64(word);
+}
+
+/* ones, or zeros, before superblock `s` and before block `b`. */
+BS_INLINE size_t BitStreamRankSuper(BSRankIndex const *index, size_t s, int value) {
+    return value ? index->_M_supers[s] : s * BS_RANK_SUPER_BITS - index->_M_supers[s];
+}
+
+BS_INLINE size_t BitStreamRankBlock(BSRankIndex const *index, size_t b, int value) {
+    size_t inside = (b % BS_RANK_BLOCKS_PER_SUPER) * BS_RANK_BLOCK_BITS;
+
+    return value ? index->_M_blocks[b] : inside - index->_M_blocks[b];
+}
+
+static int BitStreamRankIndexSample(BSRankIndex *index) {
+    size_t count[2];
+    size_t next[2] = { 0, 0 };
+    size_t value;
+    size_t s;
+
+    count[1] = index->_M_ones / BS_RANK_SAMPLE + 1;
+    count[0] = (index->_M_bits - index->_M_ones) / BS_RANK_SAMPLE + 1;
+    for (value = 0; value < 2; ++value) {
+        if (!(index->_M_samples[value] = (size_t*) malloc(count[value] * sizeof(size_t))))
+            return -1;
+    }
+    /* the last superblock which starts at or before the sampled bit. */
+    for (s = 0; s < index->_M_super_count; ++s) {
+        for (value = 0; value < 2; ++value) {
+            while (next[value] < count[value]
+                    && (s + 1 == index->_M_super_count
+                        || BitStreamRankSuper(index, s + 1, (int) value) > next[value] * BS_RANK_SAMPLE))
+                index->_M_samples[value][next[value]++] = s;
+        }
+    }
+    index->_M_sample_count[0] = next[0];
+    index->_M_sample_count[1] = next[1];
+    return 0;
+}
+
+/**
+ * Index over the buffer of an in memory input stream, which has to
+ * outlive the index. NULL for a source backed stream.
+ */
+BSRankIndex* BitStreamRankIndexCreate(BitInputStream const *bis) {
+    BSRankIndex *index;
+    size_t blocks;
+    size_t b;
+    size_t w;
+    size_t ones = 0;
+    size_t inside = 0;
+
+    if (BitInputStreamHasReader(bis))
+        return NULL;
+    if (!(index = (BSRankIndex*) calloc(1, sizeof(BSRankIndex))))
+        return NULL;
+    index->_M_bytes = bis->_M_bytes;
+    index->_M_bits = bis->_M_size;
+    index->_M_order = bis->_M_order;
+    /* one entry more for a rank at the very end. */
+    index->_M_super_count = index->_M_bits / BS_RANK_SUPER_BITS + 1;
+    blocks = index->_M_bits / BS_RANK_BLOCK_BITS + 1;
+    index->_M_supers = (uint64_t*) malloc(index->_M_super_count * sizeof(uint64_t));
+    index->_M_blocks = (uint16_t*) malloc(blocks * sizeof(uint16_t));
+    if (!index->_M_supers || !index->_M_blocks) {
+        BitStreamRankIndexDestroy(index);
+        return NULL;
+    }
+    for (b = 0; b < blocks; ++b) {
+        if (b % BS_RANK_BLOCKS_PER_SUPER == 0) {
+            index->_M_supers[b / BS_RANK_BLOCKS_PER_SUPER] = ones;
+            inside = 0;
+        }
+        index->_M_blocks[b] = (uint16_t) inside;
+        for (w = b * (BS_RANK_BLOCK_BITS / 64); w < (b + 1) * (BS_RANK_BLOCK_BITS / 64) && (w << 6) < index->_M_bits; ++w)
+            inside += BitStreamPopCount64(BitStreamRankWord(index, w));
+        ones += inside - index->_M_blocks[b];
+    }
+    index->_M_ones = ones;
+    if (BitStreamRankIndexSample(index) != 0) {
+        BitStreamRankIndexDestroy(index);
+        return NULL;
+    }
+    return index;
+}
+
+void BitStreamRankIndexDestroy(BSRankIndex *index) {
+    if (!index)
+        return;
+    free(index->_M_supers);
+    free(index->_M_blocks);
+    free(index->_M_samples[0]);
+    free(index->_M_samples[1]);
+    free(index);
+}
+
+size_t BitStreamRankIndexGetOnes(BSRankIndex const *index) {
+    return index->_M_ones;
+}
+
+/* set bits before position `pos`, up to the size of the buffer. */
+size_t BitStreamRankIndexRank1(BSRankIndex const *index, size_t pos) {
+    size_t rank;
+    size_t w;
+
+    if (pos > index->_M_bits)
+        pos = index->_M_bits;
+    rank = index->_M_supers[pos / BS_RANK_SUPER_BITS] + index->_M_blocks[pos / BS_RANK_BLOCK_BITS];
+    /* the whole words of the block, in either order. */
+    w = pos / BS_RANK_BLOCK_BITS * (BS_RANK_BLOCK_BITS / 64);
+    if ((pos >> 6) > w)
+        rank += BitStreamBitmapKernels()->_M_count(index->_M_bytes + (w << 3), ((pos >> 6) - w) << 3);
+    if (pos & 0x3f)
+        rank += BitStreamRankPrefix(BitStreamRankWord(index, pos >> 6), pos & 0x3f, index->_M_order);
+    return rank;
+}
+
+size_t BitStreamRankIndexRank0(BSRankIndex const *index, size_t pos) {
+    if (pos > index->_M_bits)
+        pos = index->_M_bits;
+    return pos - BitStreamRankIndexRank1(index, pos);
+}
+
+static size_t BitStreamRankIndexSelect(BSRankIndex const *index, size_t k, int value) {
+    size_t lo;
+    size_t hi;
+    size_t mid;
+    size_t b;
+    size_t w;
+    size_t ones;
+    uint64_t word;
+
+    if (k >= (value ? index->_M_ones : index->_M_bits - index->_M_ones))
+        return (size_t) -1;
+    /* the last superblock starting with at most k of them, between two samples. */
+    lo = index->_M_samples[value][k / BS_RANK_SAMPLE];
+    hi = k / BS_RANK_SAMPLE + 1 < index->_M_sample_count[value]
+        ? index->_M_samples[value][k / BS_RANK_SAMPLE + 1] : index->_M_super_count - 1;
+    while (lo < hi) {
+        mid = lo + (hi - lo + 1) / 2;
+        if (BitStreamRankSuper(index, mid, value) <= k)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    k -= BitStreamRankSuper(index, lo, value);
+    /* then the last block. */
+    b = lo * BS_RANK_BLOCKS_PER_SUPER;
+    hi = b + BS_RANK_BLOCKS_PER_SUPER - 1;
+    if (hi > index->_M_bits / BS_RANK_BLOCK_BITS)
+        hi = index->_M_bits / BS_RANK_BLOCK_BITS;
+    lo = b;
+    while (lo < hi) {
+        mid = lo + (hi - lo + 1) / 2;
+        if (BitStreamRankBlock(index, mid, value) <= k)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    k -= BitStreamRankBlock(index, lo, value);
+    /* and the word. */
+    for (w = lo * (BS_RANK_BLOCK_BITS / 64);; ++w) {
+        word = BitStreamRankWord(index, w);
+        if (!value) {
+            word = ~word;
+            if (index->_M_bits - (w << 6) < 64)
+                word = index->_M_order == BS_LSB_FIRST
+                    ? word & (((uint64_t) 1 << (index->_M_bits - (w << 6))) - 1)
+                    : word & ~(~(uint64_t) 0 >> (index->_M_bits - (w << 6)));
+        }
+        ones = BitStreamPopCount64(word);
+        if (k < ones)
+            return (w << 6) + BitStreamSelectInWord(word, k, index->_M_order);
+        k -= ones;
+    }
+}
+
+/* position of the set bit of rank `k`, counting from 0, (size_t) -1 past the last one. */
+size_t BitStreamRankIndexSelect1(BSRankIndex const *index, size_t k) {
+    return BitStreamRankIndexSelect(index, k, 1);
+}
+
+size_t BitStreamRankIndexSelect0(BSRankIndex const *index, size_t k) {
+    return BitStreamRankIndexSelect(index, k, 0);
+}
@@ -0,0 +1,616 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Record codecs compiled from a runtime schema.
+ *
+ * A schema is compiled once into groups: runs of adjacent fields, padding
+ * included, which fit in one 57 bits window and so come out of a single
+ * load, or go in with a single accumulator write. Every field keeps the
+ * shifts which take it out of its group in either bit order. Padding too
+ * long for a group becomes groups of its own which carry no field.
+ *
+ * Reads load straight from the buffer rather than through the cached
+ * window of the stream. Byte aligned records on a byte aligned cursor go
+ * through a fast path whose loads have the byte and shift of every group
+ * precomputed and, away from the end of the buffer, no bounds check.
+ */
+
+#define BS_SCHEMA_GROUP_BITS 57
+
+/* targets of up to this many fields live on the stack. */
+#define BS_SCHEMA_STACK_FIELDS 32
+
+typedef struct tagBSSchemaField {
+    BSFieldKind _M_kind;
+    size_t _M_bits;
+    size_t _M_size;
+    size_t _M_offset;
+    uint64_t _M_mask;
+    /* right shift of the field in the value of its group, by bit order. */
+    size_t _M_shift[2];
+} BSSchemaField;
+
+typedef struct tagBSSchemaGroup {
+    size_t _M_start;
+    size_t _M_bits;
+    size_t _M_first;
+    size_t _M_count;
+} BSSchemaGroup;
+
+struct tagBSSchema {
+    BSSchemaGroup *_M_groups;
+    size_t _M_group_count;
+    BSSchemaField *_M_fields;
+    size_t _M_field_count;
+    size_t _M_bits;
+};
+
+/* where the values of a field go, or come from, record after record. */
+typedef struct tagBSSchemaTarget {
+    uint8_t *_M_base;
+    size_t _M_stride;
+} BSSchemaTarget;
+
+BS_INLINE uint64_t BitStreamSchemaMask(size_t bits) {
+    return bits >= 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << bits) - 1;
+}
+
+static int BitStreamSchemaCheckField(BSField const *field) {
+    switch (field->_M_kind) {
+    case BS_FIELD_PAD:
+        return field->_M_bits > 0;
+    case BS_FIELD_SINT:
+        if (field->_M_bits < 2)
+            return 0;
+        /* fall through */
+    case BS_FIELD_UINT:
+    case BS_FIELD_INT:
+        if (field->_M_bits == 0 || field->_M_bits > 64)
+            return 0;
+        if (field->_M_size != 1 && field->_M_size != 2 && field->_M_size != 4 && field->_M_size != 8)
+            return 0;
+        return field->_M_bits <= field->_M_size * 8;
+    }
+    return 0;
+}
+
+/* closes the open group, if any, and opens an empty one at `start`. */
+static void BitStreamSchemaOpenGroup(BSSchema *schema, size_t start) {
+    BSSchemaGroup *group = schema->_M_groups + schema->_M_group_count;
+
+    if (schema->_M_group_count > 0 && schema->_M_groups[schema->_M_group_count - 1]._M_bits == 0)
+        --group;
+    else
+        ++schema->_M_group_count;
+    group->_M_start = start;
+    group->_M_bits = 0;
+    group->_M_first = schema->_M_field_count;
+    group->_M_count = 0;
+}
+
+/**
+ * Compiles `count` fields, in stream order, into a schema. NULL for an
+ * invalid field: value fields are 1..64 bits wide, sign and magnitude ones
+ * at least 2, and go to members of 1, 2, 4 or 8 bytes which hold them,
+ * padding is at least 1 bit.
+ */
+BSSchema* BitStreamSchemaCreate(BSField const *fields, size_t count) {
+    BSSchema *schema;
+    BSSchemaGroup *group;
+    BSSchemaField *field;
+    size_t groups = 0;
+    size_t start = 0;
+    size_t bits;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < count; ++i) {
+        if (!BitStreamSchemaCheckField(fields + i))
+            return NULL;
+        /* the most groups there can be, a long padding splits into 64 bits ones. */
+        groups += fields[i]._M_kind == BS_FIELD_PAD ? fields[i]._M_bits / 64 + 2 : 1;
+    }
+    if (!(schema = (BSSchema*) calloc(1, sizeof(BSSchema))))
+        return NULL;
+    schema->_M_groups = (BSSchemaGroup*) calloc(groups + 1, sizeof(BSSchemaGroup));
+    schema->_M_fields = (BSSchemaField*) calloc(count + 1, sizeof(BSSchemaField));
+    if (!schema->_M_groups || !schema->_M_fields) {
+        BitStreamSchemaDestroy(schema);
+        return NULL;
+    }
+
+    BitStreamSchemaOpenGroup(schema, 0);
+    for (i = 0; i < count; ++i) {
+        group = schema->_M_groups + schema->_M_group_count - 1;
+        bits = fields[i]._M_bits;
+        if (fields[i]._M_kind == BS_FIELD_PAD) {
+            if (group->_M_bits + bits <= BS_SCHEMA_GROUP_BITS) {
+                group->_M_bits += bits;
+                start += bits;
+                continue;
+            }
+            /* too long to merge, skipped in groups of its own. */
+            BitStreamSchemaOpenGroup(schema, start);
+            for (; bits > 0; bits -= group->_M_bits) {
+                group = schema->_M_groups + schema->_M_group_count - 1;
+                group->_M_bits = bits < 64 ? bits : 64;
+                start += group->_M_bits;
+                BitStreamSchemaOpenGroup(schema, start);
+            }
+            continue;
+        }
+        if (group->_M_bits > 0 && group->_M_bits + bits > BS_SCHEMA_GROUP_BITS) {
+            BitStreamSchemaOpenGroup(schema, start);
+            group = schema->_M_groups + schema->_M_group_count - 1;
+        }
+        field = schema->_M_fields + schema->_M_field_count++;
+        field->_M_kind = fields[i]._M_kind;
+        field->_M_bits = bits;
+        field->_M_size = fields[i]._M_size;
+        field->_M_offset = fields[i]._M_offset;
+        field->_M_mask = BitStreamSchemaMask(bits);
+        field->_M_shift[BS_LSB_FIRST] = group->_M_bits;
+        group->_M_bits += bits;
+        ++group->_M_count;
+        start += bits;
+        /* a field wider than a window fills a group on its own. */
+        if (group->_M_bits > BS_SCHEMA_GROUP_BITS)
+            BitStreamSchemaOpenGroup(schema, start);
+    }
+    if (schema->_M_groups[schema->_M_group_count - 1]._M_bits == 0)
+        --schema->_M_group_count;
+    for (i = 0; i < schema->_M_group_count; ++i) {
+        group = schema->_M_groups + i;
+        for (j = 0; j < group->_M_count; ++j) {
+            field = schema->_M_fields + group->_M_first + j;
+            field->_M_shift[BS_MSB_FIRST] = group->_M_bits - field->_M_shift[BS_LSB_FIRST] - field->_M_bits;
+        }
+    }
+    schema->_M_bits = start;
+    return schema;
+}
+
+void BitStreamSchemaDestroy(BSSchema *schema) {
+    if (!schema)
+        return;
+    free(schema->_M_groups);
+    free(schema->_M_fields);
+    free(schema);
+}
+
+/* bits of one record. */
+size_t BitStreamSchemaGetBits(BSSchema const *schema) {
+    return schema->_M_bits;
+}
+
+/* value fields, padding excluded, the number of columns. */
+size_t BitStreamSchemaGetFieldCount(BSSchema const *schema) {
+    return schema->_M_field_count;
+}
+
+/* 1..64 bits at bit `pos`, MSB first. */
+BS_INLINE uint64_t BitStreamSchemaExtractMsb(uint8_t const *bytes, size_t nbytes, size_t pos, size_t bits) {
+    size_t s = pos & 0x7;
+    uint64_t v = BitStreamLoadWindow(bytes, nbytes, pos >> 3) << s;
+
+    if (bits + s > 64)
+        v |= (BitStreamLoadWindow(bytes, nbytes, (pos >> 3) + 8) >> 56) >> (8 - s);
+    return v >> (64 - bits);
+}
+
+BS_INLINE uint64_t BitStreamSchemaLoadMember(uint8_t const *p, size_t size, int sign) {
+    uint8_t u8;
+    uint16_t u16;
+    uint32_t u32;
+    uint64_t u64;
+
+    switch (size) {
+    case 1:
+        u8 = *p;
+        return sign ? (uint64_t) (int64_t) (int8_t) u8 : u8;
+    case 2:
+        memcpy(&u16, p, 2);
+        return sign ? (uint64_t) (int64_t) (int16_t) u16 : u16;
+    case 4:
+        memcpy(&u32, p, 4);
+        return sign ? (uint64_t) (int64_t) (int32_t) u32 : u32;
+    default:
+        memcpy(&u64, p, 8);
+        return u64;
+    }
+}
+
+BS_INLINE void BitStreamSchemaStoreMember(uint8_t *p, size_t size, uint64_t v) {
+    uint16_t u16;
+    uint32_t u32;
+
+    switch (size) {
+    case 1:
+        *p = (uint8_t) v;
+        break;
+    case 2:
+        u16 = (uint16_t) v;
+        memcpy(p, &u16, 2);
+        break;
+    case 4:
+        u32 = (uint32_t) v;
+        memcpy(p, &u32, 4);
+        break;
+    default:
+        memcpy(p, &v, 8);
+        break;
+    }
+}
+
+/**
+ * The value of a field out of the bits it was stored in, signed ones
+ * sign extended. Sign and magnitude fields start with their sign bit,
+ * which ends up in the most significant bit MSB first and in the least
+ * significant one LSB first.
+ */
+BS_INLINE uint64_t BitStreamSchemaDecodeValue(BSSchemaField const *field, uint64_t v, BSBitOrder order) {
+    uint64_t sign;
+    uint64_t magnitude;
+
+    switch (field->_M_kind) {
+    case BS_FIELD_INT:
+        sign = (uint64_t) 1 << (field->_M_bits - 1);
+        return (v ^ sign) - sign;
+    case BS_FIELD_SINT:
+        if (order == BS_LSB_FIRST) {
+            sign = v & 0x1;
+            magnitude = v >> 1;
+        } else {
+            sign = v >> (field->_M_bits - 1);
+            magnitude = v & BitStreamSchemaMask(field->_M_bits - 1);
+        }
+        return sign ? (uint64_t) 0 - magnitude : magnitude;
+    default:
+        return v;
+    }
+}
+
+BS_INLINE uint64_t BitStreamSchemaEncodeValue(BSSchemaField const *field, uint64_t v, BSBitOrder order) {
+    uint64_t magnitude;
+    int negative;
+
+    if (field->_M_kind != BS_FIELD_SINT)
+        return v & field->_M_mask;
+    negative = (int64_t) v < 0;
+    magnitude = (negative ? (uint64_t) 0 - v : v) & BitStreamSchemaMask(field->_M_bits - 1);
+    if (order == BS_LSB_FIRST)
+        return (magnitude << 1) | (uint64_t) negative;
+    return ((uint64_t) negative << (field->_M_bits - 1)) | magnitude;
+}
+
+/* splits the value of a group into the fields of record `i`. */
+BS_INLINE void BitStreamSchemaScatter(BSSchema const *schema, BSSchemaGroup const *group,
+        BSSchemaTarget const *targets, size_t i, uint64_t g, BSBitOrder order) {
+    BSSchemaField const *field = schema->_M_fields + group->_M_first;
+    BSSchemaTarget const *target = targets + group->_M_first;
+    size_t k;
+    uint64_t v;
+
+    for (k = 0; k < group->_M_count; ++k, ++field, ++target) {
+        v = (g >> field->_M_shift[order]) & field->_M_mask;
+        BitStreamSchemaStoreMember(target->_M_base + i * target->_M_stride, field->_M_size,
+                BitStreamSchemaDecodeValue(field, v, order));
+    }
+}
+
+/* the general path, any cursor, every load bounded. */
+static void BitStreamSchemaDecodeBits(BSSchema const *schema, uint8_t const *bytes, size_t nbytes,
+        size_t pos, size_t first, size_t count, BSSchemaTarget const *targets, BSBitOrder order) {
+    BSSchemaGroup const *group;
+    size_t i;
+    size_t k;
+    uint64_t g;
+
+    for (i = first; i < first + count; ++i, pos += schema->_M_bits) {
+        for (k = 0, group = schema->_M_groups; k < schema->_M_group_count; ++k, ++group) {
+            if (group->_M_count == 0)
+                continue;
+            if (order == BS_LSB_FIRST)
+                g = BitStreamExtractLsb(bytes, nbytes, pos + group->_M_start, group->_M_bits);
+            else
+                g = BitStreamSchemaExtractMsb(bytes, nbytes, pos + group->_M_start, group->_M_bits);
+            BitStreamSchemaScatter(schema, group, targets, i, g, order);
+        }
+    }
+}
+
+/**
+ * Byte aligned records from a byte aligned cursor: a group is one word
+ * load at a fixed byte of the record, shifted by a fixed amount. Groups
+ * past 57 bits and the records near the end of the buffer take the
+ * general path.
+ */
+static void BitStreamSchemaDecodeAligned(BSSchema const *schema, uint8_t const *bytes, size_t nbytes,
+        size_t pos, size_t count, BSSchemaTarget const *targets, BSBitOrder order) {
+    BSSchemaGroup const *group;
+    uint8_t const *record = bytes + (pos >> 3);
+    size_t rbytes = schema->_M_bits >> 3;
+    size_t safe;
+    size_t i;
+    size_t k;
+    uint64_t g;
+
+    /* records whose loads all stay in the buffer, the widest ends 9 bytes after its record. */
+    safe = nbytes - (pos >> 3) >= rbytes + 9 ? (nbytes - (pos >> 3) - 9) / rbytes : 0;
+    if (safe > count)
+        safe = count;
+    for (i = 0; i < safe; ++i, record += rbytes) {
+        for (k = 0, group = schema->_M_groups; k < schema->_M_group_count; ++k, ++group) {
+            if (group->_M_count == 0)
+                continue;
+            if (BS_UNLIKELY(group->_M_bits > BS_SCHEMA_GROUP_BITS)) {
+                g = order == BS_LSB_FIRST
+                    ? BitStreamExtractLsb(bytes, nbytes, pos + i * schema->_M_bits + group->_M_start, group->_M_bits)
+                    : BitStreamSchemaExtractMsb(bytes, nbytes, pos + i * schema->_M_bits + group->_M_start,
+                            group->_M_bits);
+            } else if (order == BS_LSB_FIRST) {
+                g = (BitStreamLoadLE64(record + (group->_M_start >> 3)) >> (group->_M_start & 0x7))
+                    & BitStreamSchemaMask(group->_M_bits);
+            } else {
+                g = (BitStreamLoadBE64(record + (group->_M_start >> 3)) << (group->_M_start & 0x7))
+                    >> (64 - group->_M_bits);
+            }
+            BitStreamSchemaScatter(schema, group, targets, i, g, order);
+        }
+    }
+    BitStreamSchemaDecodeBits(schema, bytes, nbytes, pos + safe * schema->_M_bits, safe, count - safe,
+            targets, order);
+}
+
+/* decodes `count` records which are all in the buffer, from the cursor on. */
+static void BitInputStreamDecodeRecords(BitInputStream *bis, BSSchema const *schema, size_t count,
+        BSSchemaTarget const *targets) {
+    size_t nbytes = (bis->_M_size + 7) >> 3;
+    size_t pos = bis->_M_position;
+
+    if (!(schema->_M_bits & 0x7) && !(pos & 0x7))
+        BitStreamSchemaDecodeAligned(schema, bis->_M_bytes, nbytes, pos, count, targets, bis->_M_order);
+    else
+        BitStreamSchemaDecodeBits(schema, bis->_M_bytes, nbytes, pos, 0, count, targets, bis->_M_order);
+    bis->_M_position = pos + count * schema->_M_bits;
+    bis->_M_cache_bits = 0;
+}
+
+/**
+ * Targets are rebased for every window so that record 0 of a window is
+ * the first one it holds.
+ */
+static void BitStreamSchemaAdvanceTargets(BSSchemaTarget *targets, size_t n, size_t records) {
+    size_t k;
+
+    for (k = 0; k < n; ++k)
+        targets[k]._M_base += records * targets[k]._M_stride;
+}
+
+/**
+ * In memory streams read all of the records or none of them. Source
+ * backed ones go window by window, the records before an EOS are read and
+ * counted in the result, a record has to fit in the window.
+ */
+static ReadResult BitInputStreamReadSchema(BitInputStream *bis, BSSchema const *schema, size_t count,
+        BSSchemaTarget *targets) {
+    ReadResult result;
+    size_t done = 0;
+    size_t n;
+
+    result._M_status = BS_SUCCESS;
+    result._M_value.uint = count;
+    BS_STAT_INC(bulk_calls);
+    if (schema->_M_bits == 0 || count == 0)
+        return result;
+    if (!BitInputStreamHasReader(bis)) {
+        if (count > (bis->_M_size - bis->_M_position) / schema->_M_bits) {
+            BS_STAT_INC(eos);
+            result._M_status = BS_EOS;
+            result._M_value.uint = 0;
+        } else {
+            BS_STAT_ADD(bits_read, count * schema->_M_bits);
+            BitInputStreamDecodeRecords(bis, schema, count, targets);
+        }
+        return result;
+    }
+    while (done < count) {
+        n = (bis->_M_size - bis->_M_position) / schema->_M_bits;
+        if (n == 0) {
+            if (!BitInputStreamFill(bis, schema->_M_bits)) {
+                BS_STAT_INC(eos);
+                result._M_status = BS_EOS;
+                break;
+            }
+            continue;
+        }
+        if (n > count - done)
+            n = count - done;
+        BS_STAT_ADD(bits_read, n * schema->_M_bits);
+        BitInputStreamDecodeRecords(bis, schema, n, targets);
+        BitStreamSchemaAdvanceTargets(targets, schema->_M_field_count, n);
+        done += n;
+    }
+    result._M_value.uint = done;
+    return result;
+}
+
+/**
+ * Encodes `count` records, the stream has room for them. Groups go into
+ * the accumulator of the stream, held in registers for the whole call.
+ */
+BS_INLINE void BitStreamSchemaEncode(BitOutputStream *bos, BSSchema const *schema, size_t count,
+        BSSchemaTarget const *targets, BSBitOrder order) {
+    BSSchemaGroup const *group;
+    BSSchemaField const *field;
+    BSSchemaTarget const *target;
+    uint64_t cache = bos->_M_cache;
+    size_t nbits = bos->_M_cache_bits;
+    uint8_t *p = bos->_M_bytes + ((bos->_M_position - nbits) >> 3);
+    size_t i;
+    size_t k;
+    size_t j;
+    uint64_t g;
+    uint64_t v;
+
+    for (i = 0; i < count; ++i) {
+        for (k = 0, group = schema->_M_groups; k < schema->_M_group_count; ++k, ++group) {
+            g = 0;
+            field = schema->_M_fields + group->_M_first;
+            target = targets + group->_M_first;
+            for (j = 0; j < group->_M_count; ++j, ++field, ++target) {
+                v = BitStreamSchemaLoadMember(target->_M_base + i * target->_M_stride, field->_M_size,
+                        field->_M_kind != BS_FIELD_UINT);
+                g |= BitStreamSchemaEncodeValue(field, v, order) << field->_M_shift[order];
+            }
+            if (order == BS_LSB_FIRST)
+                BitStreamAccumulateLsb(&cache, &nbits, &p, group->_M_bits, g);
+            else
+                BitStreamAccumulate(&cache, &nbits, &p, group->_M_bits, g);
+        }
+    }
+    bos->_M_cache = cache;
+    bos->_M_cache_bits = nbits;
+    bos->_M_position += count * schema->_M_bits;
+}
+
+/* one copy of the loops per bit order, the order checks fold away. */
+static void BitOutputStreamEncodeRecords(BitOutputStream *bos, BSSchema const *schema, size_t count,
+        BSSchemaTarget const *targets) {
+    if (bos->_M_order == BS_LSB_FIRST)
+        BitStreamSchemaEncode(bos, schema, count, targets, BS_LSB_FIRST);
+    else
+        BitStreamSchemaEncode(bos, schema, count, targets, BS_MSB_FIRST);
+}
+
+/**
+ * In memory streams grow once for the whole array. Sink backed ones go
+ * buffer by buffer, a failing sink leaves the records before it written.
+ */
+static WriteResult BitOutputStreamWriteSchema(BitOutputStream *bos, BSSchema const *schema, size_t count,
+        BSSchemaTarget *targets) {
+    WriteResult result = { BS_SUCCESS };
+    size_t done = 0;
+    size_t n;
+
+    BS_STAT_INC(bulk_calls);
+    if (schema->_M_bits == 0 || count == 0)
+        return result;
+    if (count > ((size_t) -1 - bos->_M_position) / schema->_M_bits) {
+        BS_STAT_INC(failures);
+        result._M_status = BS_FAIL;
+        return result;
+    }
+    if (!bos->_M_sink) {
+        if (BitOutputStreamReserve(bos, count * schema->_M_bits) != 0) {
+            BS_STAT_INC(failures);
+            result._M_status = BS_FAIL;
+        } else {
+            BS_STAT_ADD(bits_written, count * schema->_M_bits);
+            BitOutputStreamEncodeRecords(bos, schema, count, targets);
+        }
+        return result;
+    }
+    while (done < count) {
+        n = (bos->_M_size - bos->_M_position) / schema->_M_bits;
+        if (n == 0) {
+            if (BitOutputStreamDrainSink(bos, schema->_M_bits) != 0) {
+                BS_STAT_INC(failures);
+                result._M_status = BS_FAIL;
+                break;
+            }
+            continue;
+        }
+        if (n > count - done)
+            n = count - done;
+        BS_STAT_ADD(bits_written, n * schema->_M_bits);
+        BitOutputStreamEncodeRecords(bos, schema, n, targets);
+        BitStreamSchemaAdvanceTargets(targets, schema->_M_field_count, n);
+        done += n;
+    }
+    return result;
+}
+
+/* targets of the rows of a struct array, or of column arrays when `columns` is not NULL. */
+static BSSchemaTarget* BitStreamSchemaTargets(BSSchema const *schema, BSSchemaTarget *stack, uint8_t *rows,
+        size_t stride, void *const *columns) {
+    BSSchemaTarget *targets = stack;
+    size_t k;
+
+    if (schema->_M_field_count > BS_SCHEMA_STACK_FIELDS
+            && !(targets = (BSSchemaTarget*) malloc(schema->_M_field_count * sizeof(BSSchemaTarget))))
+        return NULL;
+    for (k = 0; k < schema->_M_field_count; ++k) {
+        if (columns) {
+            targets[k]._M_base = (uint8_t*) columns[k];
+            targets[k]._M_stride = schema->_M_fields[k]._M_size;
+        } else {
+            targets[k]._M_base = rows + schema->_M_fields[k]._M_offset;
+            targets[k]._M_stride = stride;
+        }
+    }
+    return targets;
+}
+
+static ReadResult BitInputStreamReadTargets(BitInputStream *bis, BSSchema const *schema, size_t count,
+        uint8_t *rows, size_t stride, void *const *columns) {
+    BSSchemaTarget stack[BS_SCHEMA_STACK_FIELDS];
+    BSSchemaTarget *targets = BitStreamSchemaTargets(schema, stack, rows, stride, columns);
+    ReadResult result;
+
+    if (!targets) {
+        result._M_status = BS_FAIL;
+        result._M_value.uint = 0;
+        return result;
+    }
+    result = BitInputStreamReadSchema(bis, schema, count, targets);
+    if (targets != stack)
+        free(targets);
+    return result;
+}
+
+static WriteResult BitOutputStreamWriteTargets(BitOutputStream *bos, BSSchema const *schema, size_t count,
+        uint8_t *rows, size_t stride, void *const *columns) {
+    BSSchemaTarget stack[BS_SCHEMA_STACK_FIELDS];
+    BSSchemaTarget *targets = BitStreamSchemaTargets(schema, stack, rows, stride, columns);
+    WriteResult result = { BS_FAIL };
+
+    if (!targets)
+        return result;
+    result = BitOutputStreamWriteSchema(bos, schema, count, targets);
+    if (targets != stack)
+        free(targets);
+    return result;
+}
+
+/**
+ * `count` records into an array of structs `stride` bytes apart, every
+ * field into the member at its offset. The value of the result is the
+ * number of records read.
+ */
+ReadResult BitInputStreamReadRecords(BitInputStream *bis, BSSchema const *schema, size_t count,
+        void *records, size_t stride) {
+    return BitInputStreamReadTargets(bis, schema, count, (uint8_t*) records, stride, NULL);
+}
+
+/* `count` records scattered into one array per value field, in schema order. */
+ReadResult BitInputStreamReadColumns(BitInputStream *bis, BSSchema const *schema, size_t count,
+        void *const *columns) {
+    return BitInputStreamReadTargets(bis, schema, count, NULL, 0, columns);
+}
+
+/* the write side of BitInputStreamReadRecords, values wider than their field are masked. */
+WriteResult BitOutputStreamWriteRecords(BitOutputStream *bos, BSSchema const *schema, size_t count,
+        void const *records, size_t stride) {
+    return BitOutputStreamWriteTargets(bos, schema, count, (uint8_t*) records, stride, NULL);
+}
+
+WriteResult BitOutputStreamWriteColumns(BitOutputStream *bos, BSSchema const *schema, size_t count,
+        void const *const *columns) {
+    return BitOutputStreamWriteTargets(bos, schema, count, NULL, 0, (void *const*) columns);
+}
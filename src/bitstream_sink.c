@@ -0,0 +1,153 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define BS_HAVE_POSIX_IO 1
+#endif
+
+/**
+ * Sink backed output streams.
+ *
+ * The stream writes into a buffer of fixed capacity. When a write does not
+ * fit, the complete bytes are handed to the sink and the partial trailing
+ * byte moves to the front of the buffer. `_M_base` is the number of bits
+ * already handed over, seeking is limited to the bits still buffered.
+ */
+
+#define BS_SINK_DEFAULT_BUFFER (64 << 10)
+#define BS_SINK_MIN_BUFFER 64
+
+static size_t BitStreamWriteFd(void *context, void const *buffer, size_t n) {
+#if defined(BS_HAVE_POSIX_IO)
+    size_t done = 0;
+    ssize_t rc;
+
+    while (done < n) {
+        rc = write(*(int*) context, (uint8_t const*) buffer + done, n - done);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            break;
+        done += (size_t) rc;
+    }
+    return done;
+#else
+    (void) context;
+    (void) buffer;
+    (void) n;
+    return 0;
+#endif
+}
+
+static void BitStreamCloseSinkFd(BSSink *sink) {
+    free(sink->_M_context);
+}
+
+BitOutputStream* BitOutputStreamInitializeWithWriter(BitOutputStream *bos, BSWriteFunc writer, void *context,
+        size_t buffer) {
+    BSSink *sink;
+
+    if (!bos || !writer)
+        return NULL;
+    if (buffer == 0)
+        buffer = BS_SINK_DEFAULT_BUFFER;
+    if (buffer < BS_SINK_MIN_BUFFER)
+        buffer = BS_SINK_MIN_BUFFER;
+    if (!(sink = (BSSink*) calloc(1, sizeof(BSSink))))
+        return NULL;
+    if (!BitOutputStreamInitialize(bos, NULL, buffer << 3)) {
+        free(sink);
+        return NULL;
+    }
+    sink->_M_write = writer;
+    sink->_M_context = context;
+    sink->_M_drain = &BitOutputStreamDrainToWriter;
+    bos->_M_sink = sink;
+    return bos;
+}
+
+BitOutputStream* BitOutputStreamInitializeWithFd(BitOutputStream *bos, int fd, size_t buffer) {
+    int *context = (int*) malloc(sizeof(int));
+
+    if (!context)
+        return NULL;
+    *context = fd;
+    if (!BitOutputStreamInitializeWithWriter(bos, &BitStreamWriteFd, context, buffer)) {
+        free(context);
+        return NULL;
+    }
+    bos->_M_sink->_M_close = &BitStreamCloseSinkFd;
+    return bos;
+}
+
+void BitStreamSinkDestroy(BSSink *sink) {
+    if (!sink)
+        return;
+    if (sink->_M_close)
+        sink->_M_close(sink);
+    free(sink);
+}
+
+/**
+ * Hands the complete buffered bytes to the writer, the partial trailing
+ * byte is carried over to the front of the buffer.
+ */
+int BitOutputStreamDrainToWriter(BitOutputStream *bos, size_t bits) {
+    BSSink *sink = bos->_M_sink;
+    size_t nbytes;
+
+    (void) bits;
+    if (sink->_M_failed)
+        return -1;
+    BitOutputStreamFlush(bos);
+    nbytes = bos->_M_position >> 3;
+    if (nbytes == 0)
+        return 0;
+    if (sink->_M_write(sink->_M_context, bos->_M_bytes, nbytes) != nbytes) {
+        sink->_M_failed = 1;
+        return -1;
+    }
+    if (bos->_M_position & 0x7)
+        bos->_M_bytes[0] = bos->_M_bytes[nbytes];
+    bos->_M_position -= nbytes << 3;
+    bos->_M_base += nbytes << 3;
+    return 0;
+}
+
+/* runs the drain hook of the sink, counting what it hands over. */
+#if defined(BS_ENABLE_STATS)
+static int BitOutputStreamRunDrain(BitOutputStream *bos, size_t bits) {
+    size_t base = bos->_M_base;
+    int rc = bos->_M_sink->_M_drain(bos, bits);
+
+    BS_STAT_INC(drains);
+    BS_STAT_ADD(drain_bytes, (bos->_M_base - base) >> 3);
+    return rc;
+}
+#else
+#define BitOutputStreamRunDrain(BOS, BITS) ((BOS)->_M_sink->_M_drain((BOS), (BITS)))
+#endif
+
+int BitOutputStreamDrainSink(BitOutputStream *bos, size_t bits) {
+    if (bos->_M_position + bits <= bos->_M_size)
+        return 0;
+    if (BitOutputStreamRunDrain(bos, bits) != 0)
+        return -1;
+    return bos->_M_position + bits <= bos->_M_size ? 0 : -1;
+}
+
+WriteResult BitOutputStreamFinish(BitOutputStream *bos, int bit) {
+    WriteResult result = { BS_SUCCESS };
+
+    BitOutputStreamPaddingBits(bos, bit);
+    if (bos->_M_sink && BitOutputStreamRunDrain(bos, 0) != 0)
+        result._M_status = BS_FAIL;
+    return result;
+}
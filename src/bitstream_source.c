@@ -0,0 +1,213 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define BS_HAVE_POSIX_IO 1
+#endif
+
+/**
+ * Source backed input streams.
+ *
+ * The stream reads through a window of fixed capacity which is refilled
+ * from the source whenever a read runs past its end. `_M_bytes`,
+ * `_M_position` and `_M_size` describe the window only, `_M_base` is the
+ * number of bits that have slid out of it. Sliding keeps the bytes from
+ * the marked position on, as long as they leave room for the refill.
+ */
+
+#define BS_SOURCE_DEFAULT_WINDOW (64 << 10)
+#define BS_SOURCE_MIN_WINDOW 64
+
+static size_t BitStreamReadFd(void *context, void *buffer, size_t n) {
+#if defined(BS_HAVE_POSIX_IO)
+    ssize_t rc;
+    do {
+        rc = read(*(int*) context, buffer, n);
+    } while (rc < 0 && errno == EINTR);
+    return rc > 0 ? (size_t) rc : 0;
+#else
+    (void) context;
+    (void) buffer;
+    (void) n;
+    return 0;
+#endif
+}
+
+static size_t BitStreamReadFile(void *context, void *buffer, size_t n) {
+    return fread(buffer, 1, n, (FILE*) context);
+}
+
+static void BitStreamCloseFd(BSSource *source) {
+    free(source->_M_context);
+}
+
+BSSource* BitStreamSourceCreate(size_t capacity) {
+    BSSource *source = (BSSource*) calloc(1, sizeof(BSSource));
+    if (!source)
+        return NULL;
+    if (capacity) {
+        source->_M_window = (uint8_t*) calloc(1, capacity);
+        if (!source->_M_window) {
+            free(source);
+            return NULL;
+        }
+    }
+    source->_M_capacity = capacity;
+    return source;
+}
+
+void BitStreamSourceDestroy(BSSource *source) {
+    if (!source)
+        return;
+    if (source->_M_close)
+        source->_M_close(source);
+    free(source->_M_window);
+    free(source);
+}
+
+BitInputStream* BitInputStreamInitializeWithReader(BitInputStream *bis, BSReadFunc reader, void *context,
+        size_t window) {
+    BSSource *source;
+
+    if (!bis || !reader)
+        return NULL;
+    if (window == 0)
+        window = BS_SOURCE_DEFAULT_WINDOW;
+    if (window < BS_SOURCE_MIN_WINDOW)
+        window = BS_SOURCE_MIN_WINDOW;
+    if (!(source = BitStreamSourceCreate(window)))
+        return NULL;
+    source->_M_read = reader;
+    source->_M_context = context;
+    BitInputStreamInitialize(bis, source->_M_window, 0);
+    bis->_M_source = source;
+    bis->_M_marked_position = BS_NO_MARK;
+    return bis;
+}
+
+BitInputStream* BitInputStreamInitializeWithFd(BitInputStream *bis, int fd, size_t window) {
+    int *context = (int*) malloc(sizeof(int));
+
+    if (!context)
+        return NULL;
+    *context = fd;
+    if (!BitInputStreamInitializeWithReader(bis, &BitStreamReadFd, context, window)) {
+        free(context);
+        return NULL;
+    }
+    bis->_M_source->_M_close = &BitStreamCloseFd;
+    return bis;
+}
+
+BitInputStream* BitInputStreamInitializeWithFile(BitInputStream *bis, FILE *fp, size_t window) {
+    if (!fp)
+        return NULL;
+    return BitInputStreamInitializeWithReader(bis, &BitStreamReadFile, fp, window);
+}
+
+/**
+ * Drops the consumed bytes in front of the window, keeping the marked
+ * ones while that leaves room.
+ */
+static void BitInputStreamSlide(BitInputStream *bis) {
+    BSSource *source = bis->_M_source;
+    size_t keep = bis->_M_position;
+    size_t shift;
+
+    if (bis->_M_marked_position != BS_NO_MARK && bis->_M_marked_position < keep) {
+        if ((bis->_M_size >> 3) - (bis->_M_marked_position >> 3) < source->_M_capacity)
+            keep = bis->_M_marked_position;
+        else
+            bis->_M_marked_position = BS_NO_MARK;
+    }
+    shift = keep >> 3;
+    if (shift == 0)
+        return;
+    memmove(source->_M_window, source->_M_window + shift, (bis->_M_size >> 3) - shift);
+    shift <<= 3;
+    bis->_M_base += shift;
+    bis->_M_position -= shift;
+    bis->_M_size -= shift;
+    if (bis->_M_marked_position != BS_NO_MARK)
+        bis->_M_marked_position -= shift;
+}
+
+int BitInputStreamFill(BitInputStream *bis, size_t bits) {
+    BSSource *source = bis->_M_source;
+    size_t nbytes;
+    size_t n;
+
+    if (!source || !source->_M_read)
+        return bis->_M_position + bits <= bis->_M_size;
+    while (bis->_M_position + bits > bis->_M_size) {
+        if (source->_M_eof)
+            return 0;
+        BitInputStreamSlide(bis);
+        nbytes = bis->_M_size >> 3;
+        if (nbytes == source->_M_capacity)
+            return 0;
+        n = source->_M_read(source->_M_context, source->_M_window + nbytes, source->_M_capacity - nbytes);
+        BS_STAT_INC(fills);
+        BS_STAT_ADD(fill_bytes, n);
+        if (n == 0)
+            source->_M_eof = 1;
+        bis->_M_size += n << 3;
+    }
+    return 1;
+}
+
+/**
+ * Seeks to an absolute bit position, either inside the window or forward.
+ * A failed forward seek stays at the end of the data when the starting
+ * position has already slid out of the window.
+ */
+int BitInputStreamSeekSource(BitInputStream *bis, size_t target) {
+    size_t origin = bis->_M_base + bis->_M_position;
+    size_t step;
+
+    bis->_M_cache_bits = 0;
+    if (target < bis->_M_base)
+        return -1;
+    while (target - bis->_M_base > bis->_M_size) {
+        /* forward seek, let the window slide over the skipped part. */
+        bis->_M_position = bis->_M_size;
+        step = target - bis->_M_base - bis->_M_size;
+        if (step > 64)
+            step = 64;
+        if (!BitInputStreamFill(bis, step)) {
+            if (origin >= bis->_M_base)
+                bis->_M_position = origin - bis->_M_base;
+            return -1;
+        }
+    }
+    bis->_M_position = target - bis->_M_base;
+    return 0;
+}
+
+/**
+ * Reads the source up to its end so that the size is known, the cursor
+ * stays put unless it slid out of the window.
+ */
+void BitInputStreamDrainSource(BitInputStream *bis) {
+    size_t position = bis->_M_base + bis->_M_position;
+    size_t keep;
+
+    bis->_M_cache_bits = 0;
+    while (bis->_M_source && bis->_M_source->_M_read && !bis->_M_source->_M_eof) {
+        /* the last half window stays for seeking back from the end. */
+        keep = bis->_M_source->_M_capacity << 2;
+        bis->_M_position = bis->_M_size > keep ? bis->_M_size - keep : 0;
+        BitInputStreamFill(bis, bis->_M_size - bis->_M_position + 8);
+    }
+    if (position >= bis->_M_base)
+        bis->_M_position = position - bis->_M_base;
+    else
+        bis->_M_position = 0;
+}
@@ -0,0 +1,34 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <string.h>
+
+/**
+ * Operation counters.
+ *
+ * The counters of a thread live in thread local storage, streams carry
+ * nothing, so that the layout of the streams stays the same with or
+ * without them. A snapshot is a copy of the counters of the calling
+ * thread only.
+ */
+
+#if defined(BS_ENABLE_STATS)
+BS_THREAD_LOCAL BSStats BitStreamThreadStats;
+#endif
+
+/* 0 on success, -1 for a library built without the counters. */
+int BitStreamGetStats(BSStats *stats) {
+#if defined(BS_ENABLE_STATS)
+    *stats = BitStreamThreadStats;
+    return 0;
+#else
+    memset(stats, 0, sizeof(*stats));
+    return -1;
+#endif
+}
+
+void BitStreamResetStats(void) {
+#if defined(BS_ENABLE_STATS)
+    memset(&BitStreamThreadStats, 0, sizeof(BitStreamThreadStats));
+#endif
+}
@@ -0,0 +1,394 @@
+#include "bitstream.h"
+#include "bitstream_internal.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if BS_HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/**
+ * LEB128 varints: 7 bits per byte, least significant group first, the top
+ * bit of every byte but the last one set. A varint of 64 bits takes up to
+ * 10 bytes, the tenth may only hold the top bit. Signed values are zigzag
+ * mapped first, 0, -1, 1, -2, ... to 0, 1, 2, 3, ...
+ *
+ * The bytes of a varint are 8 bits groups from the cursor on, in the bit
+ * order of the stream, aligned to bytes or not. Aligned streams decode
+ * straight from memory, up to 8 bytes with one word load. Unaligned ones
+ * peek the next 64 bits instead. Malformed varints, or values wider than
+ * asked for, read as BS_FAIL and truncated ones as BS_EOS, neither moves
+ * the cursor.
+ */
+
+#define BS_VARINT_MAX_BYTES 10
+#define BS_VARINT_STOPS 0x8080808080808080ULL
+#define BS_VARINT_GROUPS 0x7f7f7f7f7f7f7f7fULL
+
+/**
+ * Decodes the varint in the low bytes of a little-endian word, returns
+ * its length or 0 when it does not end in those 8 bytes.
+ */
+BS_INLINE size_t BitStreamDecodeVarintWord(uint64_t word, uint64_t *value) {
+    uint64_t stops = ~word & BS_VARINT_STOPS;
+    size_t len;
+
+    if (BS_UNLIKELY(!stops))
+        return 0;
+    len = (BitStreamCountTrailingZeros64(stops) >> 3) + 1;
+    if (len < 8)
+        word &= ((uint64_t) 1 << (len << 3)) - 1;
+    word &= BS_VARINT_GROUPS;
+    /* squeeze the 7 bits groups together, pairs, then quads, then all 8. */
+    word = ((word & 0x7f007f007f007f00ULL) >> 1) | (word & 0x007f007f007f007fULL);
+    word = ((word & 0x3fff00003fff0000ULL) >> 2) | (word & 0x00003fff00003fffULL);
+    word = ((word & 0x0fffffff00000000ULL) >> 4) | (word & 0x000000000fffffffULL);
+    *value = word;
+    return len;
+}
+
+/* a varint in memory with 10 readable bytes, 0 when malformed. */
+BS_INLINE size_t BitStreamDecodeVarint(uint8_t const *p, uint64_t *value) {
+    uint64_t v;
+    size_t len = BitStreamDecodeVarintWord(BitStreamLoadLE64(p), value);
+
+    if (BS_LIKELY(len))
+        return len;
+    /* all 8 groups, as if the eighth byte ended the varint. */
+    BitStreamDecodeVarintWord(BitStreamLoadLE64(p) & ~((uint64_t) 0x80 << 56), &v);
+    v |= (uint64_t) (p[8] & 0x7f) << 56;
+    len = 9;
+    if (p[8] & 0x80) {
+        if (p[9] > 1)
+            return 0;
+        v |= (uint64_t) p[9] << 63;
+        len = 10;
+    }
+    *value = v;
+    return len;
+}
+
+/* byte `i` of the varint at the cursor, the caller checks it exists. */
+BS_INLINE unsigned BitInputStreamPeekByte(BitInputStream const *bis, size_t i) {
+    size_t offset = bis->_M_position + (i << 3);
+
+    if (bis->_M_order == BS_LSB_FIRST)
+        return (unsigned) BitStreamExtractLsb(bis->_M_bytes, (bis->_M_size + 7) >> 3, offset, 8);
+    return (unsigned) ((BitStreamLoadWindow(bis->_M_bytes, (bis->_M_size + 7) >> 3, offset >> 3)
+                << (offset & 0x7)) >> 56);
+}
+
+static BSStatus BitInputStreamReadVarintSlow(BitInputStream *bis, uint64_t max, uint64_t *value) {
+    uint64_t v = 0;
+    unsigned byte;
+    size_t i;
+
+    BitInputStreamFill(bis, BS_VARINT_MAX_BYTES << 3);
+    for (i = 0; i < BS_VARINT_MAX_BYTES; ++i) {
+        if (bis->_M_size - bis->_M_position < ((i + 1) << 3))
+            return BS_EOS;
+        byte = BitInputStreamPeekByte(bis, i);
+        if (i == BS_VARINT_MAX_BYTES - 1 && byte > 1)
+            return BS_FAIL;
+        v |= (uint64_t) (byte & 0x7f) << (7 * i);
+        if (!(byte & 0x80))
+            break;
+    }
+    if (i == BS_VARINT_MAX_BYTES || v > max)
+        return BS_FAIL;
+    BitInputStreamSkipBits(bis, (i + 1) << 3);
+    *value = v;
+    return BS_SUCCESS;
+}
+
+static BSStatus BitInputStreamReadVarint(BitInputStream *bis, uint64_t max, uint64_t *value) {
+    size_t pos = bis->_M_position;
+    size_t len;
+    uint64_t v;
+    uint8_t groups[8];
+
+    if (!(pos & 0x7) && pos + (BS_VARINT_MAX_BYTES << 3) <= bis->_M_size) {
+        len = BitStreamDecodeVarint(bis->_M_bytes + (pos >> 3), &v);
+        if (!len || v > max)
+            return BS_FAIL;
+        bis->_M_position += len << 3;
+        bis->_M_cache_bits = 0;
+        *value = v;
+        return BS_SUCCESS;
+    }
+    if (pos + 64 <= bis->_M_size) {
+        /* unaligned, the next 8 groups in one peek, first group in the low byte. */
+        v = BitInputStreamPeekUInt(bis, 64)._M_value.uint;
+        if (bis->_M_order != BS_LSB_FIRST) {
+            BitStreamStoreBE64(groups, v);
+            v = BitStreamLoadLE64(groups);
+        }
+        len = BitStreamDecodeVarintWord(v, &v);
+        if (len && v <= max) {
+            BitInputStreamSkipBits(bis, len << 3);
+            *value = v;
+            return BS_SUCCESS;
+        }
+    }
+    return BitInputStreamReadVarintSlow(bis, max, value);
+}
+
+ReadResult BitInputStreamReadVarUInt(BitInputStream *bis) {
+    ReadResult result;
+    uint64_t value = 0;
+
+    result._M_status = BitInputStreamReadVarint(bis, ~(uint64_t) 0, &value);
+    result._M_value.uint = value;
+    return result;
+}
+
+ReadResult BitInputStreamReadVarSInt(BitInputStream *bis) {
+    ReadResult result;
+    uint64_t value = 0;
+
+    result._M_status = BitInputStreamReadVarint(bis, ~(uint64_t) 0, &value);
+    result._M_value.uint = (value >> 1) ^ (~(value & 0x1) + 1);
+    return result;
+}
+
+WriteResult BitOutputStreamWriteVarUInt(BitOutputStream *bos, uint64_t value) {
+    WriteResult result = { BS_SUCCESS };
+    uint64_t head = 0;
+    uint64_t tail = 0;
+    size_t len = 0;
+    uint64_t byte;
+
+    /**
+     * the first 8 bytes in one field, the up to 2 others in a second one.
+     * The first byte of a field is its high byte MSB first, its low one LSB
+     * first.
+     */
+    do {
+        byte = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+        if (bos->_M_order == BS_LSB_FIRST) {
+            if (len < 8)
+                head |= byte << (len << 3);
+            else
+                tail |= byte << ((len - 8) << 3);
+        } else if (len < 8) {
+            head = (head << 8) | byte;
+        } else {
+            tail = (tail << 8) | byte;
+        }
+        value >>= 7;
+        ++len;
+    } while (value);
+    if (BitOutputStreamReserve(bos, len << 3) != 0) {
+        result._M_status = BS_FAIL;
+        return result;
+    }
+    BitOutputStreamWriteUInt(bos, (len < 8 ? len : 8) << 3, head);
+    if (len > 8)
+        BitOutputStreamWriteUInt(bos, (len - 8) << 3, tail);
+    return result;
+}
+
+WriteResult BitOutputStreamWriteVarSInt(BitOutputStream *bos, int64_t value) {
+    uint64_t v = (uint64_t) value;
+    return BitOutputStreamWriteVarUInt(bos, (v << 1) ^ (~(v >> 63) + 1));
+}
+
+#if BS_HAVE_X86_DISPATCH
+
+/**
+ * Masked VByte. The continuation bits of 12 bytes pick a plan which
+ * decodes the leading varints of those bytes with one shuffle: up to 8 of
+ * at most 2 bytes into 16 bits lanes, or up to 4 of at most 3 bytes into
+ * 32 bits lanes, whichever covers more of them. Longer varints go through
+ * the scalar decoder.
+ */
+typedef struct tagBSVarintPlan {
+    uint8_t _M_shuffle[16];
+    uint8_t _M_count;
+    uint8_t _M_consumed;
+    uint8_t _M_wide;
+} BSVarintPlan;
+
+static void BitStreamPlanVarints(BSVarintPlan *plan, unsigned mask) {
+    size_t lengths[12];
+    size_t n = 0;
+    size_t pos = 0;
+    size_t len;
+    size_t narrow, wide;
+    size_t i, j, lane;
+
+    while (pos < 12) {
+        for (len = 1; pos + len <= 12 && (mask >> (pos + len - 1)) & 0x1; ++len)
+            ;
+        if (pos + len > 12)
+            break;
+        lengths[n++] = len;
+        pos += len;
+    }
+    for (narrow = 0; narrow < n && narrow < 8 && lengths[narrow] <= 2; ++narrow)
+        ;
+    for (wide = 0; wide < n && wide < 4 && lengths[wide] <= 3; ++wide)
+        ;
+    memset(plan, 0, sizeof(*plan));
+    memset(plan->_M_shuffle, 0x80, sizeof(plan->_M_shuffle));
+    plan->_M_wide = wide > narrow;
+    plan->_M_count = (uint8_t) (plan->_M_wide ? wide : narrow);
+    lane = plan->_M_wide ? 4 : 2;
+    for (i = 0, pos = 0; i < plan->_M_count; ++i) {
+        for (j = 0; j < lengths[i]; ++j)
+            plan->_M_shuffle[i * lane + j] = (uint8_t) (pos + j);
+        pos += lengths[i];
+    }
+    plan->_M_consumed = (uint8_t) pos;
+}
+
+static BSVarintPlan const* BitStreamVarintPlans(void) {
+    static BSVarintPlan plans[4096];
+    static int volatile resolved = 0;
+    unsigned mask;
+
+    if (resolved)
+        return plans;
+    for (mask = 0; mask < 4096; ++mask)
+        BitStreamPlanVarints(&plans[mask], mask);
+    resolved = 1;
+    return plans;
+}
+
+/**
+ * Decodes varints while 16 bytes can be loaded and 8 values stored,
+ * stops in front of a malformed one or one wider than `MAX`.
+ */
+#define BS_DEFINE_VARINT_SSE41(T, NAME, MAX, STORE_NARROW, STORE_WIDE) \
+    BS_TARGET("sse4.1") static size_t NAME(uint8_t const **from, uint8_t const *end, size_t count, \
+            T *values) { \
+        BSVarintPlan const *plans = BitStreamVarintPlans(); \
+        BSVarintPlan const *plan; \
+        uint8_t const *p = *from; \
+        T *out = values; \
+        T *limit = values + count; \
+        __m128i v, lo, hi; \
+        uint64_t value; \
+        size_t len; \
+        while (limit - out >= 8 && end - p >= 16) { \
+            v = _mm_loadu_si128((__m128i const*) p); \
+            plan = &plans[_mm_movemask_epi8(v) & 0xfff]; \
+            if (BS_UNLIKELY(plan->_M_count == 0)) { \
+                len = BitStreamDecodeVarint(p, &value); \
+                if (!len || value > (MAX)) \
+                    break; \
+                *out++ = (T) value; \
+                p += len; \
+                continue; \
+            } \
+            v = _mm_shuffle_epi8(v, _mm_loadu_si128((__m128i const*) plan->_M_shuffle)); \
+            if (!plan->_M_wide) { \
+                v = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi16(0x7f)), \
+                        _mm_srli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x7f00)), 1)); \
+                lo = _mm_cvtepu16_epi32(v); \
+                hi = _mm_cvtepu16_epi32(_mm_srli_si128(v, 8)); \
+                STORE_NARROW; \
+            } else { \
+                v = _mm_or_si128(_mm_or_si128(_mm_and_si128(v, _mm_set1_epi32(0x7f)), \
+                            _mm_srli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x7f00)), 1)), \
+                        _mm_srli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x7f0000)), 2)); \
+                STORE_WIDE; \
+            } \
+            out += plan->_M_count; \
+            p += plan->_M_consumed; \
+        } \
+        *from = p; \
+        return (size_t) (out - values); \
+    }
+
+BS_DEFINE_VARINT_SSE41(uint32_t, BitStreamVarint32SSE41, 0xffffffffULL,
+        _mm_storeu_si128((__m128i*) out, lo);
+        _mm_storeu_si128((__m128i*) (out + 4), hi),
+        _mm_storeu_si128((__m128i*) out, v))
+BS_DEFINE_VARINT_SSE41(uint64_t, BitStreamVarint64SSE41, ~(uint64_t) 0,
+        _mm_storeu_si128((__m128i*) out, _mm_cvtepu32_epi64(lo));
+        _mm_storeu_si128((__m128i*) (out + 2), _mm_cvtepu32_epi64(_mm_srli_si128(lo, 8)));
+        _mm_storeu_si128((__m128i*) (out + 4), _mm_cvtepu32_epi64(hi));
+        _mm_storeu_si128((__m128i*) (out + 6), _mm_cvtepu32_epi64(_mm_srli_si128(hi, 8))),
+        _mm_storeu_si128((__m128i*) out, _mm_cvtepu32_epi64(v));
+        _mm_storeu_si128((__m128i*) (out + 2), _mm_cvtepu32_epi64(_mm_srli_si128(v, 8))))
+
+#endif /* BS_HAVE_X86_DISPATCH */
+
+typedef size_t (*BSVarint32Kernel)(uint8_t const**, uint8_t const*, size_t, uint32_t*);
+typedef size_t (*BSVarint64Kernel)(uint8_t const**, uint8_t const*, size_t, uint64_t*);
+
+typedef struct tagBSVarintKernels {
+    BSVarint32Kernel _M_varint32;
+    BSVarint64Kernel _M_varint64;
+} BSVarintKernels;
+
+/**
+ * Kernels of the running CPU, looked up once. Concurrent first calls race
+ * benignly, they all store the same pointers.
+ */
+static BSVarintKernels const* BitStreamVarintKernels(void) {
+    static BSVarintKernels kernels;
+    static int volatile resolved = 0;
+
+    if (resolved)
+        return &kernels;
+#if BS_HAVE_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1")) {
+        kernels._M_varint32 = &BitStreamVarint32SSE41;
+        kernels._M_varint64 = &BitStreamVarint64SSE41;
+    }
+#endif
+    resolved = 1;
+    return &kernels;
+}
+
+/**
+ * Decodes up to `count` varints, stops at the first one which fails and
+ * reports how many were decoded. Byte aligned runs go through the kernel
+ * and the scalar decoder straight from memory, the rest one varint at a
+ * time.
+ */
+#define BS_DEFINE_READ_VARINT_ARRAY(T, WIDTH, MAX) \
+    ReadResult BitInputStreamReadVarUIntArray##WIDTH(BitInputStream *bis, size_t count, T *values) { \
+        BSVarint##WIDTH##Kernel kernel = BitStreamVarintKernels()->_M_varint##WIDTH; \
+        ReadResult result; \
+        uint8_t const *p, *start, *end; \
+        uint64_t value; \
+        size_t done = 0; \
+        size_t len; \
+        result._M_status = BS_SUCCESS; \
+        while (done < count) { \
+            if (!(bis->_M_position & 0x7)) { \
+                start = p = bis->_M_bytes + (bis->_M_position >> 3); \
+                end = bis->_M_bytes + (bis->_M_size >> 3); \
+                if (kernel) \
+                    done += kernel(&p, end, count - done, values + done); \
+                while (done < count && end - p >= BS_VARINT_MAX_BYTES) { \
+                    len = BitStreamDecodeVarint(p, &value); \
+                    if (!len || value > (MAX)) \
+                        break; \
+                    values[done++] = (T) value; \
+                    p += len; \
+                } \
+                if (p != start) { \
+                    bis->_M_position += (size_t) (p - start) << 3; \
+                    bis->_M_cache_bits = 0; \
+                } \
+                if (done == count) \
+                    break; \
+            } \
+            result._M_status = BitInputStreamReadVarint(bis, (MAX), &value); \
+            if (result._M_status != BS_SUCCESS) \
+                break; \
+            values[done++] = (T) value; \
+        } \
+        result._M_value.uint = done; \
+        return result; \
+    }
+
+BS_DEFINE_READ_VARINT_ARRAY(uint32_t, 32, 0xffffffffULL)
+BS_DEFINE_READ_VARINT_ARRAY(uint64_t, 64, ~(uint64_t) 0)
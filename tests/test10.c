@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define FIELDS 3000
+#define COLLECTOR_SIZE 65536
+
+typedef struct tagCollector {
+    unsigned char data[COLLECTOR_SIZE];
+    size_t size;
+    size_t calls;
+    size_t limit;
+} Collector;
+
+/* keeps everything it is handed, refuses to go beyond the limit. */
+static size_t collectorWrite(void *context, void const *buffer, size_t n) {
+    Collector *collector = (Collector*) context;
+    if (collector->size + n > collector->limit)
+        n = collector->limit - collector->size;
+    memcpy(collector->data + collector->size, buffer, n);
+    collector->size += n;
+    ++collector->calls;
+    return n;
+}
+
+/* writes the same mixed width fields to both streams. */
+static int writeFields(BitOutputStream *bos, BitOutputStream *ref) {
+    size_t i, bits;
+    uint64_t value;
+
+    srand(10);
+    for (i = 0; i < FIELDS; ++i) {
+        bits = i % 64 + 1;
+        value = ((uint64_t) rand() << 42) ^ ((uint64_t) rand() << 21) ^ (uint64_t) rand();
+        if (!BS_SUCCEEDED(BitOutputStreamWriteUInt(bos, bits, value)))
+            return EXIT_FAILURE;
+        if (!BS_SUCCEEDED(BitOutputStreamWriteUInt(ref, bits, value)))
+            return EXIT_FAILURE;
+        if (BitOutputStreamGetBitSize(bos) != BitOutputStreamGetBitSize(ref))
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    size_t nbytes = 0;
+    int fds[2] = { -1, -1 };
+    ssize_t n;
+
+    static Collector collector;
+    static unsigned char piped[COLLECTOR_SIZE];
+    uint16_t values[1000];
+
+    BitOutputStream bos = {0};
+    BitOutputStream ref = {0};
+
+    /* callback sink through the smallest buffer, against a growable stream. */
+    collector.limit = COLLECTOR_SIZE;
+    TEST_ASSERT(BitOutputStreamInitializeWithWriter(&bos, &collectorWrite, &collector, 1));
+    TEST_ASSERT(BitOutputStreamInitialize(&ref, NULL, 0));
+    TEST_ASSERT(writeFields(&bos, &ref) == EXIT_SUCCESS);
+    TEST_ASSERT(collector.calls > 1);
+    TEST_ASSERT(BitOutputStreamGetBitSize(&bos) % 8 != 0);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamFinish(&bos, 1)));
+    BitOutputStreamPaddingBits(&ref, 1);
+    nbytes = BitOutputStreamGetSize(&ref);
+    TEST_ASSERT(collector.size == nbytes);
+    TEST_ASSERT(BitOutputStreamGetSize(&bos) == nbytes);
+    TEST_ASSERT(memcmp(collector.data, BitOutputStreamGetBuffer(&ref), nbytes) == 0);
+    BitOutputStreamRelease(&bos);
+    BitOutputStreamRelease(&ref);
+
+    /* the partial byte carries over a buffer boundary, seeks stay buffered. */
+    collector.size = 0;
+    TEST_ASSERT(BitOutputStreamInitializeWithWriter(&bos, &collectorWrite, &collector, 64));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 3, 0x5)));
+    for (i = 0; i < 64; ++i)
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 8, i)));
+    TEST_ASSERT(collector.size == 63);
+    TEST_ASSERT(collector.data[0] == 0xa0);
+    TEST_ASSERT(collector.data[62] == (((61 << 5) & 0xff) | (62 >> 3)));
+    TEST_ASSERT(BitOutputStreamSeekBits(&bos, 0, SEEK_SET) != 0);
+    TEST_ASSERT(BitOutputStreamSeekBits(&bos, 64 * 8, SEEK_SET) == 0);
+    TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == 64 * 8);
+    TEST_ASSERT(BitOutputStreamSeekBits(&bos, 3 + 64 * 8, SEEK_SET) == 0);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamFinish(&bos, 0)));
+    TEST_ASSERT(collector.size == 65);
+    TEST_ASSERT(collector.data[63] == (((62 << 5) & 0xff) | (63 >> 3)));
+    TEST_ASSERT(collector.data[64] == ((63 << 5) & 0xff));
+    BitOutputStreamRelease(&bos);
+
+    /* bulk writes larger than the buffer. */
+    collector.size = 0;
+    for (i = 0; i < 1000; ++i)
+        values[i] = (uint16_t) (i * 7919 % 2048);
+    TEST_ASSERT(BitOutputStreamInitializeWithWriter(&bos, &collectorWrite, &collector, 100));
+    TEST_ASSERT(BitOutputStreamInitialize(&ref, NULL, 0));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 5, 0x11)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&ref, 5, 0x11)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUIntArray16(&bos, 11, 1000, values, BS_PACK_CHECK)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUIntArray16(&ref, 11, 1000, values, BS_PACK_CHECK)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamFinish(&bos, 0)));
+    BitOutputStreamPaddingBits(&ref, 0);
+    TEST_ASSERT(collector.size == BitOutputStreamGetSize(&ref));
+    TEST_ASSERT(memcmp(collector.data, BitOutputStreamGetBuffer(&ref), collector.size) == 0);
+    BitOutputStreamRelease(&bos);
+    BitOutputStreamRelease(&ref);
+
+    /* a failing sink fails the writes and stays failed. */
+    collector.size = 0;
+    collector.limit = 100;
+    TEST_ASSERT(BitOutputStreamInitializeWithWriter(&bos, &collectorWrite, &collector, 64));
+    for (i = 0; i < 200; ++i)
+        if (!BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 8, i)))
+            break;
+    TEST_ASSERT(i == 128);
+    TEST_ASSERT(!BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 8, 0)));
+    TEST_ASSERT(!BS_SUCCEEDED(BitOutputStreamFinish(&bos, 0)));
+    BitOutputStreamRelease(&bos);
+
+    /* file descriptor, here a pipe. */
+    TEST_ASSERT(pipe(fds) == 0);
+    TEST_ASSERT(BitOutputStreamInitializeWithFd(&bos, fds[1], 256));
+    TEST_ASSERT(BitOutputStreamInitialize(&ref, NULL, 0));
+    TEST_ASSERT(writeFields(&bos, &ref) == EXIT_SUCCESS);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamFinish(&bos, 0)));
+    BitOutputStreamRelease(&bos);
+    close(fds[1]);
+    fds[1] = -1;
+    BitOutputStreamPaddingBits(&ref, 0);
+    nbytes = 0;
+    while ((n = read(fds[0], piped + nbytes, COLLECTOR_SIZE - nbytes)) > 0)
+        nbytes += (size_t) n;
+    TEST_ASSERT(nbytes == BitOutputStreamGetSize(&ref));
+    TEST_ASSERT(memcmp(piped, BitOutputStreamGetBuffer(&ref), nbytes) == 0);
+
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitOutputStreamRelease(&bos);
+    BitOutputStreamRelease(&ref);
+    if (fds[0] >= 0)
+        close(fds[0]);
+    if (fds[1] >= 0)
+        close(fds[1]);
+    goto exit;
+}
@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define DATA_SIZE 10000
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    int fd = -1;
+    ReadResult r;
+    char path[] = "/tmp/bitstream-test11-XXXXXX";
+    int created = 0;
+
+    unsigned char data[DATA_SIZE];
+    uint32_t values[1000];
+
+    BitInputStream bis = {0};
+    BitInputStream ref = {0};
+
+    srand(11);
+    for (i = 0; i < DATA_SIZE; ++i)
+        data[i] = (unsigned char) rand();
+    TEST_ASSERT((fd = mkstemp(path)) >= 0);
+    created = 1;
+    TEST_ASSERT(write(fd, data, DATA_SIZE) == DATA_SIZE);
+    close(fd);
+    fd = -1;
+
+    /* sequential reads with mixed widths against the in memory stream. */
+    TEST_ASSERT(BitInputStreamOpenFile(&bis, path, BS_ACCESS_SEQUENTIAL));
+    TEST_ASSERT(BitInputStreamGetBitSize(&bis) == DATA_SIZE * 8);
+    BitInputStreamInitialize(&ref, data, DATA_SIZE * 8);
+    for (i = 1; ; i = i % 64 + 1) {
+        r = BitInputStreamReadUInt(&ref, i);
+        if (!BS_SUCCEEDED(r))
+            break;
+        TEST_ASSERT(BitInputStreamReadUInt(&bis, i)._M_value.uint == r._M_value.uint);
+    }
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, i)._M_status == BS_EOS);
+    BitInputStreamRelease(&bis);
+
+    /* random access through seeks, bulk reads from the mapping. */
+    TEST_ASSERT(BitInputStreamOpenFile(&bis, path, BS_ACCESS_RANDOM));
+    TEST_ASSERT(BitInputStreamSeek(&bis, -1, SEEK_END) == 0);
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 8)._M_value.uint == data[DATA_SIZE - 1]);
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+    TEST_ASSERT(BitInputStreamSeekBits(&bis, 1, SEEK_END) != 0);
+    TEST_ASSERT(BitInputStreamSeekBits(&bis, 4321 * 8 + 5, SEEK_SET) == 0);
+    BitInputStreamMark(&bis);
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUIntArray32(&bis, 19, 1000, values)));
+    BitInputStreamSeekBits(&ref, 4321 * 8 + 5, SEEK_SET);
+    for (i = 0; i < 1000; ++i)
+        TEST_ASSERT(values[i] == BitInputStreamReadUInt(&ref, 19)._M_value.uint);
+    BitInputStreamReset(&bis);
+    TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == 4321 * 8 + 5);
+    BitInputStreamRelease(&bis);
+
+    /* the remaining hints, and what cannot be opened. */
+    TEST_ASSERT(BitInputStreamOpenFile(&bis, path, BS_ACCESS_WILLNEED));
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 8)._M_value.uint == data[0]);
+    BitInputStreamRelease(&bis);
+    TEST_ASSERT(BitInputStreamOpenFile(&bis, path, BS_ACCESS_NORMAL));
+    BitInputStreamRelease(&bis);
+    TEST_ASSERT(!BitInputStreamOpenFile(&bis, "/nonexistent/bitstream", BS_ACCESS_NORMAL));
+
+    /* an empty file is an empty stream. */
+    TEST_ASSERT(truncate(path, 0) == 0);
+    TEST_ASSERT(BitInputStreamOpenFile(&bis, path, BS_ACCESS_SEQUENTIAL));
+    TEST_ASSERT(BitInputStreamGetBitSize(&bis) == 0);
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+    TEST_ASSERT(BitInputStreamReadBit(&bis)._M_status == BS_EOS);
+
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    BitInputStreamRelease(&ref);
+    if (fd >= 0)
+        close(fd);
+    if (created)
+        unlink(path);
+    goto exit;
+}
@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define CODES 20000
+
+typedef struct tagMemoryReader {
+    unsigned char const *data;
+    size_t size;
+    size_t offset;
+} MemoryReader;
+
+/* a few bytes at a time, so that codewords cross the window. */
+static size_t memoryRead(void *context, void *buffer, size_t n) {
+    MemoryReader *reader = (MemoryReader*) context;
+    size_t chunk = 1 + reader->offset % 7;
+    if (chunk > n)
+        chunk = n;
+    if (chunk > reader->size - reader->offset)
+        chunk = reader->size - reader->offset;
+    memcpy(buffer, reader->data + reader->offset, chunk);
+    reader->offset += chunk;
+    return chunk;
+}
+
+/* mostly small values, now and then up to the full 64 bits. */
+static uint64_t randomValue(size_t i) {
+    uint64_t v = ((uint64_t) rand() << 42) ^ ((uint64_t) rand() << 21) ^ (uint64_t) rand();
+    return v >> (i % 7 == 0 ? i % 64 : 40 + i % 24);
+}
+
+/* writes mixed codes, reads them back in the same order. */
+static int roundTrip(BitInputStream *bis, BitOutputStream *bos, int write) {
+    size_t i, k;
+    uint64_t v;
+    int64_t s;
+    ReadResult r;
+
+    srand(12);
+    for (i = 0; i < CODES; ++i) {
+        v = randomValue(i);
+        k = i % 13;
+        s = (int64_t) v >> 1;
+        s = (i & 0x1) ? -s : s;
+        switch (i % 4) {
+            case 0:
+                if (v == ~(uint64_t) 0)
+                    v >>= 1;
+                if (write)
+                    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUE(bos, v)));
+                else
+                    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUE(bis)) && r._M_value.uint == v);
+                break;
+            case 1:
+                if (write)
+                    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteSE(bos, s)));
+                else
+                    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadSE(bis)) && r._M_value.sint == s);
+                break;
+            case 2:
+                v >>= k;
+                if (write)
+                    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteExpGolomb(bos, k, v)));
+                else
+                    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadExpGolomb(bis, k)) && r._M_value.uint == v);
+                break;
+            case 3:
+                /* rice values stay within a few hundred bits. */
+                v &= ((uint64_t) 1 << (k + 7)) - 1;
+                if (write)
+                    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteRice(bos, k, v)));
+                else
+                    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadRice(bis, k)) && r._M_value.uint == v);
+                break;
+        }
+    }
+    return EXIT_SUCCESS;
+failure:
+    fprintf(stdout, "at code %u\n", (unsigned) i);
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    ReadResult r;
+    uint8_t const *bytes;
+    static unsigned char const zeros[16] = { 0 };
+    static unsigned char const tail[2] = { 0x00, 0x01 };
+
+    BitInputStream bis = {0};
+    BitOutputStream bos = {0};
+    MemoryReader reader = { NULL, 0, 0 };
+
+    /* the first codes, bit for bit. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    for (i = 0; i < 4; ++i)
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUE(&bos, i)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteSE(&bos, -2)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteExpGolomb(&bos, 2, 5)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteRice(&bos, 3, 21)));
+    /* 1 010 011 00100 00101 01001 001101 */
+    TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == 1 + 3 + 3 + 5 + 5 + 5 + 6);
+    bytes = (uint8_t const*) BitOutputStreamGetBuffer(&bos);
+    TEST_ASSERT(bytes[0] == 0xa6 && bytes[1] == 0x42 && bytes[2] == 0xa4 && (bytes[3] & 0xf0) == 0xd0);
+    TEST_ASSERT(!BS_SUCCEEDED(BitOutputStreamWriteUE(&bos, ~(uint64_t) 0)));
+    TEST_ASSERT(!BS_SUCCEEDED(BitOutputStreamWriteSE(&bos, INT64_MIN)));
+    TEST_ASSERT(!BS_SUCCEEDED(BitOutputStreamWriteRice(&bos, 64, 0)));
+    BitOutputStreamRelease(&bos);
+
+    /* round trips through memory, and through a source in small chunks. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    TEST_ASSERT(roundTrip(NULL, &bos, 1) == EXIT_SUCCESS);
+    BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos));
+    TEST_ASSERT(roundTrip(&bis, NULL, 0) == EXIT_SUCCESS);
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+    TEST_ASSERT(BitInputStreamReadUE(&bis)._M_status == BS_EOS);
+    BitInputStreamRelease(&bis);
+
+    reader.data = (unsigned char const*) BitOutputStreamGetBuffer(&bos);
+    reader.size = BitOutputStreamGetSize(&bos);
+    TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &memoryRead, &reader, 64));
+    TEST_ASSERT(roundTrip(&bis, NULL, 0) == EXIT_SUCCESS);
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+
+    /* too long a prefix fails, a truncated codeword is EOS, neither moves. */
+    BitInputStreamInitialize(&bis, zeros, sizeof(zeros) * 8);
+    TEST_ASSERT(BitInputStreamReadUE(&bis)._M_status == BS_FAIL);
+    TEST_ASSERT(BitInputStreamReadRice(&bis, 2)._M_status == BS_EOS);
+    TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == 0);
+    BitInputStreamInitialize(&bis, tail, 16);
+    TEST_ASSERT(BitInputStreamReadUE(&bis)._M_status == BS_EOS);
+    TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == 0);
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadRice(&bis, 0)));
+    TEST_ASSERT(r._M_value.uint == 15);
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+    BitInputStreamRelease(&bis);
+
+    /* a Rice prefix far longer than the window of a source. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteRice(&bos, 0, 600000)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 8, 0xa5)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamFinish(&bos, 0)));
+    BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos));
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadRice(&bis, 0)) && r._M_value.uint == 600000);
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 8)._M_value.uint == 0xa5);
+    BitInputStreamRelease(&bis);
+    reader.data = (unsigned char const*) BitOutputStreamGetBuffer(&bos);
+    reader.size = BitOutputStreamGetSize(&bos);
+    reader.offset = 0;
+    TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &memoryRead, &reader, 64));
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadRice(&bis, 0)) && r._M_value.uint == 600000);
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 8)._M_value.uint == 0xa5);
+    BitInputStreamRelease(&bis);
+    /* cut inside the prefix, EOS with a defined value. */
+    reader.size = 40000;
+    reader.offset = 0;
+    TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &memoryRead, &reader, 64));
+    r = BitInputStreamReadRice(&bis, 3);
+    TEST_ASSERT(r._M_status == BS_EOS && r._M_value.uint == 0);
+    BitOutputStreamRelease(&bos);
+
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+    goto exit;
+}
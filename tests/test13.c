@@ -0,0 +1,209 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define DATA_SIZE 64
+#define SYMBOLS 5000
+
+typedef struct tagMemoryReader {
+    unsigned char const *data;
+    size_t size;
+    size_t offset;
+} MemoryReader;
+
+static size_t memoryRead(void *context, void *buffer, size_t n) {
+    MemoryReader *reader = (MemoryReader*) context;
+    size_t chunk = 1 + reader->offset % 5;
+    if (chunk > n)
+        chunk = n;
+    if (chunk > reader->size - reader->offset)
+        chunk = reader->size - reader->offset;
+    memcpy(buffer, reader->data + reader->offset, chunk);
+    reader->offset += chunk;
+    return chunk;
+}
+
+/* encodes random symbols, decodes them one by one and in batches. */
+static int roundTrip(uint8_t const *lengths, size_t nsymbols, size_t primaryBits) {
+    int rc = 0;
+    size_t i;
+    size_t symbols[SYMBOLS];
+    uint32_t decoded[SYMBOLS];
+    ReadResult r;
+    MemoryReader reader = { NULL, 0, 0 };
+
+    BSHuffman *huffman = NULL;
+    BitOutputStream bos = {0};
+    BitInputStream bis = {0};
+
+    TEST_ASSERT((huffman = BitStreamHuffmanCreate(lengths, nsymbols, primaryBits)) != NULL);
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    for (i = 0; i < SYMBOLS; ++i) {
+        do {
+            symbols[i] = (size_t) rand() % nsymbols;
+        } while (lengths[symbols[i]] == 0);
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteHuffman(&bos, huffman, symbols[i])));
+    }
+
+    BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos));
+    for (i = 0; i < SYMBOLS; ++i) {
+        TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadHuffman(&bis, huffman)));
+        TEST_ASSERT(r._M_value.uint == symbols[i]);
+    }
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+    TEST_ASSERT(BitInputStreamReadHuffman(&bis, huffman)._M_status == BS_EOS);
+
+    reader.data = (unsigned char const*) BitOutputStreamGetBuffer(&bos);
+    reader.size = BitOutputStreamGetSize(&bos);
+    TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &memoryRead, &reader, 64));
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadHuffmanArray(&bis, huffman, 1000, decoded)));
+    TEST_ASSERT(r._M_value.uint == 1000);
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadHuffmanArray(&bis, huffman, SYMBOLS - 1000, decoded + 1000)));
+    TEST_ASSERT(r._M_value.uint == SYMBOLS - 1000);
+    TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == BitOutputStreamGetBitSize(&bos));
+    for (i = 0; i < SYMBOLS; ++i)
+        TEST_ASSERT(decoded[i] == symbols[i]);
+
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+    BitStreamHuffmanDestroy(huffman);
+    goto exit;
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    size_t bits = 0;
+    size_t offset = 0;
+    ReadResult r, r2;
+    unsigned char data[DATA_SIZE];
+    uint8_t fixed[288];
+    uint8_t skewed[22];
+    static uint8_t const oversubscribed[3] = { 1, 1, 1 };
+    static uint8_t const incomplete[3] = { 2, 2, 0 };
+    static unsigned char const unassigned[1] = { 0xc0 };
+    MemoryReader reader = { NULL, 0, 0 };
+
+    BSHuffman *huffman = NULL;
+    BitInputStream bis = {0};
+    BitInputStream ref = {0};
+    BitOutputStream bos = {0};
+
+    srand(13);
+    for (i = 0; i < DATA_SIZE; ++i)
+        data[i] = (unsigned char) rand();
+
+    /* peeks of every width at every offset, they never move the cursor. */
+    for (offset = 0; offset < 16; ++offset) {
+        for (bits = 1; bits <= 64; ++bits) {
+            BitInputStreamInitialize(&bis, data, DATA_SIZE * 8);
+            BitInputStreamInitialize(&ref, data, DATA_SIZE * 8);
+            TEST_ASSERT(BitInputStreamSkipBits(&bis, offset) == 0);
+            BitInputStreamReadUInt(&ref, offset);
+            TEST_ASSERT(BS_SUCCEEDED(BitInputStreamReadUInt(&bis, 3)));
+            BitInputStreamReadUInt(&ref, 3);
+            TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamPeekUInt(&bis, bits)));
+            TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == offset + 3);
+            TEST_ASSERT(BS_SUCCEEDED(r2 = BitInputStreamReadUInt(&ref, bits)));
+            TEST_ASSERT(r._M_value.uint == r2._M_value.uint);
+            TEST_ASSERT(BitInputStreamPeekUInt(&bis, bits)._M_value.uint == r2._M_value.uint);
+            TEST_ASSERT(BitInputStreamReadUInt(&bis, bits)._M_value.uint == r2._M_value.uint);
+        }
+    }
+    BitInputStreamInitialize(&bis, data, 20);
+    TEST_ASSERT(BitInputStreamPeekUInt(&bis, 21)._M_status == BS_EOS);
+    TEST_ASSERT(BitInputStreamPeekUInt(&bis, 65)._M_status == BS_FAIL);
+    TEST_ASSERT(BitInputStreamSkipBits(&bis, 21) != 0);
+    TEST_ASSERT(BitInputStreamSkipBits(&bis, 20) == 0);
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+
+    /* the same through a source, skips slide the window. */
+    reader.data = data;
+    reader.size = DATA_SIZE;
+    TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &memoryRead, &reader, 1));
+    BitInputStreamInitialize(&ref, data, DATA_SIZE * 8);
+    for (bits = 1; BitInputStreamGetBitPosition(&ref) + bits + 7 <= DATA_SIZE * 8; bits = bits % 64 + 1) {
+        TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamPeekUInt(&bis, bits)));
+        TEST_ASSERT(r._M_value.uint == BitInputStreamReadUInt(&ref, bits)._M_value.uint);
+        TEST_ASSERT(BitInputStreamSkipBits(&bis, bits) == 0);
+        TEST_ASSERT(BitInputStreamSkipBits(&bis, 7) == 0);
+        BitInputStreamReadUInt(&ref, 7);
+    }
+    BitInputStreamRelease(&bis);
+
+    /* the fixed literal code of DEFLATE. */
+    for (i = 0; i < 288; ++i)
+        fixed[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    TEST_ASSERT((huffman = BitStreamHuffmanCreate(fixed, 288, 0)) != NULL);
+    TEST_ASSERT(BitStreamHuffmanGetMaxBits(huffman) == 9);
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteHuffman(&bos, huffman, 0)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteHuffman(&bos, huffman, 144)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteHuffman(&bos, huffman, 256)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteHuffman(&bos, huffman, 287)));
+    TEST_ASSERT(!BS_SUCCEEDED(BitOutputStreamWriteHuffman(&bos, huffman, 288)));
+    BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos));
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 8)._M_value.uint == 0x30);
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 9)._M_value.uint == 0x190);
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 7)._M_value.uint == 0);
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 8)._M_value.uint == 0xc7);
+    BitOutputStreamRelease(&bos);
+    BitStreamHuffmanDestroy(huffman);
+    huffman = NULL;
+    TEST_ASSERT(roundTrip(fixed, 288, 0) == EXIT_SUCCESS);
+    TEST_ASSERT(roundTrip(fixed, 288, 4) == EXIT_SUCCESS);
+
+    /* up to 21 bits, subtables below a small and a large primary table. */
+    for (i = 0; i < 21; ++i)
+        skewed[i] = (uint8_t) (i + 1);
+    skewed[21] = 21;
+    TEST_ASSERT(roundTrip(skewed, 22, 1) == EXIT_SUCCESS);
+    TEST_ASSERT(roundTrip(skewed, 22, 0) == EXIT_SUCCESS);
+    TEST_ASSERT(roundTrip(skewed, 22, 12) == EXIT_SUCCESS);
+    TEST_ASSERT(roundTrip(skewed, 22, 24) == EXIT_SUCCESS);
+
+    /* what is no prefix code, and codes which belong to no symbol. */
+    TEST_ASSERT(BitStreamHuffmanCreate(oversubscribed, 3, 0) == NULL);
+    TEST_ASSERT((huffman = BitStreamHuffmanCreate(incomplete, 3, 0)) != NULL);
+    BitInputStreamInitialize(&bis, unassigned, 8);
+    TEST_ASSERT(BitInputStreamReadHuffman(&bis, huffman)._M_status == BS_FAIL);
+    TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == 0);
+    BitInputStreamInitialize(&bis, unassigned, 1);
+    TEST_ASSERT(BitInputStreamReadHuffman(&bis, huffman)._M_status == BS_EOS);
+
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    BitInputStreamRelease(&ref);
+    BitOutputStreamRelease(&bos);
+    BitStreamHuffmanDestroy(huffman);
+    goto exit;
+}
@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define VALUES 4000
+
+typedef struct tagMemoryReader {
+    unsigned char const *data;
+    size_t size;
+    size_t offset;
+} MemoryReader;
+
+static size_t memoryRead(void *context, void *buffer, size_t n) {
+    MemoryReader *reader = (MemoryReader*) context;
+    size_t chunk = 1 + reader->offset % 11;
+    if (chunk > n)
+        chunk = n;
+    if (chunk > reader->size - reader->offset)
+        chunk = reader->size - reader->offset;
+    memcpy(buffer, reader->data + reader->offset, chunk);
+    reader->offset += chunk;
+    return chunk;
+}
+
+/* runs of short varints with now and then a long one, as real data has. */
+static uint64_t randomValue(size_t i) {
+    uint64_t v = ((uint64_t) rand() << 42) ^ ((uint64_t) rand() << 21) ^ (uint64_t) rand();
+    if (i % 97 == 96)
+        return v << 1 | (i & 0x1);
+    return v >> (i % 13 == 0 ? 34 : 50 + i % 14);
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    size_t lead = 0;
+    ReadResult r;
+    uint8_t const *bytes;
+    static uint64_t values[VALUES];
+    static uint64_t decoded64[VALUES];
+    static uint32_t decoded32[VALUES];
+    static unsigned char const overlong[11] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02, 0 };
+    static unsigned char const wide[11] = { 0x80, 0x80, 0x80, 0x80, 0x0f, 0x01, 0x80, 0x80, 0x80, 0x80, 0x10 };
+    static unsigned char const truncated[2] = { 0x01, 0x81 };
+    MemoryReader reader = { NULL, 0, 0 };
+
+    BitOutputStream bos = {0};
+    BitInputStream bis = {0};
+
+    /* known encodings. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteVarUInt(&bos, 300)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteVarSInt(&bos, -1)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteVarSInt(&bos, 1)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteVarUInt(&bos, ~(uint64_t) 0)));
+    TEST_ASSERT(BitOutputStreamGetSize(&bos) == 2 + 1 + 1 + 10);
+    bytes = (uint8_t const*) BitOutputStreamGetBuffer(&bos);
+    TEST_ASSERT(bytes[0] == 0xac && bytes[1] == 0x02 && bytes[2] == 0x01 && bytes[3] == 0x02);
+    TEST_ASSERT(bytes[4] == 0xff && bytes[12] == 0xff && bytes[13] == 0x01);
+    BitInputStreamInitialize(&bis, bytes, BitOutputStreamGetBitSize(&bos));
+    TEST_ASSERT(BitInputStreamReadVarUInt(&bis)._M_value.uint == 300);
+    TEST_ASSERT(BitInputStreamReadVarSInt(&bis)._M_value.sint == -1);
+    TEST_ASSERT(BitInputStreamReadVarSInt(&bis)._M_value.sint == 1);
+    TEST_ASSERT(BitInputStreamReadVarUInt(&bis)._M_value.uint == ~(uint64_t) 0);
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+    BitOutputStreamRelease(&bos);
+
+    /* bulk and single reads at every bit offset against what was written. */
+    srand(14);
+    for (i = 0; i < VALUES; ++i)
+        values[i] = randomValue(i);
+    for (lead = 0; lead < 9; ++lead) {
+        TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, lead, 0)));
+        for (i = 0; i < VALUES; ++i) {
+            if (i % 5 == 0)
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteVarSInt(&bos, (int64_t) values[i])));
+            else
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteVarUInt(&bos, values[i])));
+        }
+
+        BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos));
+        BitInputStreamSkipBits(&bis, lead);
+        for (i = 0; i < VALUES; ++i) {
+            if (i % 5 == 0) {
+                TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadVarSInt(&bis)));
+                TEST_ASSERT(r._M_value.sint == (int64_t) values[i]);
+            } else {
+                TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadVarUInt(&bis)));
+                TEST_ASSERT(r._M_value.uint == values[i]);
+            }
+        }
+        TEST_ASSERT(BitInputStreamIsEOS(&bis));
+        TEST_ASSERT(BitInputStreamReadVarUInt(&bis)._M_status == BS_EOS);
+        BitOutputStreamRelease(&bos);
+
+        TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, lead, 0)));
+        for (i = 0; i < VALUES; ++i)
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteVarUInt(&bos, values[i])));
+        BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos));
+        BitInputStreamSkipBits(&bis, lead);
+        TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadVarUIntArray64(&bis, VALUES, decoded64)));
+        TEST_ASSERT(r._M_value.uint == VALUES);
+        TEST_ASSERT(memcmp(decoded64, values, sizeof(values)) == 0);
+        TEST_ASSERT(BitInputStreamIsEOS(&bis));
+
+        /* 32 bits stop in front of the first wider value. */
+        BitInputStreamSeekBits(&bis, lead, SEEK_SET);
+        r = BitInputStreamReadVarUIntArray32(&bis, VALUES, decoded32);
+        TEST_ASSERT(r._M_status == BS_FAIL);
+        TEST_ASSERT(r._M_value.uint == 96);
+        for (i = 0; i < 96; ++i)
+            TEST_ASSERT(decoded32[i] == values[i]);
+        TEST_ASSERT(BitInputStreamReadVarUInt(&bis)._M_value.uint == values[96]);
+
+        /* through a source in small chunks. */
+        reader.data = (unsigned char const*) BitOutputStreamGetBuffer(&bos);
+        reader.size = BitOutputStreamGetSize(&bos);
+        reader.offset = 0;
+        TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &memoryRead, &reader, 64));
+        BitInputStreamSkipBits(&bis, lead);
+        memset(decoded64, 0, sizeof(decoded64));
+        TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadVarUIntArray64(&bis, VALUES, decoded64)));
+        TEST_ASSERT(memcmp(decoded64, values, sizeof(values)) == 0);
+        BitInputStreamRelease(&bis);
+        BitOutputStreamRelease(&bos);
+    }
+
+    /* malformed and truncated varints leave the cursor where it was. */
+    BitInputStreamInitialize(&bis, overlong, sizeof(overlong) * 8);
+    TEST_ASSERT(BitInputStreamReadVarUInt(&bis)._M_status == BS_FAIL);
+    TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == 0);
+    BitInputStreamInitialize(&bis, wide, sizeof(wide) * 8);
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadVarUIntArray32(&bis, 2, decoded32)));
+    TEST_ASSERT(r._M_value.uint == 2 && decoded32[0] == 0xf0000000 && decoded32[1] == 1);
+    TEST_ASSERT(BitInputStreamReadVarUIntArray32(&bis, 1, decoded32)._M_status == BS_FAIL);
+    TEST_ASSERT(BitInputStreamReadVarUInt(&bis)._M_value.uint == ((uint64_t) 1 << 32));
+    BitInputStreamInitialize(&bis, truncated, sizeof(truncated) * 8);
+    TEST_ASSERT(BitInputStreamReadVarUInt(&bis)._M_value.uint == 1);
+    TEST_ASSERT(BitInputStreamReadVarUInt(&bis)._M_status == BS_EOS);
+    TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == 8);
+
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+    goto exit;
+}
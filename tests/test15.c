@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define RECORDS 2000
+#define FIELDS 9
+
+typedef struct tagMemoryReader {
+    unsigned char const *data;
+    size_t size;
+    size_t offset;
+} MemoryReader;
+
+static size_t memoryRead(void *context, void *buffer, size_t n) {
+    MemoryReader *reader = (MemoryReader*) context;
+    size_t chunk = 1 + reader->offset % 17;
+    if (chunk > n)
+        chunk = n;
+    if (chunk > reader->size - reader->offset)
+        chunk = reader->size - reader->offset;
+    memcpy(buffer, reader->data + reader->offset, chunk);
+    reader->offset += chunk;
+    return chunk;
+}
+
+/* a record header: a flag, signed and unsigned fields of odd widths, 200 bits in all. */
+static size_t const WIDTHS[FIELDS] = { 1, 3, 13, 64, 7, 29, 17, 58, 8 };
+
+static uint64_t fieldValue(size_t record, size_t field) {
+    uint64_t v = (uint64_t) record * 0x9e3779b97f4a7c15ULL + field * 0xbf58476d1ce4e5b9ULL;
+    return v ^ (v >> 29);
+}
+
+static uint64_t fieldMask(size_t field) {
+    return WIDTHS[field] == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << WIDTHS[field]) - 1;
+}
+
+/* reads the records back, one check per record. */
+static int readRecords(BitInputStream *bis) {
+    size_t i, j;
+    int64_t s;
+    uint64_t expected;
+
+    for (i = 0; i < RECORDS; ++i) {
+        if (BitInputStreamEnsure(bis, 200) != 0)
+            return EXIT_FAILURE;
+        if (BitInputStreamReadBitUnchecked(bis) != (int) (fieldValue(i, 0) & 0x1))
+            return EXIT_FAILURE;
+        for (j = 1; j < FIELDS; ++j) {
+            expected = fieldValue(i, j) & fieldMask(j);
+            if (j == 2) {
+                /* sign extended. */
+                s = BitInputStreamReadIntUnchecked(bis, WIDTHS[j]);
+                if ((uint64_t) s != (expected | (expected >> 12 ? ~(uint64_t) 0 << 13 : 0)))
+                    return EXIT_FAILURE;
+            } else if (BitInputStreamReadUIntUnchecked(bis, WIDTHS[j]) != expected) {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    size_t j = 0;
+    unsigned char fixed[13];
+    MemoryReader reader = { NULL, 0, 0 };
+
+    BitOutputStream bos = {0};
+    BitOutputStream ref = {0};
+    BitInputStream bis = {0};
+
+    /* reserved unchecked writes produce what checked ones do. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    TEST_ASSERT(BitOutputStreamInitialize(&ref, NULL, 0));
+    for (i = 0; i < RECORDS; ++i) {
+        TEST_ASSERT(BitOutputStreamReserve(&bos, 200) == 0);
+        BitOutputStreamWriteBitUnchecked(&bos, (int) fieldValue(i, 0));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteBit(&ref, (int) fieldValue(i, 0) & 0x1)));
+        for (j = 1; j < FIELDS; ++j) {
+            if (j == 2)
+                BitOutputStreamWriteIntUnchecked(&bos, WIDTHS[j], (int64_t) fieldValue(i, j));
+            else
+                BitOutputStreamWriteUIntUnchecked(&bos, WIDTHS[j], fieldValue(i, j));
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&ref, WIDTHS[j], fieldValue(i, j) & fieldMask(j))));
+        }
+        TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == (i + 1) * 200);
+    }
+    TEST_ASSERT(BitOutputStreamGetSize(&bos) == BitOutputStreamGetSize(&ref));
+    TEST_ASSERT(memcmp(BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBuffer(&ref), RECORDS * 200 / 8) == 0);
+
+    /* in memory, then through a small source window. */
+    BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos));
+    TEST_ASSERT(readRecords(&bis) == EXIT_SUCCESS);
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+    TEST_ASSERT(BitInputStreamEnsure(&bis, 0) == 0);
+    TEST_ASSERT(BitInputStreamEnsure(&bis, 1) != 0);
+
+    reader.data = (unsigned char const*) BitOutputStreamGetBuffer(&bos);
+    reader.size = BitOutputStreamGetSize(&bos);
+    TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &memoryRead, &reader, 64));
+    TEST_ASSERT(readRecords(&bis) == EXIT_SUCCESS);
+    TEST_ASSERT(BitInputStreamEnsure(&bis, 1) != 0);
+    BitInputStreamRelease(&bis);
+
+    /* a fixed buffer refuses the reservation instead of overflowing. */
+    BitOutputStreamRelease(&bos);
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, fixed, 100));
+    TEST_ASSERT(BitOutputStreamReserve(&bos, 100) == 0);
+    TEST_ASSERT(BitOutputStreamReserve(&bos, 101) != 0);
+
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+    BitOutputStreamRelease(&ref);
+    goto exit;
+}
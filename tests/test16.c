@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define RECORDS 1000
+
+typedef struct tagRecord {
+    int flag;
+    uint64_t id;
+    int64_t delta;
+    int64_t offset;
+} Record;
+
+typedef struct tagMemoryReader {
+    unsigned char const *data;
+    size_t size;
+    size_t offset;
+} MemoryReader;
+
+static size_t memoryRead(void *context, void *buffer, size_t n) {
+    MemoryReader *reader = (MemoryReader*) context;
+    size_t chunk = 1 + reader->offset % 9;
+    if (chunk > n)
+        chunk = n;
+    if (chunk > reader->size - reader->offset)
+        chunk = reader->size - reader->offset;
+    memcpy(buffer, reader->data + reader->offset, chunk);
+    reader->offset += chunk;
+    return chunk;
+}
+
+static void makeRecord(Record *record, size_t i) {
+    record->flag = (int) (i & 0x1);
+    record->id = (uint64_t) i * 2654435761U;
+    record->delta = (int64_t) (i % 200) - 100;
+    record->offset = (int64_t) (i * 7919 % 60000) - 30000;
+}
+
+/* straight line decoding, one check per record. */
+static size_t readRecords(BitInputStream *bis, Record *records, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        records[i].flag = BitInputStreamFetchBit(bis);
+        records[i].id = BitInputStreamFetchUInt(bis, 40);
+        records[i].delta = BitInputStreamFetchInt(bis, 8);
+        records[i].offset = BitInputStreamFetchSInt(bis, 17);
+        if (BitInputStreamGetError(bis) != BS_SUCCESS)
+            break;
+    }
+    return i;
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    Record expected;
+    static Record records[RECORDS + 1];
+    MemoryReader reader = { NULL, 0, 0 };
+
+    BitOutputStream bos = {0};
+    BitInputStream bis = {0};
+
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    for (i = 0; i < RECORDS; ++i) {
+        makeRecord(&expected, i);
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteBit(&bos, expected.flag)));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 40, expected.id)));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteInt(&bos, 8, expected.delta)));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteSInt(&bos, 17, expected.offset)));
+    }
+
+    /* all records, the one past them fails and sticks. */
+    BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos));
+    TEST_ASSERT(readRecords(&bis, records, RECORDS + 1) == RECORDS);
+    TEST_ASSERT(BitInputStreamGetError(&bis) == BS_EOS);
+    for (i = 0; i < RECORDS; ++i) {
+        makeRecord(&expected, i);
+        TEST_ASSERT(records[i].flag == expected.flag);
+        TEST_ASSERT(records[i].id == (expected.id & 0xffffffffffULL));
+        TEST_ASSERT(records[i].delta == expected.delta);
+        TEST_ASSERT(records[i].offset == expected.offset);
+    }
+
+    /* later reads return zero even where there are bits, until cleared. */
+    TEST_ASSERT(BitInputStreamSeekBits(&bis, 0, SEEK_SET) == 0);
+    TEST_ASSERT(BitInputStreamFetchUInt(&bis, 40) == 0);
+    TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == 0);
+    TEST_ASSERT(BS_SUCCEEDED(BitInputStreamReadBit(&bis)));
+    TEST_ASSERT(BitInputStreamFetchUInt(&bis, 1) == 0);
+    BitInputStreamClearError(&bis);
+    TEST_ASSERT(BitInputStreamSeekBits(&bis, 66, SEEK_SET) == 0);
+    TEST_ASSERT(BitInputStreamFetchBit(&bis) == 1);
+    TEST_ASSERT(BitInputStreamFetchUInt(&bis, 40) == 2654435761U);
+    TEST_ASSERT(BitInputStreamGetError(&bis) == BS_SUCCESS);
+    TEST_ASSERT(BitInputStreamFetchUInt(&bis, 65) == 0);
+    TEST_ASSERT(BitInputStreamGetError(&bis) == BS_FAIL);
+    BitInputStreamRelease(&bis);
+    TEST_ASSERT(BitInputStreamGetError(&bis) == BS_SUCCESS);
+
+    /* through a source, the window refills under the Fetch reads. */
+    reader.data = (unsigned char const*) BitOutputStreamGetBuffer(&bos);
+    reader.size = BitOutputStreamGetSize(&bos);
+    TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &memoryRead, &reader, 64));
+    memset(records, 0, sizeof(records));
+    TEST_ASSERT(readRecords(&bis, records, RECORDS) == RECORDS);
+    TEST_ASSERT(BitInputStreamGetError(&bis) == BS_SUCCESS);
+    makeRecord(&expected, RECORDS - 1);
+    TEST_ASSERT(records[RECORDS - 1].offset == expected.offset);
+    TEST_ASSERT(BitInputStreamFetchBit(&bis) == 0);
+    TEST_ASSERT(BitInputStreamGetError(&bis) == BS_EOS);
+
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+    goto exit;
+}
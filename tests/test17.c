@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define FIELDS 4000
+
+typedef struct tagMemoryReader {
+    unsigned char const *data;
+    size_t size;
+    size_t offset;
+} MemoryReader;
+
+static size_t memoryRead(void *context, void *buffer, size_t n) {
+    MemoryReader *reader = (MemoryReader*) context;
+    size_t chunk = 1 + reader->offset % 13;
+    if (chunk > n)
+        chunk = n;
+    if (chunk > reader->size - reader->offset)
+        chunk = reader->size - reader->offset;
+    memcpy(buffer, reader->data + reader->offset, chunk);
+    reader->offset += chunk;
+    return chunk;
+}
+
+static uint64_t nextRandom(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static uint64_t mask(size_t bits) {
+    return bits < 64 ? ((uint64_t) 1 << bits) - 1 : ~(uint64_t) 0;
+}
+
+/* reference LSB first writer, bit by bit. */
+static void referencePut(unsigned char *bytes, size_t *pos, size_t bits, uint64_t value) {
+    size_t i;
+
+    for (i = 0; i < bits; ++i, ++*pos) {
+        if ((value >> i) & 0x1)
+            bytes[*pos >> 3] |= (unsigned char) (1 << (*pos & 0x7));
+        else
+            bytes[*pos >> 3] &= (unsigned char) ~(1 << (*pos & 0x7));
+    }
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    size_t pos = 0;
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    static size_t widths[FIELDS];
+    static uint64_t values[FIELDS];
+    static unsigned char reference[FIELDS * 8];
+    static uint16_t packed[FIELDS];
+    static uint16_t unpacked[FIELDS];
+    unsigned char fixed[4];
+    unsigned char const *bytes = NULL;
+    MemoryReader reader = { NULL, 0, 0 };
+    ReadResult r;
+
+    BitOutputStream bos = {0};
+    BitInputStream bis = {0};
+
+    /* DEFLATE like layout, the first field in the low bits of the byte. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    BitOutputStreamSetBitOrder(&bos, BS_LSB_FIRST);
+    TEST_ASSERT(BitOutputStreamGetBitOrder(&bos) == BS_LSB_FIRST);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteBit(&bos, 1)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 2, 2)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 9, 0x1a5)));
+    TEST_ASSERT(BitOutputStreamPaddingBits(&bos, 1) == 4);
+    TEST_ASSERT(BitOutputStreamGetSize(&bos) == 2);
+    bytes = (unsigned char const*) BitOutputStreamGetBuffer(&bos);
+    TEST_ASSERT(bytes[0] == 0x2d);
+    TEST_ASSERT(bytes[1] == 0xfd);
+
+    BitInputStreamInitialize(&bis, bytes, 16);
+    BitInputStreamSetBitOrder(&bis, BS_LSB_FIRST);
+    TEST_ASSERT(BitInputStreamGetBitOrder(&bis) == BS_LSB_FIRST);
+    TEST_ASSERT(BitInputStreamReadBit(&bis)._M_value.uint == 1);
+    TEST_ASSERT(BitInputStreamPeekUInt(&bis, 11)._M_value.uint == (0x1a5 << 2 | 2));
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 2)._M_value.uint == 2);
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 9)._M_value.uint == 0x1a5);
+    TEST_ASSERT(BitInputStreamSkipPaddingBits(&bis) == 4);
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 1)._M_status == BS_EOS);
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+
+    /* random widths against the reference writer. */
+    memset(reference, 0, sizeof(reference));
+    for (i = 0; i < FIELDS; ++i) {
+        widths[i] = 1 + nextRandom(&state) % 64;
+        values[i] = nextRandom(&state) & mask(widths[i]);
+        referencePut(reference, &pos, widths[i], values[i]);
+    }
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    BitOutputStreamSetBitOrder(&bos, BS_LSB_FIRST);
+    for (i = 0; i < FIELDS; ++i) {
+        if (i % 3 == 2) {
+            TEST_ASSERT(BitOutputStreamReserve(&bos, widths[i]) == 0);
+            BitOutputStreamWriteUIntUnchecked(&bos, widths[i], values[i] | ~mask(widths[i]));
+        } else {
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, widths[i], values[i])));
+        }
+    }
+    TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == pos);
+    TEST_ASSERT(memcmp(BitOutputStreamGetBuffer(&bos), reference, (pos + 7) >> 3) == 0);
+    BitOutputStreamRelease(&bos);
+
+    BitInputStreamInitialize(&bis, reference, pos);
+    BitInputStreamSetBitOrder(&bis, BS_LSB_FIRST);
+    for (i = 0; i < FIELDS; ++i) {
+        if (i % 4 == 1) {
+            TEST_ASSERT(BitInputStreamEnsure(&bis, widths[i]) == 0);
+            TEST_ASSERT(BitInputStreamReadUIntUnchecked(&bis, widths[i]) == values[i]);
+        } else if (i % 4 == 2) {
+            TEST_ASSERT(BitInputStreamFetchUInt(&bis, widths[i]) == values[i]);
+        } else {
+            r = BitInputStreamReadUInt(&bis, widths[i]);
+            TEST_ASSERT(BS_SUCCEEDED(r));
+            TEST_ASSERT(r._M_value.uint == values[i]);
+        }
+    }
+    TEST_ASSERT(BitInputStreamGetError(&bis) == BS_SUCCESS);
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+
+    /* seeking, and widths over 64 bits keep their first 64 bits. */
+    TEST_ASSERT(BitInputStreamSeekBits(&bis, (long) widths[0], SEEK_SET) == 0);
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, widths[1])._M_value.uint == values[1]);
+    TEST_ASSERT(BitInputStreamSeekBits(&bis, 0, SEEK_SET) == 0);
+    r = BitInputStreamReadUInt(&bis, 70);
+    TEST_ASSERT(BS_SUCCEEDED(r));
+    TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == 70);
+    BitInputStreamSeekBits(&bis, 0, SEEK_SET);
+    TEST_ASSERT(r._M_value.uint == BitInputStreamPeekUInt(&bis, 64)._M_value.uint);
+    BitInputStreamRelease(&bis);
+
+    /* the same fields through a chunked reader. */
+    reader.data = reference;
+    reader.size = (pos + 7) >> 3;
+    TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &memoryRead, &reader, 64));
+    BitInputStreamSetBitOrder(&bis, BS_LSB_FIRST);
+    for (i = 0; i < FIELDS; ++i) {
+        r = BitInputStreamReadUInt(&bis, widths[i]);
+        TEST_ASSERT(BS_SUCCEEDED(r));
+        TEST_ASSERT(r._M_value.uint == values[i]);
+    }
+    BitInputStreamRelease(&bis);
+
+    /* signed fields, the sign bit of a two's complement one comes last. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    BitOutputStreamSetBitOrder(&bos, BS_LSB_FIRST);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteInt(&bos, 5, -3)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteSInt(&bos, 7, -21)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteInt(&bos, 13, 1000)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteVarSInt(&bos, -123456789)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteVarUInt(&bos, ~(uint64_t) 0)));
+    TEST_ASSERT(BitOutputStreamWriteUE(&bos, 5)._M_status == BS_FAIL);
+    TEST_ASSERT(BitOutputStreamWriteRice(&bos, 2, 5)._M_status == BS_FAIL);
+    bytes = (unsigned char const*) BitOutputStreamGetBuffer(&bos);
+    TEST_ASSERT((bytes[0] & 0x1f) == 0x1d);
+
+    BitInputStreamInitialize(&bis, bytes, BitOutputStreamGetBitSize(&bos));
+    BitInputStreamSetBitOrder(&bis, BS_LSB_FIRST);
+    TEST_ASSERT(BitInputStreamReadInt(&bis, 5)._M_value.sint == -3);
+    TEST_ASSERT(BitInputStreamReadSInt(&bis, 7)._M_value.sint == -21);
+    TEST_ASSERT(BitInputStreamFetchInt(&bis, 13) == 1000);
+    TEST_ASSERT(BitInputStreamReadVarSInt(&bis)._M_value.sint == -123456789);
+    TEST_ASSERT(BitInputStreamReadVarUInt(&bis)._M_value.uint == ~(uint64_t) 0);
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+    TEST_ASSERT(BitInputStreamSeekBits(&bis, 0, SEEK_SET) == 0);
+    TEST_ASSERT(BitInputStreamReadUE(&bis)._M_status == BS_FAIL);
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+
+    /* overwriting in a fixed buffer keeps the bits around the field. */
+    memset(fixed, 0xff, sizeof(fixed));
+    BitOutputStreamInitialize(&bos, fixed, 32);
+    BitOutputStreamSetBitOrder(&bos, BS_LSB_FIRST);
+    TEST_ASSERT(BitOutputStreamSeekBits(&bos, 5, SEEK_SET) == 0);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 6, 0)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 32, 0)) == 0);
+    BitOutputStreamFlush(&bos);
+    TEST_ASSERT(fixed[0] == 0x1f);
+    TEST_ASSERT(fixed[1] == 0xf8);
+    TEST_ASSERT(fixed[2] == 0xff);
+    BitOutputStreamRelease(&bos);
+
+    /* switching order on a byte boundary, bulk fields both ways. */
+    for (i = 0; i < FIELDS; ++i)
+        packed[i] = (uint16_t) (nextRandom(&state) & 0x7ff);
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 8, 0xa5)));
+    BitOutputStreamSetBitOrder(&bos, BS_LSB_FIRST);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 3, 6)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUIntArray16(&bos, 11, FIELDS, packed, BS_PACK_CHECK)));
+    bytes = (unsigned char const*) BitOutputStreamGetBuffer(&bos);
+    TEST_ASSERT(bytes[0] == 0xa5);
+    TEST_ASSERT((bytes[1] & 0x7) == 6);
+    TEST_ASSERT((bytes[1] >> 3) == (packed[0] & 0x1f));
+
+    BitInputStreamInitialize(&bis, bytes, BitOutputStreamGetBitSize(&bos));
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 8)._M_value.uint == 0xa5);
+    BitInputStreamSetBitOrder(&bis, BS_LSB_FIRST);
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 3)._M_value.uint == 6);
+    BitInputStreamMark(&bis);
+    TEST_ASSERT(BS_SUCCEEDED(BitInputStreamReadUIntArray16(&bis, 11, FIELDS, unpacked)));
+    TEST_ASSERT(memcmp(packed, unpacked, sizeof(packed)) == 0);
+    BitInputStreamReset(&bis);
+    for (i = 0; i < FIELDS; ++i)
+        TEST_ASSERT(BitInputStreamReadUInt(&bis, 11)._M_value.uint == packed[i]);
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+
+    goto success;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+    return rc;
+}
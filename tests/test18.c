@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define SEGMENTS 300
+#define START_CODE 0x000001
+
+typedef struct tagDecodeContext {
+    uint64_t sums[SEGMENTS];
+    int aligned;
+    size_t failAt;
+} DecodeContext;
+
+static size_t segmentLength(size_t i) {
+    return 1 + (i * 7919) % 400;
+}
+
+static unsigned segmentValue(size_t i, size_t j) {
+    return (unsigned) ((i * 31 + j * 17) & 0x1fff);
+}
+
+/**
+ * Unaligned segments: a 13 bits count and as many 13 bits values. Aligned
+ * ones: a start code, the number of the segment plus one and payload bytes
+ * with the top bit set, up to the next start code.
+ */
+static int decodeSegment(void *context, size_t i, BitInputStream *bis) {
+    DecodeContext *decode = (DecodeContext*) context;
+    uint64_t sum = 0;
+    size_t n;
+    size_t j;
+
+    if (i == decode->failAt)
+        return 7;
+    if (decode->aligned) {
+        if (BitInputStreamReadUInt(bis, 24)._M_value.uint != START_CODE)
+            return -2;
+        if (BitInputStreamReadUInt(bis, 8)._M_value.uint != (i & 0x7f) + 1)
+            return -3;
+        while (!BitInputStreamIsEOS(bis))
+            sum += BitInputStreamReadUInt(bis, 8)._M_value.uint;
+    } else {
+        n = (size_t) BitInputStreamReadUInt(bis, 13)._M_value.uint;
+        if (n != segmentLength(i))
+            return -4;
+        for (j = 0; j < n; ++j) {
+            if (BitInputStreamReadUInt(bis, 13)._M_value.uint != segmentValue(i, j))
+                return -5;
+            sum += segmentValue(i, j);
+        }
+        /* the view ends with the segment. */
+        if (!BitInputStreamIsEOS(bis))
+            return -6;
+    }
+    decode->sums[i] = sum;
+    return 0;
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    size_t j = 0;
+    uint64_t expected[SEGMENTS];
+    uint64_t aligned[SEGMENTS];
+    static DecodeContext decode;
+
+    BSIndex *index = NULL;
+    BSIndex *scanned = NULL;
+    BitOutputStream bos = {0};
+
+    TEST_ASSERT((index = BitStreamIndexCreate()) != NULL);
+    TEST_ASSERT((scanned = BitStreamIndexCreate()) != NULL);
+
+    /* unaligned segments behind a 5 bits header, recorded while writing. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 5, 0x15)));
+    for (i = 0; i < SEGMENTS; ++i) {
+        TEST_ASSERT(BitOutputStreamAddSyncPoint(&bos, index) == 0);
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 13, segmentLength(i))));
+        expected[i] = 0;
+        for (j = 0; j < segmentLength(i); ++j) {
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 13, segmentValue(i, j))));
+            expected[i] += segmentValue(i, j);
+        }
+    }
+    TEST_ASSERT(BitStreamIndexGetCount(index) == SEGMENTS);
+    TEST_ASSERT(BitStreamIndexGet(index, 0) == 5);
+    TEST_ASSERT(BitStreamIndexAdd(index, 4) == -1);
+    TEST_ASSERT(BitStreamIndexFind(index, 0) == SEGMENTS);
+    TEST_ASSERT(BitStreamIndexFind(index, 5) == 0);
+    TEST_ASSERT(BitStreamIndexFind(index, BitStreamIndexGet(index, 7) - 1) == 6);
+    TEST_ASSERT(BitStreamIndexFind(index, BitOutputStreamGetBitSize(&bos)) == SEGMENTS - 1);
+
+    decode.aligned = 0;
+    decode.failAt = SEGMENTS;
+    TEST_ASSERT(BitStreamDecodeParallel(BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos),
+                index, &decodeSegment, &decode, 4) == 0);
+    TEST_ASSERT(memcmp(decode.sums, expected, sizeof(expected)) == 0);
+
+    memset(decode.sums, 0, sizeof(decode.sums));
+    TEST_ASSERT(BitStreamDecodeParallel(BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos),
+                index, &decodeSegment, &decode, 1) == 0);
+    TEST_ASSERT(memcmp(decode.sums, expected, sizeof(expected)) == 0);
+
+    /* the first failure stops the others. */
+    decode.failAt = 50;
+    TEST_ASSERT(BitStreamDecodeParallel(BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos),
+                index, &decodeSegment, &decode, 0) == 7);
+    BitOutputStreamRelease(&bos);
+
+    /* byte aligned segments found by their start code. */
+    BitStreamIndexClear(index);
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 16, 0xabcd)));
+    for (i = 0; i < SEGMENTS; ++i) {
+        BitOutputStreamPaddingBits(&bos, 0);
+        TEST_ASSERT(BitOutputStreamAddSyncPoint(&bos, index) == 0);
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 24, START_CODE)));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 8, (i & 0x7f) + 1)));
+        aligned[i] = 0;
+        for (j = 0; j < segmentLength(i) % 50; ++j) {
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 8, 0x80 | segmentValue(i, j))));
+            aligned[i] += 0x80 | (segmentValue(i, j) & 0xff);
+        }
+    }
+    TEST_ASSERT(BitStreamIndexScan(scanned, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos),
+                START_CODE, 24) == SEGMENTS);
+    TEST_ASSERT(BitStreamIndexGetCount(scanned) == SEGMENTS);
+    for (i = 0; i < SEGMENTS; ++i)
+        TEST_ASSERT(BitStreamIndexGet(scanned, i) == BitStreamIndexGet(index, i));
+    TEST_ASSERT(BitStreamIndexScan(scanned, BitOutputStreamGetBuffer(&bos), 16, START_CODE, 12) == -1);
+
+    decode.aligned = 1;
+    decode.failAt = SEGMENTS;
+    TEST_ASSERT(BitStreamDecodeParallel(BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos),
+                scanned, &decodeSegment, &decode, 3) == 0);
+    TEST_ASSERT(memcmp(decode.sums, aligned, sizeof(aligned)) == 0);
+    BitOutputStreamRelease(&bos);
+
+    goto success;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitStreamIndexDestroy(index);
+    BitStreamIndexDestroy(scanned);
+    BitOutputStreamRelease(&bos);
+    return rc;
+}
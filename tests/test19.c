@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define SOURCE_BYTES 4096
+#define RUNS 400
+#define PARTITIONS 37
+
+typedef struct tagCollector {
+    unsigned char data[1 << 16];
+    size_t size;
+} Collector;
+
+static size_t collect(void *context, void const *buffer, size_t n) {
+    Collector *collector = (Collector*) context;
+    if (n > sizeof(collector->data) - collector->size)
+        return 0;
+    memcpy(collector->data + collector->size, buffer, n);
+    collector->size += n;
+    return n;
+}
+
+static uint64_t nextRandom(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static int bitAt(unsigned char const *bytes, size_t pos, BSBitOrder order) {
+    return order == BS_LSB_FIRST ? (bytes[pos >> 3] >> (pos & 0x7)) & 0x1
+        : (bytes[pos >> 3] >> (7 - (pos & 0x7))) & 0x1;
+}
+
+/* the reference, one bit at a time. */
+static int writeBitByBit(BitOutputStream *bos, unsigned char const *bytes, size_t offset, size_t bits,
+        BSBitOrder order) {
+    size_t i;
+
+    for (i = 0; i < bits; ++i)
+        if (!BS_SUCCEEDED(BitOutputStreamWriteBit(bos, bitAt(bytes, offset + i, order))))
+            return -1;
+    return 0;
+}
+
+/* the bits after the end of the last byte are whatever memory held. */
+static int sameBits(void const *a, void const *b, size_t bits, BSBitOrder order) {
+    unsigned char const *x = (unsigned char const*) a;
+    unsigned char const *y = (unsigned char const*) b;
+    size_t i;
+
+    if (memcmp(x, y, bits >> 3) != 0)
+        return 0;
+    for (i = bits & ~(size_t) 0x7; i < bits; ++i)
+        if (bitAt(x, i, order) != bitAt(y, i, order))
+            return 0;
+    return 1;
+}
+
+/* a bump allocator without any locking, blocks remember their size for realloc. */
+typedef struct tagArena {
+    unsigned char data[1 << 20];
+    size_t used;
+    size_t calls;
+} Arena;
+
+static void* arenaMalloc(void *context, size_t n) {
+    Arena *arena = (Arena*) context;
+    size_t *block;
+
+    ++arena->calls;
+    n = (n + 15) & ~(size_t) 15;
+    if (n + 16 > sizeof(arena->data) - arena->used)
+        return NULL;
+    block = (size_t*) (arena->data + arena->used);
+    *block = n;
+    arena->used += n + 16;
+    return (unsigned char*) block + 16;
+}
+
+static void* arenaRealloc(void *context, void *p, size_t n) {
+    void *q = arenaMalloc(context, n);
+    size_t old;
+
+    if (q && p) {
+        old = *(size_t*) ((unsigned char*) p - 16);
+        memcpy(q, p, old < n ? old : n);
+    }
+    return q;
+}
+
+static void arenaFree(void *context, void *p) {
+    (void) context;
+    (void) p;
+}
+
+/* partitions of odd lengths, so that they land on every alignment. */
+static int encodePartition(void *context, size_t i, BitOutputStream *bos) {
+    size_t j;
+
+    (void) context;
+    for (j = 0; j < 100 + i * 13; ++j)
+        if (!BS_SUCCEEDED(BitOutputStreamWriteUInt(bos, 1 + (i + j) % 29, i * 977 + j)))
+            return -1;
+    return 0;
+}
+
+static int failPartition(void *context, size_t i, BitOutputStream *bos) {
+    return i == 5 ? -1 : encodePartition(context, i, bos);
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    size_t offset = 0;
+    size_t bits = 0;
+    int order = 0;
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    static unsigned char source[SOURCE_BYTES];
+    static Collector collector;
+    size_t expectedBits = 0;
+    static Arena arena;
+    BSAllocator allocator;
+
+    BitOutputStream bos = {0};
+    BitOutputStream expected = {0};
+    BitOutputStream tail = {0};
+
+    for (i = 0; i < SOURCE_BYTES; ++i)
+        source[i] = (unsigned char) nextRandom(&state);
+
+    /* random runs at random alignments against the bit by bit copy, both orders. */
+    for (order = BS_MSB_FIRST; order <= BS_LSB_FIRST; ++order) {
+        TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+        TEST_ASSERT(BitOutputStreamInitialize(&expected, NULL, 0));
+        BitOutputStreamSetBitOrder(&bos, (BSBitOrder) order);
+        BitOutputStreamSetBitOrder(&expected, (BSBitOrder) order);
+        for (i = 0; i < RUNS; ++i) {
+            offset = nextRandom(&state) % (SOURCE_BYTES * 4);
+            bits = nextRandom(&state) % (i % 8 == 0 ? SOURCE_BYTES * 4 : 200);
+            if (i % 5 == 0)
+                offset &= ~(size_t) 0x7;
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteBits(&bos, source, offset, bits)));
+            TEST_ASSERT(writeBitByBit(&expected, source, offset, bits, (BSBitOrder) order) == 0);
+            /* some plain fields in between. */
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, i % 7, i)));
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&expected, i % 7, i)));
+        }
+        TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == BitOutputStreamGetBitSize(&expected));
+        TEST_ASSERT(sameBits(BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBuffer(&expected),
+                    BitOutputStreamGetBitSize(&bos), (BSBitOrder) order));
+
+        /* appending a whole stream behind a 3 bits field. */
+        BitOutputStreamRelease(&bos);
+        TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+        TEST_ASSERT(BitOutputStreamInitialize(&tail, NULL, 0));
+        BitOutputStreamSetBitOrder(&bos, (BSBitOrder) order);
+        BitOutputStreamSetBitOrder(&tail, (BSBitOrder) order);
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&tail, 3, 5)));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamAppend(&tail, &expected)));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 3, 5)));
+        TEST_ASSERT(writeBitByBit(&bos, (unsigned char const*) BitOutputStreamGetBuffer(&expected), 0,
+                    BitOutputStreamGetBitSize(&expected), (BSBitOrder) order) == 0);
+        TEST_ASSERT(BitOutputStreamGetBitSize(&tail) == BitOutputStreamGetBitSize(&bos));
+        TEST_ASSERT(sameBits(BitOutputStreamGetBuffer(&tail), BitOutputStreamGetBuffer(&bos),
+                    BitOutputStreamGetBitSize(&bos), (BSBitOrder) order));
+        TEST_ASSERT(BitOutputStreamAppend(&tail, &tail)._M_status == BS_FAIL);
+        BitOutputStreamRelease(&tail);
+        BitOutputStreamRelease(&expected);
+        BitOutputStreamRelease(&bos);
+    }
+
+    /* orders do not mix. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    TEST_ASSERT(BitOutputStreamInitialize(&tail, NULL, 0));
+    BitOutputStreamSetBitOrder(&tail, BS_LSB_FIRST);
+    TEST_ASSERT(BitOutputStreamAppend(&bos, &tail)._M_status == BS_FAIL);
+    BitOutputStreamRelease(&tail);
+    BitOutputStreamRelease(&bos);
+
+    /* a sink backed stream takes long runs buffer by buffer. */
+    TEST_ASSERT(BitOutputStreamInitializeWithWriter(&bos, &collect, &collector, 100));
+    TEST_ASSERT(BitOutputStreamInitialize(&expected, NULL, 0));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 5, 0x11)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&expected, 5, 0x11)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteBits(&bos, source, 3, SOURCE_BYTES * 8 - 3)));
+    TEST_ASSERT(writeBitByBit(&expected, source, 3, SOURCE_BYTES * 8 - 3, BS_MSB_FIRST) == 0);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamFinish(&bos, 0)));
+    TEST_ASSERT(collector.size == SOURCE_BYTES + 1);
+    TEST_ASSERT(memcmp(collector.data, BitOutputStreamGetBuffer(&expected), collector.size - 1) == 0);
+    BitOutputStreamRelease(&expected);
+    BitOutputStreamRelease(&bos);
+
+    /* parallel encoding matches the serial one. */
+    TEST_ASSERT(BitOutputStreamInitialize(&expected, NULL, 0));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&expected, 7, 0x55)));
+    for (i = 0; i < PARTITIONS; ++i)
+        TEST_ASSERT(encodePartition(NULL, i, &expected) == 0);
+    expectedBits = BitOutputStreamGetBitSize(&expected);
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 7, 0x55)));
+    TEST_ASSERT(BS_SUCCEEDED(BitStreamEncodeParallel(&bos, PARTITIONS, &encodePartition, NULL, 4)));
+    TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == expectedBits);
+    TEST_ASSERT(sameBits(BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBuffer(&expected),
+                expectedBits, BS_MSB_FIRST));
+    BitOutputStreamReset(&bos);
+    TEST_ASSERT(BitStreamEncodeParallel(&bos, PARTITIONS, &failPartition, NULL, 0)._M_status == BS_FAIL);
+    BitOutputStreamRelease(&bos);
+
+    /* only the target stream uses its allocator, which needs no locking. */
+    allocator._M_malloc = &arenaMalloc;
+    allocator._M_realloc = &arenaRealloc;
+    allocator._M_free = &arenaFree;
+    allocator._M_context = &arena;
+    TEST_ASSERT(BitOutputStreamInitializeWithAllocator(&bos, NULL, 0, &allocator));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 7, 0x55)));
+    TEST_ASSERT(BS_SUCCEEDED(BitStreamEncodeParallel(&bos, PARTITIONS, &encodePartition, NULL, 4)));
+    TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == expectedBits);
+    TEST_ASSERT(sameBits(BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBuffer(&expected),
+                expectedBits, BS_MSB_FIRST));
+    TEST_ASSERT(arena.calls > 0 && arena.calls < PARTITIONS);
+    BitOutputStreamRelease(&expected);
+    BitOutputStreamRelease(&bos);
+
+    goto success;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitOutputStreamRelease(&bos);
+    BitOutputStreamRelease(&expected);
+    BitOutputStreamRelease(&tail);
+    return rc;
+}
@@ -0,0 +1,202 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define TEXT_BYTES 40000
+
+typedef struct tagReader {
+    unsigned char const *data;
+    size_t size;
+    size_t position;
+} Reader;
+
+/* hands out odd sized pieces. */
+static size_t produce(void *context, void *buffer, size_t n) {
+    Reader *reader = (Reader*) context;
+    if (n > 37)
+        n = 37;
+    if (n > reader->size - reader->position)
+        n = reader->size - reader->position;
+    memcpy(buffer, reader->data + reader->position, n);
+    reader->position += n;
+    return n;
+}
+
+/* "aé€😀" repeated, the multi byte characters land across every block boundary. */
+static size_t fillText(char *text, size_t n) {
+    static char const pattern[] = "a\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80";
+    size_t i;
+
+    for (i = 0; i + sizeof(pattern) - 1 <= n; i += sizeof(pattern) - 1)
+        memcpy(text + i, pattern, sizeof(pattern) - 1);
+    return i;
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    int order = 0;
+    size_t shift = 0;
+    size_t i = 0;
+    size_t n = 0;
+    static char text[TEXT_BYTES];
+    static char back[TEXT_BYTES];
+    void const *view = NULL;
+    ReadResult r;
+    Reader reader;
+
+    BitOutputStream bos = {0};
+    BitInputStream bis = {0};
+
+    for (i = 0; i < TEXT_BYTES; ++i)
+        text[i] = (char) (i * 131 + (i >> 7));
+
+    /* byte strings at every alignment round trip in both orders. */
+    for (order = BS_MSB_FIRST; order <= BS_LSB_FIRST; ++order) {
+        for (shift = 0; shift < 8; ++shift) {
+            TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+            BitOutputStreamSetBitOrder(&bos, (BSBitOrder) order);
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, shift, 0x55)));
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteChar8(&bos, 3, text)));
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteChar8(&bos, TEXT_BYTES - 3, text + 3)));
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 5, 0x11)));
+            TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == shift + TEXT_BYTES * 8 + 5);
+            BitOutputStreamFlush(&bos);
+
+            /* against a field by field read. */
+            TEST_ASSERT(BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos)));
+            BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+            TEST_ASSERT(BitInputStreamReadUInt(&bis, shift)._M_value.uint == (0x55 & ((1u << shift) - 1)));
+            for (i = 0; i < 1000; ++i)
+                TEST_ASSERT(BitInputStreamReadUInt(&bis, 8)._M_value.uint == (unsigned char) text[i]);
+            BitInputStreamRelease(&bis);
+
+            TEST_ASSERT(BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos)));
+            BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+            TEST_ASSERT(BitInputStreamReadUInt(&bis, shift)._M_value.uint == (0x55 & ((1u << shift) - 1)));
+            r = BitInputStreamReadChar8(&bis, 1, back);
+            TEST_ASSERT(BS_SUCCEEDED(r) && r._M_value.uint == 1);
+            r = BitInputStreamReadChar8(&bis, TEXT_BYTES - 1, back + 1);
+            TEST_ASSERT(BS_SUCCEEDED(r) && r._M_value.uint == TEXT_BYTES - 1);
+            TEST_ASSERT(memcmp(back, text, TEXT_BYTES) == 0);
+            TEST_ASSERT(BitInputStreamReadUInt(&bis, 5)._M_value.uint == 0x11);
+            /* short of bytes. */
+            r = BitInputStreamReadChar8(&bis, 1, back);
+            TEST_ASSERT(r._M_status == BS_EOS && r._M_value.uint == 0);
+            BitInputStreamRelease(&bis);
+            BitOutputStreamRelease(&bos);
+        }
+    }
+
+    /* a source backed stream, refilled piece by piece. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 3, 0x5)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteChar8(&bos, TEXT_BYTES, text)));
+    BitOutputStreamPaddingBits(&bos, 0);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteChar8(&bos, 100, text)));
+    BitOutputStreamFlush(&bos);
+    reader.data = (unsigned char const*) BitOutputStreamGetBuffer(&bos);
+    reader.size = BitOutputStreamGetBitSize(&bos) >> 3;
+    reader.position = 0;
+    TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &produce, &reader, 64));
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 3)._M_value.uint == 0x5);
+    memset(back, 0, sizeof(back));
+    r = BitInputStreamReadChar8(&bis, TEXT_BYTES, back);
+    TEST_ASSERT(BS_SUCCEEDED(r) && r._M_value.uint == TEXT_BYTES);
+    TEST_ASSERT(memcmp(back, text, TEXT_BYTES) == 0);
+    /* views need a byte boundary and fit in the window. */
+    TEST_ASSERT(BitInputStreamReadBytesView(&bis, 10, &view)._M_status == BS_FAIL);
+    BitInputStreamSkipBits(&bis, 5);
+    for (i = 0; i < 100; i += 20) {
+        TEST_ASSERT(BS_SUCCEEDED(BitInputStreamReadBytesView(&bis, 20, &view)));
+        TEST_ASSERT(memcmp(view, text + i, 20) == 0);
+    }
+    TEST_ASSERT(BitInputStreamReadBytesView(&bis, 1, &view)._M_status == BS_EOS);
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+
+    /* a view of an in memory stream points into its buffer. */
+    TEST_ASSERT(BitInputStreamInitialize(&bis, text, TEXT_BYTES * 8));
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 16)._M_value.uint == (unsigned) (((unsigned char) text[0] << 8) | (unsigned char) text[1]));
+    TEST_ASSERT(BS_SUCCEEDED(BitInputStreamReadBytesView(&bis, TEXT_BYTES - 2, &view)));
+    TEST_ASSERT(view == text + 2);
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+    BitInputStreamRelease(&bis);
+
+    /* UTF-8 checks. */
+    TEST_ASSERT(BitStreamIsValidUtf8("plain ascii text, long enough for a vector", 42));
+    TEST_ASSERT(BitStreamIsValidUtf8("\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\xed\x9f\xbf\xf4\x8f\xbf\xbf", 16));
+    TEST_ASSERT(!BitStreamIsValidUtf8("\xc0\xaf", 2));
+    TEST_ASSERT(!BitStreamIsValidUtf8("\xe0\x80\xaf", 3));
+    TEST_ASSERT(!BitStreamIsValidUtf8("\xed\xa0\x80", 3));
+    TEST_ASSERT(!BitStreamIsValidUtf8("\xf4\x90\x80\x80", 4));
+    TEST_ASSERT(!BitStreamIsValidUtf8("\xf5\x80\x80\x80", 4));
+    TEST_ASSERT(!BitStreamIsValidUtf8("\x80", 1));
+    TEST_ASSERT(!BitStreamIsValidUtf8("abc\xe2\x82", 5));
+    TEST_ASSERT(!BitStreamIsValidUtf8("0123456789abcdef0123456789\xff", 27));
+
+    n = fillText(text, TEXT_BYTES);
+    TEST_ASSERT(BitStreamIsValidUtf8(text, n));
+    for (order = BS_MSB_FIRST; order <= BS_LSB_FIRST; ++order) {
+        TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+        BitOutputStreamSetBitOrder(&bos, (BSBitOrder) order);
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 1, 1)));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUtf8Checked(&bos, n, text)));
+        /* a string cut in the middle of a character is not written. */
+        TEST_ASSERT(BitOutputStreamWriteUtf8Checked(&bos, n - 1, text)._M_status == BS_FAIL);
+        TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == 1 + n * 8);
+        BitOutputStreamFlush(&bos);
+
+        TEST_ASSERT(BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos)));
+        BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+        BitInputStreamSkipBits(&bis, 1);
+        r = BitInputStreamReadUtf8Checked(&bis, n, back);
+        TEST_ASSERT(BS_SUCCEEDED(r) && r._M_value.uint == n);
+        TEST_ASSERT(memcmp(back, text, n) == 0);
+        BitInputStreamRelease(&bis);
+
+        /* cut short of a whole character. */
+        TEST_ASSERT(BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos)));
+        BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+        BitInputStreamSkipBits(&bis, 1);
+        TEST_ASSERT(BitInputStreamReadUtf8Checked(&bis, n - 2, back)._M_status == BS_FAIL);
+        BitInputStreamRelease(&bis);
+        BitOutputStreamRelease(&bos);
+    }
+
+    /* a stray byte deep in the second block. */
+    text[(16 << 10) + 996] = (char) 0xbf;
+    TEST_ASSERT(BitInputStreamInitialize(&bis, text, n * 8));
+    TEST_ASSERT(BitInputStreamReadUtf8Checked(&bis, n, back)._M_status == BS_FAIL);
+    BitInputStreamRelease(&bis);
+    /* the first block already written is taken back. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 3, 0x5)));
+    TEST_ASSERT(BitOutputStreamWriteUtf8Checked(&bos, n, text)._M_status == BS_FAIL);
+    TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == 3);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 13, 0x1234)));
+    BitOutputStreamFlush(&bos);
+    TEST_ASSERT(memcmp(BitOutputStreamGetBuffer(&bos), "\xb2\x34", 2) == 0);
+    BitOutputStreamRelease(&bos);
+
+    goto success;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+    return rc;
+}
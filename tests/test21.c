@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define SOURCE_BYTES 20000
+
+typedef struct tagReader {
+    unsigned char const *data;
+    size_t size;
+    size_t position;
+} Reader;
+
+typedef struct tagCollector {
+    unsigned char data[SOURCE_BYTES + 16];
+    size_t size;
+} Collector;
+
+/* hands out odd sized pieces. */
+static size_t produce(void *context, void *buffer, size_t n) {
+    Reader *reader = (Reader*) context;
+    if (n > 301)
+        n = 301;
+    if (n > reader->size - reader->position)
+        n = reader->size - reader->position;
+    memcpy(buffer, reader->data + reader->position, n);
+    reader->position += n;
+    return n;
+}
+
+static size_t collect(void *context, void const *buffer, size_t n) {
+    Collector *collector = (Collector*) context;
+    if (n > sizeof(collector->data) - collector->size)
+        return 0;
+    memcpy(collector->data + collector->size, buffer, n);
+    collector->size += n;
+    return n;
+}
+
+/* the field by field copy, up to 57 bits at a time. */
+static int copyByFields(BitOutputStream *bos, BitInputStream *bis, size_t bits) {
+    ReadResult r;
+    size_t n;
+
+    for (; bits > 0; bits -= n) {
+        n = bits < 57 ? bits : 57;
+        r = BitInputStreamReadUInt(bis, n);
+        if (!BS_SUCCEEDED(r) || !BS_SUCCEEDED(BitOutputStreamWriteUInt(bos, n, r._M_value.uint)))
+            return -1;
+    }
+    return 0;
+}
+
+/* the bits after the end of the last byte are whatever memory held. */
+static int sameBits(void const *a, void const *b, size_t bits, BSBitOrder order) {
+    unsigned char const *x = (unsigned char const*) a;
+    unsigned char const *y = (unsigned char const*) b;
+    unsigned mask = order == BS_LSB_FIRST ? (1u << (bits & 0x7)) - 1 : (0xff00u >> (bits & 0x7)) & 0xff;
+
+    if (memcmp(x, y, bits >> 3) != 0)
+        return 0;
+    return !(bits & 0x7) || ((x[bits >> 3] ^ y[bits >> 3]) & mask) == 0;
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    int order = 0;
+    size_t from = 0;
+    size_t to = 0;
+    size_t i = 0;
+    size_t bits = 0;
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    static unsigned char source[SOURCE_BYTES];
+    static Collector collector;
+    Reader reader;
+
+    BitInputStream bis = {0};
+    BitInputStream expectedIn = {0};
+    BitOutputStream bos = {0};
+    BitOutputStream expected = {0};
+
+    for (i = 0; i < SOURCE_BYTES; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        source[i] = (unsigned char) state;
+    }
+
+    /* every pair of alignments, runs of every length class, both orders. */
+    for (order = BS_MSB_FIRST; order <= BS_LSB_FIRST; ++order) {
+        for (from = 0; from < 8; ++from) {
+            for (to = 0; to < 8; ++to) {
+                bits = (from * 8 + to) * 997 % (SOURCE_BYTES * 8 - 64);
+                TEST_ASSERT(BitInputStreamInitialize(&bis, source, SOURCE_BYTES * 8));
+                TEST_ASSERT(BitInputStreamInitialize(&expectedIn, source, SOURCE_BYTES * 8));
+                TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+                TEST_ASSERT(BitOutputStreamInitialize(&expected, NULL, 0));
+                BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+                BitInputStreamSetBitOrder(&expectedIn, (BSBitOrder) order);
+                BitOutputStreamSetBitOrder(&bos, (BSBitOrder) order);
+                BitOutputStreamSetBitOrder(&expected, (BSBitOrder) order);
+
+                /* a patched field in between two copied runs. */
+                BitInputStreamSkipBits(&bis, from);
+                BitInputStreamSkipBits(&expectedIn, from);
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, to, 0x5a)));
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&expected, to, 0x5a)));
+                TEST_ASSERT(BS_SUCCEEDED(BitStreamCopyBits(&bos, &bis, bits)));
+                TEST_ASSERT(copyByFields(&expected, &expectedIn, bits) == 0);
+                TEST_ASSERT(BitInputStreamReadUInt(&bis, 11)._M_value.uint
+                        == BitInputStreamReadUInt(&expectedIn, 11)._M_value.uint);
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 11, 0x3c3)));
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&expected, 11, 0x3c3)));
+                TEST_ASSERT(BS_SUCCEEDED(BitStreamCopyBits(&bos, &bis, 53)));
+                TEST_ASSERT(copyByFields(&expected, &expectedIn, 53) == 0);
+
+                TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == BitInputStreamGetBitPosition(&expectedIn));
+                TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == BitOutputStreamGetBitSize(&expected));
+                BitOutputStreamFlush(&bos);
+                BitOutputStreamFlush(&expected);
+                TEST_ASSERT(sameBits(BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBuffer(&expected),
+                            BitOutputStreamGetBitSize(&bos), (BSBitOrder) order));
+                BitInputStreamRelease(&bis);
+                BitInputStreamRelease(&expectedIn);
+                BitOutputStreamRelease(&bos);
+                BitOutputStreamRelease(&expected);
+            }
+        }
+    }
+
+    /* a source backed input into a sink backed output, past the end of the input. */
+    reader.data = source;
+    reader.size = SOURCE_BYTES;
+    reader.position = 0;
+    TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &produce, &reader, 1000));
+    TEST_ASSERT(BitInputStreamInitialize(&expectedIn, source, SOURCE_BYTES * 8));
+    TEST_ASSERT(BitOutputStreamInitializeWithWriter(&bos, &collect, &collector, 100));
+    TEST_ASSERT(BitOutputStreamInitialize(&expected, NULL, 0));
+    BitInputStreamSkipBits(&bis, 6);
+    BitInputStreamSkipBits(&expectedIn, 6);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 3, 0x2)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&expected, 3, 0x2)));
+    TEST_ASSERT(BitStreamCopyBits(&bos, &bis, SOURCE_BYTES * 8)._M_status == BS_EOS);
+    TEST_ASSERT(copyByFields(&expected, &expectedIn, SOURCE_BYTES * 8 - 6) == 0);
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+    TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == BitOutputStreamGetBitSize(&expected));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamFinish(&bos, 0)));
+    BitOutputStreamFlush(&expected);
+    TEST_ASSERT(collector.size == SOURCE_BYTES);
+    TEST_ASSERT(sameBits(collector.data, BitOutputStreamGetBuffer(&expected), SOURCE_BYTES * 8 - 3, BS_MSB_FIRST));
+    BitInputStreamRelease(&bis);
+    BitInputStreamRelease(&expectedIn);
+    BitOutputStreamRelease(&bos);
+    BitOutputStreamRelease(&expected);
+
+    /* orders do not mix. */
+    TEST_ASSERT(BitInputStreamInitialize(&bis, source, SOURCE_BYTES * 8));
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    BitOutputStreamSetBitOrder(&bos, BS_LSB_FIRST);
+    TEST_ASSERT(BitStreamCopyBits(&bos, &bis, 8)._M_status == BS_FAIL);
+    TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == 0);
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+
+    goto success;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    BitInputStreamRelease(&expectedIn);
+    BitOutputStreamRelease(&bos);
+    BitOutputStreamRelease(&expected);
+    return rc;
+}
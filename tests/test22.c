@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+typedef struct tagCollector {
+    unsigned char data[4096];
+    size_t size;
+} Collector;
+
+static size_t collect(void *context, void const *buffer, size_t n) {
+    Collector *collector = (Collector*) context;
+    if (n > sizeof(collector->data) - collector->size)
+        return 0;
+    memcpy(collector->data + collector->size, buffer, n);
+    collector->size += n;
+    return n;
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    unsigned char fixed[4];
+    uint16_t values[100];
+    static Collector collector;
+    BSStats stats;
+    BSStats zero;
+
+    BitOutputStream bos = {0};
+    BitInputStream bis = {0};
+
+    memset(&zero, 0, sizeof(zero));
+    BitStreamResetStats();
+    if (BitStreamGetStats(&stats) != 0) {
+        /* built without the counters: nothing is counted. */
+        TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 13, 0x1234)));
+        TEST_ASSERT(BitStreamGetStats(&stats) == -1);
+        TEST_ASSERT(memcmp(&stats, &zero, sizeof(stats)) == 0);
+        goto success;
+    }
+    TEST_ASSERT(memcmp(&stats, &zero, sizeof(stats)) == 0);
+
+    /* a growable stream, expanding as it goes. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    for (i = 0; i < 100; ++i)
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 13, i)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteBit(&bos, 1)));
+    TEST_ASSERT(BitStreamGetStats(&stats) == 0);
+    TEST_ASSERT(stats._M_write_calls == 101);
+    TEST_ASSERT(stats._M_bits_written == 1301);
+    TEST_ASSERT(stats._M_write_misses > 0 && stats._M_write_misses == stats._M_expansions);
+    TEST_ASSERT(stats._M_expansion_bytes < 1301 / 8 * 2);
+    TEST_ASSERT(stats._M_failures == 0);
+
+    /* bulk writes count their bits. */
+    for (i = 0; i < 100; ++i)
+        values[i] = (uint16_t) i;
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUIntArray16(&bos, 7, 100, values, BS_PACK_MASK)));
+    TEST_ASSERT(BitStreamGetStats(&stats) == 0);
+    TEST_ASSERT(stats._M_bulk_calls == 1);
+    TEST_ASSERT(stats._M_bits_written == 2001);
+
+    /* reads, misses, seeks and the end of the stream. */
+    BitStreamResetStats();
+    TEST_ASSERT(BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos)));
+    for (i = 0; i < 100; ++i)
+        TEST_ASSERT(BitInputStreamReadUInt(&bis, 13)._M_value.uint == i);
+    TEST_ASSERT(BitInputStreamReadBit(&bis)._M_value.uint == 1);
+    TEST_ASSERT(BS_SUCCEEDED(BitInputStreamReadUIntArray16(&bis, 7, 100, values)));
+    TEST_ASSERT(BitInputStreamReadUInt(&bis, 1)._M_status == BS_EOS);
+    TEST_ASSERT(BitInputStreamSeekBits(&bis, 13, SEEK_SET) == 0);
+    TEST_ASSERT(BitStreamGetStats(&stats) == 0);
+    TEST_ASSERT(stats._M_read_calls == 102);
+    TEST_ASSERT(stats._M_bits_read == 2001);
+    TEST_ASSERT(stats._M_read_misses > 0 && stats._M_read_misses < 100);
+    TEST_ASSERT(stats._M_eos == 1);
+    TEST_ASSERT(stats._M_seeks == 1);
+    TEST_ASSERT(stats._M_write_calls == 0);
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+
+    /* a fixed stream which runs out of room. */
+    BitStreamResetStats();
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, fixed, 32));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 30, 1)));
+    TEST_ASSERT(BitOutputStreamWriteUInt(&bos, 3, 1)._M_status == BS_FAIL);
+    TEST_ASSERT(BitStreamGetStats(&stats) == 0);
+    TEST_ASSERT(stats._M_failures == 1 && stats._M_write_misses == 1 && stats._M_expansions == 0);
+    BitOutputStreamRelease(&bos);
+
+    /* sink drains. */
+    BitStreamResetStats();
+    TEST_ASSERT(BitOutputStreamInitializeWithWriter(&bos, &collect, &collector, 100));
+    for (i = 0; i < 1000; ++i)
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 16, i)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamFinish(&bos, 0)));
+    TEST_ASSERT(BitStreamGetStats(&stats) == 0);
+    TEST_ASSERT(stats._M_drains >= 2000 / 100);
+    TEST_ASSERT(stats._M_drain_bytes == 2000 && collector.size == 2000);
+    BitOutputStreamRelease(&bos);
+
+    goto success;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+    return rc;
+}
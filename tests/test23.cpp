@@ -0,0 +1,162 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <tuple>
+#include <utility>
+
+#include "../src/bitstream.hpp"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+namespace bs = bitstream;
+
+typedef bs::record<bs::u<3>, bs::flag, bs::i<13>, bs::u<32>, bs::u<64>, bs::i<7>> Header;
+
+/* every width 1..64 through the templates, against the C calls. */
+template <std::size_t... N>
+static bool writeWidths(bs::output &out, BitOutputStream *bos, std::uint64_t seed, std::index_sequence<N...>) {
+    bool ok = true;
+    ((ok = ok && out.write<N + 1>(seed * (N + 1))
+      && BS_SUCCEEDED(BitOutputStreamWriteUInt(bos, N + 1, seed * (N + 1)))), ...);
+    return ok;
+}
+
+template <std::size_t... N>
+static bool readWidths(bs::input &in, BitInputStream *bis, std::index_sequence<N...>) {
+    bool ok = true;
+    ((ok = ok && in.read<N + 1>() == BitInputStreamReadUInt(bis, N + 1)._M_value.uint), ...);
+    return ok && in.ok();
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    int order = 0;
+    std::size_t k = 0;
+    unsigned char fixed[8];
+    Header::value_type values;
+    Header::value_type back;
+
+    BitOutputStream bos = {};
+    BitOutputStream twin = {};
+    BitInputStream bis = {};
+    BitInputStream other = {};
+
+    static_assert(Header::bits == 3 + 1 + 13 + 32 + 64 + 7, "record width");
+    static_assert(bs::mask<64> == ~std::uint64_t(0) && bs::mask<5> == 0x1f, "masks");
+
+    for (order = BS_MSB_FIRST; order <= BS_LSB_FIRST; ++order) {
+        /* single fields, interleaved with C calls on the same stream. */
+        TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+        TEST_ASSERT(BitOutputStreamInitialize(&twin, NULL, 0));
+        BitOutputStreamSetBitOrder(&bos, (BSBitOrder) order);
+        BitOutputStreamSetBitOrder(&twin, (BSBitOrder) order);
+        {
+            bs::output out(bos);
+            for (k = 0; k < 20; ++k) {
+                TEST_ASSERT(writeWidths(out, &twin, 0x9e3779b97f4a7c15ULL + k, std::make_index_sequence<64>()));
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 3, k)));
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&twin, 3, k)));
+            }
+            TEST_ASSERT(out.write_int<9>(-100));
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteInt(&twin, 9, -100)));
+        }
+        TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == BitOutputStreamGetBitSize(&twin));
+        TEST_ASSERT(std::memcmp(BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBuffer(&twin),
+                    BitOutputStreamGetBitSize(&bos) >> 3) == 0);
+
+        TEST_ASSERT(BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos)));
+        TEST_ASSERT(BitInputStreamInitialize(&other, BitOutputStreamGetBuffer(&twin), BitOutputStreamGetBitSize(&twin)));
+        BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+        BitInputStreamSetBitOrder(&other, (BSBitOrder) order);
+        {
+            bs::input in(bis);
+            for (k = 0; k < 20; ++k) {
+                TEST_ASSERT(readWidths(in, &other, std::make_index_sequence<64>()));
+                TEST_ASSERT(BitInputStreamReadUInt(&bis, 3)._M_value.uint == (k & 7));
+                /* and again through the template after a C seek back. */
+                TEST_ASSERT(BitInputStreamSeekBits(&bis, -3, SEEK_CUR) == 0);
+                TEST_ASSERT(in.read<3>() == (k & 7));
+                TEST_ASSERT(BitInputStreamReadUInt(&other, 3)._M_value.uint == (k & 7));
+            }
+            TEST_ASSERT(in.read_int<9>() == -100);
+            TEST_ASSERT(in.read<1>() == 0 && !in.ok() && in.error() == BS_EOS);
+            TEST_ASSERT(in.read<8>() == 0);
+            in.clear_error();
+            TEST_ASSERT(in.ok());
+        }
+        BitInputStreamRelease(&other);
+        BitInputStreamRelease(&bis);
+        BitOutputStreamRelease(&twin);
+        BitOutputStreamRelease(&bos);
+
+        /* records, behind an odd C field. */
+        TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+        BitOutputStreamSetBitOrder(&bos, (BSBitOrder) order);
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 5, 0x13)));
+        {
+            bs::output out(bos);
+            for (k = 0; k < 100; ++k) {
+                values = Header::value_type((std::uint8_t) (k & 7), (k & 1) != 0, (std::int16_t) (k * 37 - 4096),
+                        (std::uint32_t) (k * 2654435761u), 0xfedcba9876543210ULL ^ k, (std::int8_t) ((int) k % 64 - 64));
+                TEST_ASSERT(Header::encode(out, values));
+            }
+        }
+        TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == 5 + 100 * Header::bits);
+        TEST_ASSERT(BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos) - 1));
+        BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+        TEST_ASSERT(BitInputStreamReadUInt(&bis, 5)._M_value.uint == 0x13);
+        {
+            bs::input in(bis);
+            for (k = 0; k < 99; ++k) {
+                values = Header::value_type((std::uint8_t) (k & 7), (k & 1) != 0, (std::int16_t) (k * 37 - 4096),
+                        (std::uint32_t) (k * 2654435761u), 0xfedcba9876543210ULL ^ k, (std::int8_t) ((int) k % 64 - 64));
+                TEST_ASSERT(Header::decode(in, back));
+                TEST_ASSERT(back == values);
+                /* C reads go on where the record ended. */
+                if (k == 50) {
+                    TEST_ASSERT(BitInputStreamPeekUInt(&bis, 3)._M_value.uint == 51 % 8);
+                }
+            }
+            /* the last record is one bit short, nothing of it is read. */
+            TEST_ASSERT(!Header::decode(in, back));
+            TEST_ASSERT(in.error() == BS_EOS);
+            TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == 5 + 99 * Header::bits);
+        }
+        BitInputStreamRelease(&bis);
+        BitOutputStreamRelease(&bos);
+    }
+
+    /* a fixed output without room for the record writes nothing. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, fixed, 64));
+    {
+        bs::output out(bos);
+        TEST_ASSERT(out.write<60>(1));
+        TEST_ASSERT(!Header::encode(out, values));
+        TEST_ASSERT(!out.ok() && out.error() == BS_FAIL);
+        TEST_ASSERT(!out.write<1>(1));
+        out.clear_error();
+        TEST_ASSERT(out.write<4>(0xf));
+        TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == 64);
+    }
+    BitOutputStreamRelease(&bos);
+
+    goto success;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    BitInputStreamRelease(&other);
+    BitOutputStreamRelease(&bos);
+    BitOutputStreamRelease(&twin);
+    return rc;
+}
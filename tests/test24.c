@@ -0,0 +1,357 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define RECORDS 500
+
+typedef struct tagSample {
+    uint16_t a;
+    int8_t b;
+    int32_t c;
+    uint64_t d;
+    int64_t e;
+    uint8_t f;
+} Sample;
+
+#define FIELD(KIND, BITS, MEMBER) { KIND, BITS, offsetof(Sample, MEMBER), sizeof(((Sample*) 0)->MEMBER) }
+#define PAD(BITS) { BS_FIELD_PAD, BITS, 0, 0 }
+
+/* 247 bits, padding merged into a group and padding of groups of its own. */
+static BSField const packed[] = {
+    FIELD(BS_FIELD_UINT, 11, a),
+    PAD(3),
+    FIELD(BS_FIELD_INT, 7, b),
+    FIELD(BS_FIELD_SINT, 20, c),
+    FIELD(BS_FIELD_UINT, 61, d),
+    PAD(80),
+    FIELD(BS_FIELD_INT, 64, e),
+    FIELD(BS_FIELD_UINT, 1, f),
+};
+
+/* 128 bits, byte aligned records. */
+static BSField const aligned[] = {
+    FIELD(BS_FIELD_UINT, 12, a),
+    PAD(4),
+    FIELD(BS_FIELD_INT, 8, b),
+    FIELD(BS_FIELD_SINT, 24, c),
+    FIELD(BS_FIELD_UINT, 8, f),
+    FIELD(BS_FIELD_UINT, 64, d),
+    PAD(8),
+};
+
+typedef struct tagReader {
+    unsigned char const *data;
+    size_t size;
+    size_t position;
+} Reader;
+
+static size_t produce(void *context, void *buffer, size_t n) {
+    Reader *reader = (Reader*) context;
+    if (n > 301)
+        n = 301;
+    if (n > reader->size - reader->position)
+        n = reader->size - reader->position;
+    memcpy(buffer, reader->data + reader->position, n);
+    reader->position += n;
+    return n;
+}
+
+static uint64_t next(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static uint64_t getMember(Sample const *sample, size_t offset) {
+    switch (offset) {
+    case offsetof(Sample, a): return sample->a;
+    case offsetof(Sample, b): return (uint64_t) (int64_t) sample->b;
+    case offsetof(Sample, c): return (uint64_t) (int64_t) sample->c;
+    case offsetof(Sample, d): return sample->d;
+    case offsetof(Sample, e): return (uint64_t) sample->e;
+    default: return sample->f;
+    }
+}
+
+static void setMember(Sample *sample, size_t offset, uint64_t value) {
+    switch (offset) {
+    case offsetof(Sample, a): sample->a = (uint16_t) value; break;
+    case offsetof(Sample, b): sample->b = (int8_t) value; break;
+    case offsetof(Sample, c): sample->c = (int32_t) value; break;
+    case offsetof(Sample, d): sample->d = value; break;
+    case offsetof(Sample, e): sample->e = (int64_t) value; break;
+    default: sample->f = (uint8_t) value; break;
+    }
+}
+
+/* values which fit their fields. */
+static void fill(Sample *samples, size_t n, BSField const *fields, size_t count, uint64_t *state) {
+    size_t i;
+    size_t k;
+    uint64_t v;
+    int64_t limit;
+
+    memset(samples, 0, n * sizeof(Sample));
+    for (i = 0; i < n; ++i) {
+        for (k = 0; k < count; ++k) {
+            if (fields[k]._M_kind == BS_FIELD_PAD)
+                continue;
+            v = next(state);
+            if (fields[k]._M_kind == BS_FIELD_UINT) {
+                if (fields[k]._M_bits < 64)
+                    v &= ((uint64_t) 1 << fields[k]._M_bits) - 1;
+            } else if (fields[k]._M_bits < 64) {
+                limit = (int64_t) 1 << (fields[k]._M_bits - 1);
+                v = (uint64_t) ((int64_t) (v % (uint64_t) (2 * limit - 1)) - (limit - 1));
+            }
+            setMember(samples + i, fields[k]._M_offset, v);
+        }
+    }
+}
+
+static int writeByFields(BitOutputStream *bos, Sample const *samples, size_t n, BSField const *fields, size_t count) {
+    size_t i;
+    size_t k;
+    size_t bits;
+    uint64_t v;
+    WriteResult r;
+
+    for (i = 0; i < n; ++i) {
+        for (k = 0; k < count; ++k) {
+            v = getMember(samples + i, fields[k]._M_offset);
+            switch (fields[k]._M_kind) {
+            case BS_FIELD_UINT:
+                r = BitOutputStreamWriteUInt(bos, fields[k]._M_bits, v);
+                break;
+            case BS_FIELD_INT:
+                r = BitOutputStreamWriteInt(bos, fields[k]._M_bits, (int64_t) v);
+                break;
+            case BS_FIELD_SINT:
+                r = BitOutputStreamWriteSInt(bos, fields[k]._M_bits, (int64_t) v);
+                break;
+            default:
+                for (bits = fields[k]._M_bits; bits > 0; bits -= bits < 32 ? bits : 32)
+                    r = BitOutputStreamWriteUInt(bos, bits < 32 ? bits : 32, 0);
+                break;
+            }
+            if (!BS_SUCCEEDED(r))
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/* the bits after the end of the last byte are whatever memory held. */
+static int sameBits(void const *a, void const *b, size_t bits, BSBitOrder order) {
+    unsigned char const *x = (unsigned char const*) a;
+    unsigned char const *y = (unsigned char const*) b;
+    unsigned mask = order == BS_LSB_FIRST ? (1u << (bits & 0x7)) - 1 : (0xff00u >> (bits & 0x7)) & 0xff;
+
+    if (memcmp(x, y, bits >> 3) != 0)
+        return 0;
+    return !(bits & 0x7) || ((x[bits >> 3] ^ y[bits >> 3]) & mask) == 0;
+}
+
+static int sameSamples(Sample const *x, Sample const *y, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        if (x[i].a != y[i].a || x[i].b != y[i].b || x[i].c != y[i].c
+                || x[i].d != y[i].d || x[i].e != y[i].e || x[i].f != y[i].f)
+            return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    int order = 0;
+    int layout = 0;
+    size_t start = 0;
+    size_t i = 0;
+    size_t k = 0;
+    size_t count = 0;
+    size_t bits = 0;
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    BSField const *fields = NULL;
+    BSField invalid;
+    BSSchema *schema = NULL;
+    static Sample samples[RECORDS];
+    static Sample decoded[RECORDS];
+    static Sample columns[RECORDS];
+    uint16_t a[RECORDS];
+    int8_t b[RECORDS];
+    int32_t c[RECORDS];
+    uint64_t d[RECORDS];
+    int64_t e[RECORDS];
+    uint8_t f[RECORDS];
+    void *targets[6];
+    void *tails[6];
+    ReadResult r;
+    Reader reader;
+
+    BitInputStream bis = {0};
+    BitOutputStream bos = {0};
+    BitOutputStream expected = {0};
+
+    for (layout = 0; layout < 2; ++layout) {
+        fields = layout ? aligned : packed;
+        count = layout ? sizeof(aligned) / sizeof(aligned[0]) : sizeof(packed) / sizeof(packed[0]);
+        TEST_ASSERT((schema = BitStreamSchemaCreate(fields, count)) != NULL);
+        TEST_ASSERT(BitStreamSchemaGetBits(schema) == (layout ? 128 : 247));
+        TEST_ASSERT(BitStreamSchemaGetFieldCount(schema) == (layout ? 5 : 6));
+        /* columns in schema order. */
+        for (i = 0, k = 0; i < count; ++i) {
+            switch (fields[i]._M_kind == BS_FIELD_PAD ? (size_t) -1 : fields[i]._M_offset) {
+            case offsetof(Sample, a): targets[k] = a; tails[k++] = a + RECORDS - 1; break;
+            case offsetof(Sample, b): targets[k] = b; tails[k++] = b + RECORDS - 1; break;
+            case offsetof(Sample, c): targets[k] = c; tails[k++] = c + RECORDS - 1; break;
+            case offsetof(Sample, d): targets[k] = d; tails[k++] = d + RECORDS - 1; break;
+            case offsetof(Sample, e): targets[k] = e; tails[k++] = e + RECORDS - 1; break;
+            case offsetof(Sample, f): targets[k] = f; tails[k++] = f + RECORDS - 1; break;
+            default: break;
+            }
+        }
+
+        for (order = BS_MSB_FIRST; order <= BS_LSB_FIRST; ++order) {
+            for (start = 0; start < 8; ++start) {
+                fill(samples, RECORDS, fields, count, &state);
+                TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+                TEST_ASSERT(BitOutputStreamInitialize(&expected, NULL, 0));
+                BitOutputStreamSetBitOrder(&bos, (BSBitOrder) order);
+                BitOutputStreamSetBitOrder(&expected, (BSBitOrder) order);
+
+                /* records after a field which leaves the cursor at every alignment. */
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, start + 8, 0xa5)));
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&expected, start + 8, 0xa5)));
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteRecords(&bos, schema, RECORDS, samples, sizeof(Sample))));
+                TEST_ASSERT(writeByFields(&expected, samples, RECORDS, fields, count) == 0);
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 5, 0x11)));
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&expected, 5, 0x11)));
+                TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == BitOutputStreamGetBitSize(&expected));
+                BitOutputStreamFlush(&bos);
+                BitOutputStreamFlush(&expected);
+                bits = BitOutputStreamGetBitSize(&bos);
+                TEST_ASSERT(sameBits(BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBuffer(&expected), bits,
+                            (BSBitOrder) order));
+
+                /* rows. */
+                TEST_ASSERT(BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos)));
+                BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+                TEST_ASSERT(BitInputStreamReadUInt(&bis, start + 8)._M_value.uint == 0xa5);
+                memset(decoded, 0, sizeof(decoded));
+                TEST_ASSERT(BitInputStreamReadRecords(&bis, schema, RECORDS, decoded, sizeof(Sample))._M_value.uint
+                        == RECORDS);
+                TEST_ASSERT(sameSamples(samples, decoded, RECORDS));
+                TEST_ASSERT(BitInputStreamReadUInt(&bis, 5)._M_value.uint == 0x11);
+                BitInputStreamRelease(&bis);
+
+                /* columns, and a short read which reads nothing. */
+                TEST_ASSERT(BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos)));
+                BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+                BitInputStreamSkipBits(&bis, start + 8);
+                TEST_ASSERT(BS_SUCCEEDED(BitInputStreamReadColumns(&bis, schema, RECORDS - 1, targets)));
+                r = BitInputStreamReadColumns(&bis, schema, 2, targets);
+                TEST_ASSERT(r._M_status == BS_EOS && r._M_value.uint == 0);
+                TEST_ASSERT(BitInputStreamGetBitPosition(&bis)
+                        == start + 8 + (RECORDS - 1) * BitStreamSchemaGetBits(schema));
+                TEST_ASSERT(BS_SUCCEEDED(BitInputStreamReadColumns(&bis, schema, 1, tails)));
+                memset(columns, 0, sizeof(columns));
+                for (i = 0; i < RECORDS; ++i) {
+                    columns[i].a = a[i];
+                    columns[i].b = b[i];
+                    columns[i].c = c[i];
+                    columns[i].d = d[i];
+                    columns[i].e = layout ? 0 : e[i];
+                    columns[i].f = f[i];
+                }
+                TEST_ASSERT(sameSamples(samples, columns, RECORDS));
+                TEST_ASSERT(BitInputStreamReadUInt(&bis, 5)._M_value.uint == 0x11);
+                BitInputStreamRelease(&bis);
+
+                /* columns back out. */
+                BitOutputStreamRelease(&expected);
+                TEST_ASSERT(BitOutputStreamInitialize(&expected, NULL, 0));
+                BitOutputStreamSetBitOrder(&expected, (BSBitOrder) order);
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&expected, start + 8, 0xa5)));
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteColumns(&expected, schema, RECORDS,
+                                (void const *const*) targets)));
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&expected, 5, 0x11)));
+                BitOutputStreamFlush(&expected);
+                TEST_ASSERT(sameBits(BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBuffer(&expected), bits,
+                            (BSBitOrder) order));
+
+                BitOutputStreamRelease(&bos);
+                BitOutputStreamRelease(&expected);
+            }
+        }
+
+        /* a source backed input, records straddle the refills. */
+        fill(samples, RECORDS, fields, count, &state);
+        TEST_ASSERT(BitOutputStreamInitialize(&expected, NULL, 0));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&expected, 3, 0x5)));
+        TEST_ASSERT(writeByFields(&expected, samples, RECORDS, fields, count) == 0);
+        BitOutputStreamFlush(&expected);
+        reader.data = (unsigned char const*) BitOutputStreamGetBuffer(&expected);
+        reader.size = (BitOutputStreamGetBitSize(&expected) + 7) >> 3;
+        reader.position = 0;
+        TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &produce, &reader, 100));
+        TEST_ASSERT(BitInputStreamReadUInt(&bis, 3)._M_value.uint == 0x5);
+        memset(decoded, 0, sizeof(decoded));
+        TEST_ASSERT(BitInputStreamReadRecords(&bis, schema, RECORDS, decoded, sizeof(Sample))._M_value.uint == RECORDS);
+        TEST_ASSERT(sameSamples(samples, decoded, RECORDS));
+        /* what is left is less than a record. */
+        r = BitInputStreamReadRecords(&bis, schema, 1, decoded, sizeof(Sample));
+        TEST_ASSERT(r._M_status == BS_EOS && r._M_value.uint == 0);
+        BitInputStreamRelease(&bis);
+        BitOutputStreamRelease(&expected);
+
+        BitStreamSchemaDestroy(schema);
+        schema = NULL;
+    }
+
+    /* fields the schema cannot hold. */
+    invalid._M_offset = 0;
+    invalid._M_kind = BS_FIELD_UINT;
+    invalid._M_bits = 0;
+    invalid._M_size = 8;
+    TEST_ASSERT(BitStreamSchemaCreate(&invalid, 1) == NULL);
+    invalid._M_bits = 65;
+    TEST_ASSERT(BitStreamSchemaCreate(&invalid, 1) == NULL);
+    invalid._M_bits = 9;
+    invalid._M_size = 1;
+    TEST_ASSERT(BitStreamSchemaCreate(&invalid, 1) == NULL);
+    invalid._M_size = 3;
+    TEST_ASSERT(BitStreamSchemaCreate(&invalid, 1) == NULL);
+    invalid._M_kind = BS_FIELD_SINT;
+    invalid._M_bits = 1;
+    invalid._M_size = 1;
+    TEST_ASSERT(BitStreamSchemaCreate(&invalid, 1) == NULL);
+
+    goto success;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitStreamSchemaDestroy(schema);
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+    BitOutputStreamRelease(&expected);
+    return rc;
+}
@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define MESSAGES 200
+#define FIELDS 1000
+
+/* a message of FIELDS 24 bits fields, 3000 bytes. */
+static int encode(BitOutputStream *bos, size_t seed) {
+    size_t i;
+
+    for (i = 0; i < FIELDS; ++i) {
+        if (!BS_SUCCEEDED(BitOutputStreamWriteUInt(bos, 24, (seed * 7919 + i * 31) & 0xffffff)))
+            return -1;
+    }
+    return 0;
+}
+
+static int check(BitOutputStream *bos, size_t seed) {
+    BitInputStream bis;
+    size_t i;
+    int rc = 0;
+
+    BitOutputStreamFlush(bos);
+    if (!BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(bos), BitOutputStreamGetBitSize(bos)))
+        return -1;
+    for (i = 0; i < FIELDS && rc == 0; ++i) {
+        if (BitInputStreamReadUInt(&bis, 24)._M_value.uint != ((seed * 7919 + i * 31) & 0xffffff))
+            rc = -1;
+    }
+    BitInputStreamRelease(&bis);
+    return rc;
+}
+
+static int partition(void *context, size_t i, BitOutputStream *bos) {
+    return encode(bos, i);
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    size_t cached = 0;
+    BSPool *pool = NULL;
+    BSAllocator allocator;
+
+    BitOutputStream bos = {0};
+
+    TEST_ASSERT((pool = BitStreamPoolCreate()) != NULL);
+    TEST_ASSERT(BitStreamPoolGetCachedBytes(pool) == 0);
+
+    /* the first message grows its buffer, the next ones start at its size. */
+    for (i = 0; i < MESSAGES; ++i) {
+        TEST_ASSERT(BitOutputStreamInitializeWithPool(&bos, pool));
+        if (i > 0)
+            TEST_ASSERT(BitOutputStreamGetCapacity(&bos) >= FIELDS * 3);
+        TEST_ASSERT(encode(&bos, i) == 0);
+        TEST_ASSERT(check(&bos, i) == 0);
+        BitOutputStreamRelease(&bos);
+    }
+    TEST_ASSERT((cached = BitStreamPoolGetCachedBytes(pool)) > 0);
+
+    /* a smaller message reuses the same buffer. */
+    TEST_ASSERT(BitOutputStreamInitializeWithPool(&bos, pool));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 8, 0x5a)));
+    TEST_ASSERT(BitStreamPoolGetCachedBytes(pool) < cached);
+    BitOutputStreamRelease(&bos);
+    TEST_ASSERT(BitStreamPoolGetCachedBytes(pool) == cached);
+
+    /* trim keeps at most the given number of bytes. */
+    TEST_ASSERT(BitStreamPoolTrim(pool, 0) == cached);
+    TEST_ASSERT(BitStreamPoolGetCachedBytes(pool) == 0);
+
+    /* buffers beyond the largest class bypass the pool. */
+    TEST_ASSERT(BitOutputStreamInitializeWithPool(&bos, pool));
+    TEST_ASSERT(BitOutputStreamReserve(&bos, (size_t) 20 << 23) == 0);
+    TEST_ASSERT(encode(&bos, 1) == 0);
+    TEST_ASSERT(check(&bos, 1) == 0);
+    BitOutputStreamRelease(&bos);
+    TEST_ASSERT(BitStreamPoolGetCachedBytes(pool) < (size_t) 1 << 24);
+    BitStreamPoolTrim(pool, 0);
+    TEST_ASSERT(BitStreamPoolGetCachedBytes(pool) == 0);
+
+    /* the stream grows on whichever worker encodes the first partition, caches of exiting threads go to the depot. */
+    BitStreamPoolGetAllocator(pool, &allocator);
+    for (i = 0; i < 4; ++i) {
+        TEST_ASSERT(BitOutputStreamInitializeWithAllocator(&bos, NULL, 0, &allocator));
+        TEST_ASSERT(BS_SUCCEEDED(BitStreamEncodeParallel(&bos, 8, &partition, NULL, 4)));
+        TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == (size_t) 8 * FIELDS * 24);
+        BitOutputStreamRelease(&bos);
+    }
+    TEST_ASSERT(BitStreamPoolGetCachedBytes(pool) > 0);
+
+    BitStreamPoolDestroy(pool);
+    pool = NULL;
+
+    goto success;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitOutputStreamRelease(&bos);
+    BitStreamPoolDestroy(pool);
+    return rc;
+}
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#if defined(BS_HAVE_IOVEC)
+#include <unistd.h>
+#endif
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define FIELDS 20000
+#define VALUES 3000
+#define OUTPUT_BYTES 400000
+
+/* fields of every width, then an array and a byte string which go through by room. */
+static int encode(BitOutputStream *bos, unsigned char const *bytes) {
+    uint32_t values[VALUES];
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    size_t i;
+
+    for (i = 0; i < FIELDS; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        if (!BS_SUCCEEDED(BitOutputStreamWriteUInt(bos, i % 64 + 1, state)))
+            return -1;
+    }
+    for (i = 0; i < VALUES; ++i)
+        values[i] = (uint32_t) (i * 2654435761u);
+    if (!BS_SUCCEEDED(BitOutputStreamWriteUIntArray32(bos, 27, VALUES, values, BS_PACK_MASK)))
+        return -1;
+    if (!BS_SUCCEEDED(BitOutputStreamWriteBits(bos, bytes, 3, 5000 * 8 + 5)))
+        return -1;
+    return 0;
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    int order = 0;
+    size_t i = 0;
+    size_t size = 0;
+    size_t total = 0;
+    size_t bytes = 0;
+    size_t chunk = 0;
+    static unsigned char source[5008];
+    static unsigned char flat[OUTPUT_BYTES];
+    static unsigned char joined[OUTPUT_BYTES];
+    unsigned char const *p = NULL;
+    BSPool *pool = NULL;
+    BSAllocator allocator;
+#if defined(BS_HAVE_IOVEC)
+    struct iovec iov[64];
+    FILE *file = NULL;
+#endif
+
+    BitOutputStream bos = {0};
+    BitOutputStream expected = {0};
+
+    for (i = 0; i < sizeof(source); ++i)
+        source[i] = (unsigned char) (i * 37 + 11);
+
+    for (order = BS_MSB_FIRST; order <= BS_LSB_FIRST; ++order) {
+        for (chunk = 64; chunk <= 64 << 10; chunk <<= 5) {
+            TEST_ASSERT(BitOutputStreamInitializeChunked(&bos, chunk, NULL));
+            TEST_ASSERT(BitOutputStreamInitialize(&expected, NULL, 0));
+            BitOutputStreamSetBitOrder(&bos, (BSBitOrder) order);
+            BitOutputStreamSetBitOrder(&expected, (BSBitOrder) order);
+            TEST_ASSERT(encode(&bos, source) == 0);
+            TEST_ASSERT(encode(&expected, source) == 0);
+            TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == BitOutputStreamGetBitSize(&expected));
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamFinish(&bos, 0)));
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamFinish(&expected, 0)));
+            bytes = BitOutputStreamGetSize(&expected);
+            TEST_ASSERT(bytes <= OUTPUT_BYTES);
+
+            /* the chunks, one by one and flattened, are the contiguous output. */
+            TEST_ASSERT(BitOutputStreamGetChunkCount(&bos) >= bytes / chunk);
+            for (i = 0, total = 0; (p = (unsigned char const*) BitOutputStreamGetChunk(&bos, i, &size)); ++i) {
+                TEST_ASSERT(size > 0 && size <= chunk);
+                TEST_ASSERT(total + size <= bytes);
+                memcpy(joined + total, p, size);
+                total += size;
+            }
+            TEST_ASSERT(i == BitOutputStreamGetChunkCount(&bos));
+            TEST_ASSERT(total == bytes);
+            TEST_ASSERT(memcmp(joined, BitOutputStreamGetBuffer(&expected), bytes) == 0);
+            TEST_ASSERT(BitOutputStreamFlatten(&bos, NULL, 0) == bytes);
+            TEST_ASSERT(BitOutputStreamFlatten(&bos, flat, 1000) == bytes);
+            TEST_ASSERT(memcmp(flat, joined, 1000) == 0);
+            TEST_ASSERT(BitOutputStreamFlatten(&bos, flat, sizeof(flat)) == bytes);
+            TEST_ASSERT(memcmp(flat, joined, bytes) == 0);
+
+            /* writing goes on after a finish. */
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 12, 0xabc)));
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&expected, 12, 0xabc)));
+            TEST_ASSERT(BitOutputStreamFlatten(&bos, flat, sizeof(flat)) == bytes + 2);
+            BitOutputStreamFlush(&expected);
+            TEST_ASSERT(memcmp(flat, BitOutputStreamGetBuffer(&expected), bytes + 1) == 0);
+
+            BitOutputStreamRelease(&bos);
+            BitOutputStreamRelease(&expected);
+        }
+    }
+
+    /* a reservation wider than a chunk, then unchecked writes into it. */
+    for (order = BS_MSB_FIRST; order <= BS_LSB_FIRST; ++order) {
+        TEST_ASSERT(BitOutputStreamInitializeChunked(&bos, 64, NULL));
+        TEST_ASSERT(BitOutputStreamInitialize(&expected, NULL, 0));
+        BitOutputStreamSetBitOrder(&bos, (BSBitOrder) order);
+        BitOutputStreamSetBitOrder(&expected, (BSBitOrder) order);
+        TEST_ASSERT(BitOutputStreamReserve(&bos, 600) == 0);
+        TEST_ASSERT(BitOutputStreamReserve(&expected, 600) == 0);
+        for (i = 0; i < 600 / 12; ++i) {
+            BitOutputStreamWriteUIntUnchecked(&bos, 12, i * 97);
+            BitOutputStreamWriteUIntUnchecked(&expected, 12, i * 97);
+        }
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 3, 5)));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&expected, 3, 5)));
+        TEST_ASSERT(BitOutputStreamReserve(&bos, 5000) == 0);
+        TEST_ASSERT(BitOutputStreamReserve(&expected, 5000) == 0);
+        for (i = 0; i < 5000 / 50; ++i) {
+            BitOutputStreamWriteUIntUnchecked(&bos, 50, i * 2654435761u);
+            BitOutputStreamWriteUIntUnchecked(&expected, 50, i * 2654435761u);
+        }
+        TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == 603 + 5000);
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamFinish(&bos, 0)));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamFinish(&expected, 0)));
+        bytes = BitOutputStreamGetSize(&expected);
+        TEST_ASSERT(BitOutputStreamFlatten(&bos, flat, sizeof(flat)) == bytes);
+        TEST_ASSERT(memcmp(flat, BitOutputStreamGetBuffer(&expected), bytes) == 0);
+        BitOutputStreamRelease(&bos);
+        BitOutputStreamRelease(&expected);
+    }
+
+    /* a contiguous stream is a single chunk. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0));
+    TEST_ASSERT(BitOutputStreamGetChunkCount(&bos) == 0);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 20, 0x12345)));
+    TEST_ASSERT(BitOutputStreamGetChunkCount(&bos) == 1);
+    TEST_ASSERT((p = (unsigned char const*) BitOutputStreamGetChunk(&bos, 0, &size)) != NULL && size == 3);
+    TEST_ASSERT(p[0] == 0x12 && p[1] == 0x34);
+    TEST_ASSERT(BitOutputStreamGetChunk(&bos, 1, &size) == NULL && size == 0);
+    BitOutputStreamRelease(&bos);
+
+#if defined(BS_HAVE_IOVEC)
+    /* handed to writev as they are. */
+    TEST_ASSERT(BitOutputStreamInitializeChunked(&bos, 4096, NULL));
+    TEST_ASSERT(BitOutputStreamInitialize(&expected, NULL, 0));
+    TEST_ASSERT(encode(&bos, source) == 0);
+    TEST_ASSERT(encode(&expected, source) == 0);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamFinish(&bos, 1)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamFinish(&expected, 1)));
+    bytes = BitOutputStreamGetSize(&expected);
+    TEST_ASSERT((size = BitOutputStreamGetIovec(&bos, iov, 64)) > 1 && size <= 64);
+    TEST_ASSERT((file = tmpfile()) != NULL);
+    TEST_ASSERT(writev(fileno(file), iov, (int) size) == (ssize_t) bytes);
+    rewind(file);
+    TEST_ASSERT(fread(flat, 1, sizeof(flat), file) == bytes);
+    TEST_ASSERT(memcmp(flat, BitOutputStreamGetBuffer(&expected), bytes) == 0);
+    TEST_ASSERT(BitOutputStreamGetIovec(&bos, iov, 1) == size);
+    BitOutputStreamRelease(&bos);
+    BitOutputStreamRelease(&expected);
+#endif
+
+    /* chunks from a pool go back to it. */
+    TEST_ASSERT((pool = BitStreamPoolCreate()) != NULL);
+    BitStreamPoolGetAllocator(pool, &allocator);
+    TEST_ASSERT(BitOutputStreamInitializeChunked(&bos, 1000, &allocator));
+    TEST_ASSERT(encode(&bos, source) == 0);
+    TEST_ASSERT(BitOutputStreamGetChunkCount(&bos) > 1);
+    BitOutputStreamRelease(&bos);
+    TEST_ASSERT(BitStreamPoolGetCachedBytes(pool) > 0);
+
+    /* default chunks fill their pool class. */
+    BitStreamPoolTrim(pool, 0);
+    TEST_ASSERT(BitOutputStreamInitializeChunked(&bos, 0, &allocator));
+    for (i = 0; i < 4; ++i)
+        TEST_ASSERT(encode(&bos, source) == 0);
+    TEST_ASSERT(BitOutputStreamGetChunk(&bos, 0, &size) != NULL && size == (64 << 10) - 16);
+    total = BitOutputStreamGetChunkCount(&bos);
+    BitOutputStreamRelease(&bos);
+    TEST_ASSERT(BitStreamPoolGetCachedBytes(pool) == total * ((64 << 10) - 16));
+
+    goto success;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+#if defined(BS_HAVE_IOVEC)
+    if (file)
+        fclose(file);
+#endif
+    BitOutputStreamRelease(&bos);
+    BitOutputStreamRelease(&expected);
+    BitStreamPoolDestroy(pool);
+    return rc;
+}
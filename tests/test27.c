@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+/* not a whole number of bytes, several superblocks. */
+#define BITS 300003
+#define BYTES ((BITS + 7) / 8)
+
+typedef struct tagReader {
+    unsigned char const *data;
+    size_t size;
+    size_t position;
+} Reader;
+
+static size_t produce(void *context, void *buffer, size_t n) {
+    Reader *reader = (Reader*) context;
+    if (n > 301)
+        n = 301;
+    if (n > reader->size - reader->position)
+        n = reader->size - reader->position;
+    memcpy(buffer, reader->data + reader->position, n);
+    reader->position += n;
+    return n;
+}
+
+/* dense, sparse, all ones and all zeros stretches. */
+static void fill(unsigned char *bytes) {
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    size_t i;
+
+    for (i = 0; i < BYTES; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        switch ((i / 4096) % 4) {
+        case 0: bytes[i] = (unsigned char) state; break;
+        case 1: bytes[i] = (state & 0xf0) ? 0 : (unsigned char) (1u << (state & 0x7)); break;
+        case 2: bytes[i] = (i % 1000 == 7) ? 0xef : 0xff; break;
+        default: bytes[i] = (i % 3000 == 11) ? 0x10 : 0; break;
+        }
+    }
+    /* the bits of a source backed stream past BITS count as clear. */
+    bytes[BYTES - 1] = 0;
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    int order = 0;
+    size_t i = 0;
+    size_t k = 0;
+    size_t pos = 0;
+    size_t len = 0;
+    size_t ones = 0;
+    static unsigned char bytes[BYTES];
+    static unsigned char bits[BITS];
+    static size_t prefix[BITS + 1];
+    BSRankIndex *index = NULL;
+    ReadResult r;
+    Reader reader;
+
+    BitInputStream bis = {0};
+
+    fill(bytes);
+    for (order = BS_MSB_FIRST; order <= BS_LSB_FIRST; ++order) {
+        /* the reference, bit by bit. */
+        TEST_ASSERT(BitInputStreamInitialize(&bis, bytes, BITS));
+        BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+        for (i = 0, prefix[0] = 0; i < BITS; ++i) {
+            bits[i] = (unsigned char) BitInputStreamReadBit(&bis)._M_value.uint;
+            prefix[i + 1] = prefix[i] + bits[i];
+        }
+        BitInputStreamRelease(&bis);
+
+        /* counts over ranges of every alignment, the cursor moves past them. */
+        for (pos = 0; pos < BITS; pos += 7919) {
+            for (len = 0; len < 5000 && pos + len <= BITS; len = len * 3 + 1 + pos % 13) {
+                TEST_ASSERT(BitInputStreamInitialize(&bis, bytes, BITS));
+                BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+                BitInputStreamSkipBits(&bis, pos);
+                r = BitInputStreamCountOnes(&bis, len);
+                TEST_ASSERT(BS_SUCCEEDED(r) && r._M_value.uint == prefix[pos + len] - prefix[pos]);
+                TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == pos + len);
+                if (pos + len < BITS)
+                    TEST_ASSERT(BitInputStreamReadBit(&bis)._M_value.uint == bits[pos + len]);
+                BitInputStreamRelease(&bis);
+            }
+        }
+        TEST_ASSERT(BitInputStreamInitialize(&bis, bytes, BITS));
+        BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+        TEST_ASSERT(BitInputStreamCountOnes(&bis, BITS)._M_value.uint == prefix[BITS]);
+        TEST_ASSERT(BitInputStreamCountOnes(&bis, 1)._M_status == BS_EOS);
+        BitInputStreamRelease(&bis);
+
+        /* every set bit, and every clear bit, one search at a time from a few starts. */
+        TEST_ASSERT(BitInputStreamInitialize(&bis, bytes, BITS));
+        BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+        for (i = 0, pos = 0; ; ++i) {
+            r = BitInputStreamFindNextSet(&bis);
+            if (!BS_SUCCEEDED(r))
+                break;
+            TEST_ASSERT(bits[pos + r._M_value.uint] == 1);
+            TEST_ASSERT(prefix[pos + r._M_value.uint] - prefix[pos] == 0);
+            pos += r._M_value.uint;
+            TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == pos);
+            TEST_ASSERT(BitInputStreamReadBit(&bis)._M_value.uint == 1);
+            ++pos;
+        }
+        TEST_ASSERT(r._M_status == BS_EOS && i == prefix[BITS]);
+        TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == BITS);
+        BitInputStreamRelease(&bis);
+        for (pos = 3; pos < BITS; pos += 4999) {
+            TEST_ASSERT(BitInputStreamInitialize(&bis, bytes, BITS));
+            BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+            BitInputStreamSkipBits(&bis, pos);
+            r = BitInputStreamFindNextClear(&bis);
+            for (k = pos; k < BITS && bits[k]; ++k)
+                ;
+            TEST_ASSERT(k == BITS ? r._M_status == BS_EOS : BS_SUCCEEDED(r));
+            TEST_ASSERT(r._M_value.uint == k - pos);
+            TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == k);
+            BitInputStreamRelease(&bis);
+        }
+
+        /* rank everywhere, select of every rank. */
+        TEST_ASSERT(BitInputStreamInitialize(&bis, bytes, BITS));
+        BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+        TEST_ASSERT((index = BitStreamRankIndexCreate(&bis)) != NULL);
+        TEST_ASSERT(BitStreamRankIndexGetOnes(index) == prefix[BITS]);
+        for (pos = 0; pos <= BITS; ++pos) {
+            TEST_ASSERT(BitStreamRankIndexRank1(index, pos) == prefix[pos]);
+            TEST_ASSERT(BitStreamRankIndexRank0(index, pos) == pos - prefix[pos]);
+        }
+        TEST_ASSERT(BitStreamRankIndexRank1(index, BITS + 100) == prefix[BITS]);
+        for (pos = 0, ones = 0; pos < BITS; ++pos) {
+            if (bits[pos])
+                TEST_ASSERT(BitStreamRankIndexSelect1(index, ones++) == pos);
+            else
+                TEST_ASSERT(BitStreamRankIndexSelect0(index, pos - ones) == pos);
+        }
+        TEST_ASSERT(BitStreamRankIndexSelect1(index, prefix[BITS]) == (size_t) -1);
+        TEST_ASSERT(BitStreamRankIndexSelect0(index, BITS - prefix[BITS]) == (size_t) -1);
+        BitStreamRankIndexDestroy(index);
+        index = NULL;
+        BitInputStreamRelease(&bis);
+
+        /* a source backed stream goes window by window. */
+        reader.data = bytes;
+        reader.size = BYTES;
+        reader.position = 0;
+        TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &produce, &reader, 1000));
+        BitInputStreamSetBitOrder(&bis, (BSBitOrder) order);
+        TEST_ASSERT(BitStreamRankIndexCreate(&bis) == NULL);
+        BitInputStreamSkipBits(&bis, 5);
+        r = BitInputStreamCountOnes(&bis, 100000);
+        TEST_ASSERT(BS_SUCCEEDED(r) && r._M_value.uint == prefix[100005] - prefix[5]);
+        /* the second all ones stretch starts at byte 24576. */
+        BitInputStreamSkipBits(&bis, 24576 * 8 - 100005);
+        r = BitInputStreamFindNextClear(&bis);
+        for (k = 24576 * 8; bits[k]; ++k)
+            ;
+        TEST_ASSERT(BS_SUCCEEDED(r) && BitInputStreamGetBitPosition(&bis) == k);
+        r = BitInputStreamCountOnes(&bis, BITS);
+        TEST_ASSERT(r._M_status == BS_EOS && r._M_value.uint == prefix[BITS] - prefix[k]);
+        BitInputStreamRelease(&bis);
+    }
+
+    goto success;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitStreamRankIndexDestroy(index);
+    BitInputStreamRelease(&bis);
+    return rc;
+}
@@ -1,6 +1,5 @@
 #include <stdlib.h>
 #include <stdio.h>
-#include <time.h>
 
 #include "../src/bitstream.h"
 
@@ -34,23 +33,19 @@ cleanup:
         } \
     } while (0)
 
-typedef int (*perf_runner)(void*);
+typedef int (*repeat_runner)(void*);
 
-int perf_test(char const* name, perf_runner runner, size_t n, void *arg) {
+/* timings live in the benchmarks, `make bench`. */
+int repeat_test(char const* name, repeat_runner runner, size_t n, void *arg) {
     int rc = 0;
     size_t i = 0;
-    time_t t1, t2;
-    time(&t1);
-    for (i = 0; i < n; ++i)
+    for (i = 0; i < n && rc != EXIT_FAILURE; ++i)
         rc = runner(arg);
-    time(&t2);
-    fprintf(stdout, "Name = %s, N = %lu, Total = %g s, Average = %g s, QPS = %g\n",
-            name, (unsigned long) n, difftime(t2, t1), difftime(t2, t1) / n,
-            n / difftime(t2, t1));
+    fprintf(stdout, "Name = %s, N = %lu\n", name, (unsigned long) i);
     return rc;
 }
 
-int test_output_perf(void *arg) {
+int test_output_repeated(void *arg) {
     int rc;
     BitOutputStream *const bos = (BitOutputStream*) arg;
     size_t bpos = BitOutputStreamGetBitSize(bos);
@@ -82,7 +77,7 @@ cleanup:
     goto exit;
 }
 
-int test_input_perf(void *arg) {
+int test_input_repeated(void *arg) {
     int rc;
     ReadResult r;
     BitInputStream *const bis = (BitInputStream*) arg;
@@ -121,11 +116,11 @@ cleanup:
     goto exit;
 }
 
-#define PERF_TEST(RUNNER, N, PARAM) perf_test(#RUNNER, &RUNNER, N, PARAM)
+#define REPEAT_TEST(RUNNER, N, PARAM) repeat_test(#RUNNER, &RUNNER, N, PARAM)
 
 int main(int argc, char* *argv) {
     int rc = 0;
-    size_t const N = 0x1ffffff;
+    size_t const N = 0xffff;
 
     unsigned char buf[0xff];
     size_t const buflen = sizeof(buf);
@@ -135,13 +130,13 @@ int main(int argc, char* *argv) {
 
     BitOutputStreamInitialize(&bos, &buf[0], buflen * 8);
 
-    if ((rc = PERF_TEST(test_output_perf, N, &bos)) == EXIT_FAILURE)
+    if ((rc = REPEAT_TEST(test_output_repeated, N, &bos)) == EXIT_FAILURE)
         goto failure;
     BitInputStreamInitialize(&bis, &buf[0], (5 * 6 + 8 - 1) / 8 * 8);
     printf("binary: ");
     printBinary(&bis);
     printf("\n");
-    if ((rc = PERF_TEST(test_input_perf, N, &bis)) == EXIT_FAILURE)
+    if ((rc = REPEAT_TEST(test_input_repeated, N, &bis)) == EXIT_FAILURE)
         goto failure;
     goto success;
 exit:
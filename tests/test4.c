@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+/* reference reader, one bit a time. */
+static uint64_t referenceBits(unsigned char const *buf, size_t pos, size_t bits) {
+    uint64_t value = 0;
+    size_t i;
+    for (i = 0; i < bits; ++i, ++pos)
+        value = (value << 1) | ((buf[pos >> 3] >> (7 - (pos & 0x7))) & 0x1);
+    return value;
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    size_t bits = 0;
+    size_t offset = 0;
+    size_t pos = 0;
+    ReadResult r;
+
+    unsigned char buf[0x100];
+    size_t const buflen = sizeof(buf);
+
+    BitInputStream bis = {0};
+
+    srand(1);
+    for (i = 0; i < buflen; ++i)
+        buf[i] = (unsigned char) rand();
+
+    /* every width from every bit offset inside a byte. */
+    for (offset = 0; offset < 8; ++offset) {
+        for (bits = 1; bits <= 64; ++bits) {
+            TEST_ASSERT(BitInputStreamInitialize(&bis, &buf[0], buflen * 8));
+            TEST_ASSERT(BitInputStreamSeekBits(&bis, offset, SEEK_SET) == 0);
+            for (pos = offset; pos + bits <= buflen * 8; pos += bits) {
+                r = BitInputStreamReadUInt(&bis, bits);
+                TEST_ASSERT(BS_SUCCEEDED(r));
+                TEST_ASSERT(r._M_value.uint == referenceBits(buf, pos, bits));
+            }
+            TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == pos);
+            r = BitInputStreamReadUInt(&bis, bits);
+            TEST_ASSERT(r._M_status == BS_EOS);
+            TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == pos);
+        }
+    }
+
+    /* mixing with ReadBit, Mark/Reset and SeekBits keeps the window coherent. */
+    TEST_ASSERT(BitInputStreamInitialize(&bis, &buf[0], 100));
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUInt(&bis, 3)));
+    TEST_ASSERT(r._M_value.uint == referenceBits(buf, 0, 3));
+    BitInputStreamMark(&bis);
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadBit(&bis)));
+    TEST_ASSERT(r._M_value.uint == referenceBits(buf, 3, 1));
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUInt(&bis, 40)));
+    TEST_ASSERT(r._M_value.uint == referenceBits(buf, 4, 40));
+    BitInputStreamReset(&bis);
+    TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == 3);
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUInt(&bis, 41)));
+    TEST_ASSERT(r._M_value.uint == referenceBits(buf, 3, 41));
+    TEST_ASSERT(BitInputStreamSeekBits(&bis, -10, SEEK_END) == 0);
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUInt(&bis, 10)));
+    TEST_ASSERT(r._M_value.uint == referenceBits(buf, 90, 10));
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+    TEST_ASSERT(BitInputStreamReadBit(&bis)._M_status == BS_EOS);
+    TEST_ASSERT(BitInputStreamSeekBits(&bis, 7, SEEK_SET) == 0);
+    TEST_ASSERT(BitInputStreamSkipPaddingBits(&bis) == 1);
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUInt(&bis, 8)));
+    TEST_ASSERT(r._M_value.uint == buf[1]);
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUInt(&bis, 0)));
+    TEST_ASSERT(r._M_value.uint == 0);
+
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    goto exit;
+}
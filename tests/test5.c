@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+/* reference writer, one bit a time. */
+static void referencePut(unsigned char *buf, size_t pos, size_t bits, uint64_t value) {
+    size_t i;
+    for (i = 0; i < bits; ++i, ++pos) {
+        if ((value >> (bits - 1 - i)) & 0x1)
+            buf[pos >> 3] |= 0x80 >> (pos & 0x7);
+        else
+            buf[pos >> 3] &= ~(0x80 >> (pos & 0x7));
+    }
+}
+
+static uint64_t randomValue(void) {
+    return ((uint64_t) rand() << 42) ^ ((uint64_t) rand() << 21) ^ (uint64_t) rand();
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    size_t bits = 0;
+    size_t pos = 0;
+    uint64_t value = 0;
+
+    unsigned char buf[0x100];
+    unsigned char expected[0x100];
+    size_t const buflen = sizeof(buf);
+
+    BitOutputStream bos = {0};
+    BitOutputStream growable = {0};
+
+    srand(2);
+    memset(buf, 0xa5, buflen);
+    memset(expected, 0xa5, buflen);
+
+    /* random widths, trailing bits of the last byte are preserved. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, &buf[0], buflen * 8));
+    TEST_ASSERT(BitOutputStreamInitialize(&growable, NULL, 0));
+    for (pos = 0; ; pos += bits) {
+        bits = 1 + rand() % 64;
+        if (pos + bits > buflen * 8)
+            break;
+        value = randomValue();
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, bits, value)));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&growable, bits, value)));
+        referencePut(expected, pos, bits, value);
+    }
+    TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == pos);
+    TEST_ASSERT(BitOutputStreamGetBitSize(&growable) == pos);
+    TEST_ASSERT(BitOutputStreamGetBuffer(&bos) == buf);
+    TEST_ASSERT(memcmp(buf, expected, buflen) == 0);
+    TEST_ASSERT(memcmp(BitOutputStreamGetBuffer(&growable), expected, pos >> 3) == 0);
+
+    /* overwriting in the middle keeps the neighbour bits. */
+    TEST_ASSERT(BitOutputStreamSeekBits(&bos, 13, SEEK_SET) == 0);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteBit(&bos, 1)));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 70, 0x123456789abcdefULL)));
+    referencePut(expected, 13, 1, 1);
+    referencePut(expected, 14, 6, 0);
+    referencePut(expected, 20, 64, 0x123456789abcdefULL);
+    BitOutputStreamFlush(&bos);
+    TEST_ASSERT(memcmp(buf, expected, buflen) == 0);
+
+    /* padding flushes and ends at a byte boundary. */
+    TEST_ASSERT(BitOutputStreamSeekBits(&bos, 0, SEEK_SET) == 0);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 3, 0x5)));
+    TEST_ASSERT(BitOutputStreamPaddingBits(&bos, 1) == 5);
+    TEST_ASSERT(buf[0] == 0xbf);
+    TEST_ASSERT(BitOutputStreamPaddingBits(&bos, 1) == 0);
+    TEST_ASSERT(BitOutputStreamGetSize(&bos) == 1);
+
+    /* reset starts over, the pending bits reach memory on release. */
+    BitOutputStreamReset(&bos);
+    for (i = 0; i < 8; ++i)
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteBit(&bos, (int) (i & 0x1))));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 4, 0x3)));
+    BitOutputStreamRelease(&bos);
+    TEST_ASSERT(buf[0] == 0x55);
+    TEST_ASSERT((buf[1] & 0xf0) == 0x30);
+    TEST_ASSERT((buf[1] & 0x0f) == (expected[1] & 0x0f));
+
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitOutputStreamRelease(&bos);
+    BitOutputStreamRelease(&growable);
+    goto exit;
+}
@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+typedef struct tagCountingArena {
+    size_t mallocs;
+    size_t reallocs;
+    size_t frees;
+} CountingArena;
+
+static void* countingMalloc(void *context, size_t n) {
+    ++((CountingArena*) context)->mallocs;
+    return malloc(n);
+}
+
+static void* countingRealloc(void *context, void *p, size_t n) {
+    ++((CountingArena*) context)->reallocs;
+    return realloc(p, n);
+}
+
+static void countingFree(void *context, void *p) {
+    ++((CountingArena*) context)->frees;
+    free(p);
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    ReadResult r;
+
+    CountingArena arena = {0};
+    BSAllocator allocator = { &countingMalloc, &countingRealloc, &countingFree, NULL };
+
+    BitOutputStream bos = {0};
+    BitInputStream bis = {0};
+
+    allocator._M_context = &arena;
+
+    /* growth by realloc, doubling amortizes many small writes. */
+    TEST_ASSERT(BitOutputStreamInitializeWithAllocator(&bos, NULL, 0, &allocator));
+    TEST_ASSERT(arena.mallocs == 1);
+    for (i = 0; i < 100000; ++i)
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 13, i)));
+    TEST_ASSERT(arena.reallocs > 0 && arena.reallocs < 20);
+    TEST_ASSERT(BitOutputStreamGetCapacity(&bos) * 8 >= 13 * 100000);
+    TEST_ASSERT(BitInputStreamInitialize(&bis, BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBitSize(&bos)));
+    for (i = 0; i < 100000; ++i) {
+        TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUInt(&bis, 13)));
+        TEST_ASSERT(r._M_value.uint == (i & 0x1fff));
+    }
+    BitOutputStreamRelease(&bos);
+    TEST_ASSERT(arena.frees == 1);
+
+    /* presized stream and reserve avoid growth entirely. */
+    memset(&arena, 0, sizeof(arena));
+    TEST_ASSERT(BitOutputStreamInitializeWithAllocator(&bos, NULL, 1000, &allocator));
+    TEST_ASSERT(BitOutputStreamGetCapacity(&bos) == 125);
+    TEST_ASSERT(BitOutputStreamReserve(&bos, 1000) == 0);
+    TEST_ASSERT(arena.reallocs == 0);
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 3, 5)));
+    TEST_ASSERT(BitOutputStreamReserve(&bos, 100000) == 0);
+    TEST_ASSERT(arena.reallocs == 1);
+    TEST_ASSERT(BitOutputStreamGetCapacity(&bos) * 8 >= 100003);
+    BitOutputStreamRelease(&bos);
+
+    /* one write wider than twice the capacity still fits. */
+    TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 8));
+    TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 64, 0x0123456789abcdefULL)));
+    TEST_ASSERT(BitOutputStreamGetSize(&bos) == 8);
+    TEST_ASSERT(((unsigned char const*) BitOutputStreamGetBuffer(&bos))[7] == 0xef);
+
+    /* fixed memory cannot grow. */
+    {
+        unsigned char buf[2];
+        BitOutputStream fixed = {0};
+        TEST_ASSERT(BitOutputStreamInitialize(&fixed, &buf[0], 16));
+        TEST_ASSERT(BitOutputStreamReserve(&fixed, 17) != 0);
+        TEST_ASSERT(!BS_SUCCEEDED(BitOutputStreamWriteUInt(&fixed, 17, 0)));
+        BitOutputStreamRelease(&fixed);
+    }
+
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    BitOutputStreamRelease(&bos);
+    goto exit;
+}
@@ -0,0 +1,103 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define COUNT 150
+
+/* compares a bulk read of `count` fields against single ReadUInt calls. */
+#define CHECK_ARRAY(T, WIDTH) \
+    for (bits = 1; bits <= WIDTH; ++bits) { \
+        for (offset = 0; offset < 8; ++offset) { \
+            T values[COUNT + 1]; \
+            size_t count = COUNT - offset; \
+            values[count] = (T) 0x5a; \
+            TEST_ASSERT(BitInputStreamInitialize(&bis, &buf[0], buflen * 8)); \
+            TEST_ASSERT(BitInputStreamInitialize(&ref, &buf[0], buflen * 8)); \
+            TEST_ASSERT(BitInputStreamSeekBits(&bis, offset, SEEK_SET) == 0); \
+            TEST_ASSERT(BitInputStreamSeekBits(&ref, offset, SEEK_SET) == 0); \
+            r = BitInputStreamReadUIntArray##WIDTH(&bis, bits, count, values); \
+            TEST_ASSERT(BS_SUCCEEDED(r)); \
+            TEST_ASSERT(r._M_value.uint == count); \
+            for (i = 0; i < count; ++i) { \
+                TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUInt(&ref, bits))); \
+                TEST_ASSERT(values[i] == (T) r._M_value.uint); \
+            } \
+            TEST_ASSERT(values[count] == (T) 0x5a); \
+            TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == BitInputStreamGetBitPosition(&ref)); \
+            TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUInt(&bis, 7))); \
+            TEST_ASSERT(BS_SUCCEEDED(r2 = BitInputStreamReadUInt(&ref, 7))); \
+            TEST_ASSERT(r._M_value.uint == r2._M_value.uint); \
+        } \
+    }
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    size_t bits = 0;
+    size_t offset = 0;
+    ReadResult r, r2;
+
+    unsigned char buf[COUNT * 8 + 8];
+    size_t const buflen = sizeof(buf);
+
+    BitInputStream bis = {0};
+    BitInputStream ref = {0};
+
+    srand(3);
+    for (i = 0; i < buflen; ++i)
+        buf[i] = (unsigned char) rand();
+
+    CHECK_ARRAY(uint8_t, 8)
+    CHECK_ARRAY(uint16_t, 16)
+    CHECK_ARRAY(uint32_t, 32)
+    CHECK_ARRAY(uint64_t, 64)
+
+    /* the fields run up to the very last bit of the buffer. */
+    {
+        uint32_t values[8 * 9];
+        TEST_ASSERT(BitInputStreamInitialize(&bis, &buf[0], 9 * 8 * 8 + 3));
+        TEST_ASSERT(BitInputStreamSeekBits(&bis, 3, SEEK_SET) == 0);
+        TEST_ASSERT(BS_SUCCEEDED(BitInputStreamReadUIntArray32(&bis, 9, 8 * 8, values)));
+        TEST_ASSERT(BitInputStreamIsEOS(&bis));
+        TEST_ASSERT(values[63] == (((uint32_t) (buf[71] & 0x3f) << 3) | (buf[72] >> 5)));
+    }
+
+    /* nothing is consumed by failures. */
+    {
+        uint8_t values[4];
+        TEST_ASSERT(BitInputStreamInitialize(&bis, &buf[0], 20));
+        r = BitInputStreamReadUIntArray8(&bis, 7, 3, values);
+        TEST_ASSERT(r._M_status == BS_EOS && r._M_value.uint == 0);
+        r = BitInputStreamReadUIntArray8(&bis, 9, 1, values);
+        TEST_ASSERT(r._M_status == BS_FAIL && r._M_value.uint == 0);
+        r = BitInputStreamReadUIntArray8(&bis, 0, 1, values);
+        TEST_ASSERT(r._M_status == BS_FAIL && r._M_value.uint == 0);
+        TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == 0);
+        TEST_ASSERT(BS_SUCCEEDED(BitInputStreamReadUIntArray8(&bis, 5, 4, values)));
+        TEST_ASSERT(values[0] == buf[0] >> 3);
+    }
+
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    BitInputStreamRelease(&ref);
+    goto exit;
+}
@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define COUNT 150
+
+/* compares a bulk write of `count` fields against single WriteUInt calls. */
+#define CHECK_ARRAY(T, WIDTH) \
+    for (bits = 1; bits <= WIDTH; ++bits) { \
+        for (offset = 0; offset < 8; ++offset) { \
+            T values[COUNT]; \
+            size_t count = COUNT - offset; \
+            for (i = 0; i < count; ++i) \
+                values[i] = (T) (((uint64_t) rand() << 40) ^ ((uint64_t) rand() << 20) ^ (uint64_t) rand()); \
+            TEST_ASSERT(BitOutputStreamInitialize(&bos, NULL, 0)); \
+            TEST_ASSERT(BitOutputStreamInitialize(&ref, NULL, 0)); \
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, offset, 0x55))); \
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&ref, offset, 0x55))); \
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUIntArray##WIDTH(&bos, bits, count, values, BS_PACK_MASK))); \
+            for (i = 0; i < count; ++i) \
+                TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&ref, bits, values[i]))); \
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&bos, 5, 0x11))); \
+            TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUInt(&ref, 5, 0x11))); \
+            TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == BitOutputStreamGetBitSize(&ref)); \
+            TEST_ASSERT(BitOutputStreamPaddingBits(&bos, 0) == BitOutputStreamPaddingBits(&ref, 0)); \
+            TEST_ASSERT(memcmp(BitOutputStreamGetBuffer(&bos), BitOutputStreamGetBuffer(&ref), \
+                        BitOutputStreamGetSize(&bos)) == 0); \
+            BitOutputStreamRelease(&bos); \
+            BitOutputStreamRelease(&ref); \
+        } \
+    }
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    size_t bits = 0;
+    size_t offset = 0;
+
+    BitOutputStream bos = {0};
+    BitOutputStream ref = {0};
+
+    srand(4);
+
+    CHECK_ARRAY(uint8_t, 8)
+    CHECK_ARRAY(uint16_t, 16)
+    CHECK_ARRAY(uint32_t, 32)
+    CHECK_ARRAY(uint64_t, 64)
+
+    /* checking mode refuses values wider than the field, masking cuts them. */
+    {
+        uint16_t values[3] = { 1, 2, 8 };
+        unsigned char buf[2] = { 0, 0 };
+        TEST_ASSERT(BitOutputStreamInitialize(&bos, &buf[0], 16));
+        TEST_ASSERT(BitOutputStreamWriteUIntArray16(&bos, 3, 3, values, BS_PACK_CHECK)._M_status == BS_FAIL);
+        TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == 0);
+        TEST_ASSERT(BitOutputStreamWriteUIntArray16(&bos, 17, 1, values, BS_PACK_MASK)._M_status == BS_FAIL);
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUIntArray16(&bos, 4, 3, values, BS_PACK_CHECK)));
+        TEST_ASSERT(BS_SUCCEEDED(BitOutputStreamWriteUIntArray16(&bos, 3, 1, &values[2], BS_PACK_MASK)));
+        TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == 15);
+        BitOutputStreamFlush(&bos);
+        TEST_ASSERT(buf[0] == 0x12);
+        TEST_ASSERT((buf[1] & 0xfe) == 0x80);
+        /* fixed memory is full. */
+        TEST_ASSERT(BitOutputStreamWriteUIntArray16(&bos, 1, 2, values, BS_PACK_MASK)._M_status == BS_FAIL);
+        TEST_ASSERT(BitOutputStreamGetBitSize(&bos) == 15);
+        BitOutputStreamRelease(&bos);
+    }
+
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitOutputStreamRelease(&bos);
+    BitOutputStreamRelease(&ref);
+    goto exit;
+}
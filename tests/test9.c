@@ -0,0 +1,163 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/bitstream.h"
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            fprintf(stdout, "%s failed!\n", #CONDITION); \
+            goto failure; \
+        } \
+    } while (0)
+
+#define DATA_SIZE 5000
+
+typedef struct tagChunkedReader {
+    unsigned char const *data;
+    size_t size;
+    size_t offset;
+} ChunkedReader;
+
+/* hands out the data a few odd sized bytes at a time. */
+static size_t chunkedRead(void *context, void *buffer, size_t n) {
+    ChunkedReader *reader = (ChunkedReader*) context;
+    size_t chunk = 1 + reader->offset % 13;
+    if (chunk > n)
+        chunk = n;
+    if (chunk > reader->size - reader->offset)
+        chunk = reader->size - reader->offset;
+    memcpy(buffer, reader->data + reader->offset, chunk);
+    reader->offset += chunk;
+    return chunk;
+}
+
+/* reads the whole stream back with mixed widths against the in memory one. */
+static int compareStreams(BitInputStream *bis, unsigned char const *data) {
+    int rc = 0;
+    size_t bits = 0;
+    ReadResult r, r2;
+    BitInputStream ref = {0};
+
+    BitInputStreamInitialize(&ref, data, DATA_SIZE * 8);
+    for (bits = 1; ; bits = bits % 64 + 1) {
+        r2 = BitInputStreamReadUInt(&ref, bits);
+        r = BitInputStreamReadUInt(bis, bits);
+        if (!BS_SUCCEEDED(r2))
+            break;
+        TEST_ASSERT(BS_SUCCEEDED(r));
+        TEST_ASSERT(r._M_value.uint == r2._M_value.uint);
+        TEST_ASSERT(BitInputStreamGetBitPosition(bis) == BitInputStreamGetBitPosition(&ref));
+    }
+    TEST_ASSERT(r._M_status == BS_EOS);
+    TEST_ASSERT(BitInputStreamGetBitSize(bis) == DATA_SIZE * 8);
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&ref);
+    goto exit;
+}
+
+int main(int argc, char* *argv) {
+    int rc = 0;
+    size_t i = 0;
+    ReadResult r;
+    int fds[2] = { -1, -1 };
+    FILE *fp = NULL;
+
+    unsigned char data[DATA_SIZE];
+    uint16_t values[2000];
+    ChunkedReader reader = { data, DATA_SIZE, 0 };
+
+    BitInputStream bis = {0};
+
+    srand(5);
+    for (i = 0; i < DATA_SIZE; ++i)
+        data[i] = (unsigned char) rand();
+
+    /* callback source through the smallest window. */
+    TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &chunkedRead, &reader, 1));
+    TEST_ASSERT(compareStreams(&bis, data) == EXIT_SUCCESS);
+    TEST_ASSERT(!BitInputStreamIsEOS(&bis));
+    TEST_ASSERT(BitInputStreamSeekBits(&bis, 0, SEEK_END) == 0);
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+    BitInputStreamRelease(&bis);
+
+    /* mark and reset inside the window, forward and backward seeks. */
+    reader.offset = 0;
+    TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &chunkedRead, &reader, 256));
+    TEST_ASSERT(BitInputStreamSeekBits(&bis, 1001 * 8 + 3, SEEK_SET) == 0);
+    BitInputStreamMark(&bis);
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUInt(&bis, 13)));
+    for (i = 0; i < 100; ++i)
+        TEST_ASSERT(BS_SUCCEEDED(BitInputStreamReadUInt(&bis, 17)));
+    BitInputStreamReset(&bis);
+    TEST_ASSERT(BitInputStreamGetBitPosition(&bis) == 1001 * 8 + 3);
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUInt(&bis, 13)));
+    TEST_ASSERT(r._M_value.uint == ((((uint64_t) data[1001] << 16) | ((uint64_t) data[1002] << 8) | data[1003]) >> 8) % 8192);
+    TEST_ASSERT(BitInputStreamSeekBits(&bis, -16, SEEK_CUR) == 0);
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUInt(&bis, 8)));
+    TEST_ASSERT(r._M_value.uint == data[1001]);
+    TEST_ASSERT(BitInputStreamSeekBits(&bis, 0, SEEK_SET) != 0);
+    TEST_ASSERT(BitInputStreamSeek(&bis, -1, SEEK_END) == 0);
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUInt(&bis, 8)));
+    TEST_ASSERT(r._M_value.uint == data[DATA_SIZE - 1]);
+    TEST_ASSERT(BitInputStreamIsEOS(&bis));
+    BitInputStreamRelease(&bis);
+
+    /* bulk reads across window boundaries. */
+    reader.offset = 0;
+    TEST_ASSERT(BitInputStreamInitializeWithReader(&bis, &chunkedRead, &reader, 100));
+    TEST_ASSERT(BS_SUCCEEDED(BitInputStreamReadUInt(&bis, 5)));
+    TEST_ASSERT(BS_SUCCEEDED(r = BitInputStreamReadUIntArray16(&bis, 11, 1000, values)));
+    TEST_ASSERT(r._M_value.uint == 1000);
+    TEST_ASSERT(values[999] == ((((uint32_t) data[1374] << 16) | ((uint32_t) data[1375] << 8)) >> 11) % 2048);
+    r = BitInputStreamReadUIntArray16(&bis, 16, 2000, values);
+    TEST_ASSERT(r._M_status == BS_EOS);
+    TEST_ASSERT(r._M_value.uint == (DATA_SIZE * 8 - 11005) / 16);
+    BitInputStreamRelease(&bis);
+
+    /* file descriptor, here a pipe. */
+    TEST_ASSERT(pipe(fds) == 0);
+    TEST_ASSERT(write(fds[1], data, DATA_SIZE) == DATA_SIZE);
+    close(fds[1]);
+    fds[1] = -1;
+    TEST_ASSERT(BitInputStreamInitializeWithFd(&bis, fds[0], 512));
+    TEST_ASSERT(compareStreams(&bis, data) == EXIT_SUCCESS);
+    BitInputStreamRelease(&bis);
+
+    /* stdio stream. */
+    TEST_ASSERT((fp = tmpfile()) != NULL);
+    TEST_ASSERT(fwrite(data, 1, DATA_SIZE, fp) == DATA_SIZE);
+    rewind(fp);
+    TEST_ASSERT(BitInputStreamInitializeWithFile(&bis, fp, 0));
+    TEST_ASSERT(compareStreams(&bis, data) == EXIT_SUCCESS);
+
+    goto success;
+exit:
+    return rc;
+failure:
+    rc = EXIT_FAILURE;
+    goto cleanup;
+success:
+    rc = EXIT_SUCCESS;
+    goto cleanup;
+cleanup:
+    BitInputStreamRelease(&bis);
+    if (fp)
+        fclose(fp);
+    if (fds[0] >= 0)
+        close(fds[0]);
+    if (fds[1] >= 0)
+        close(fds[1]);
+    goto exit;
+}